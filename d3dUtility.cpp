@@ -149,7 +149,13 @@ int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
 	MSG msg;
 	::ZeroMemory(&msg, sizeof(MSG));
 
-	static double lastTime = (double)timeGetTime(); 
+	// performance counter instead of timeGetTime(): timeGetTime() only has millisecond
+	// resolution, which is most of a frame at high frame rates.
+	LARGE_INTEGER frequency;
+	::QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER lastTime;
+	::QueryPerformanceCounter(&lastTime);
 
 	while(msg.message != WM_QUIT)
 	{
@@ -160,8 +166,10 @@ int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
 		}
 		else
         {	
-			double currTime  = (double)timeGetTime();
-			double timeDelta = (currTime - lastTime)*0.0007;
+			LARGE_INTEGER currTime;
+			::QueryPerformanceCounter(&currTime);
+			double ms        = (double)(currTime.QuadPart - lastTime.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+			double timeDelta = ms*0.0007;
 			ptr_display((float)timeDelta);
 
 			lastTime = currTime;
@@ -0,0 +1,153 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: levelConvert.cpp
+//
+// Desc: Converts levels between the text and the binary format, and writes generated levels.
+//
+//       Build (Linux):  g++ -std=c++14 -O2 -o levelConvert simLevel.cpp levelConvert.cpp
+//       Usage:          levelConvert in.txt|in.bin out.txt|out.bin
+//                       levelConvert -default out.txt|out.bin
+//                       levelConvert -grid N out.txt|out.bin
+//                       levelConvert -chunks seed count dir
+//
+//       Text format, one item per line, '#' starts a comment line:
+//           plane x y z width height depth color
+//           wall  x y z width height depth color
+//           brick x z color [hits [sphere|box|capsule]]
+//       colors are 0xAARRGGBB. there is exactly one plane; walls and bricks keep their order.
+//
+//       -chunks writes the chunks 0 .. count-1 of the streamed level of seed into dir (which
+//       has to exist), for simRunner -stream count -chunks dir.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simLevel.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// brick spacing of the generated levels: the 0.43 of the built-in layout in both directions
+#define GRID_SPACING 0.43f
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s in.txt|in.bin out.txt|out.bin\n", prog);
+	fprintf(stderr, "       %s -default out.txt|out.bin\n", prog);
+	fprintf(stderr, "       %s -grid N out.txt|out.bin\n", prog);
+	fprintf(stderr, "       %s -chunks seed count dir\n", prog);
+}
+
+static bool isText(const char* path)
+{
+	size_t len = strlen(path);
+	return len >= 4 && strcmp(path + len - 4, ".txt") == 0;
+}
+
+static sim::LevelWall box(float x, float z, float width, float depth, float y, float height, unsigned int color)
+{
+	sim::LevelWall w;
+	w.x = x; w.y = y; w.z = z;
+	w.width = width; w.height = height; w.depth = depth;
+	w.color = color;
+	w.reserved = 0;
+	return w;
+}
+
+// a square of N bricks on a plane grown to fit, walled like the built-in level
+static void makeGrid(sim::Level& level, int count)
+{
+	int side = (int)ceil(sqrt((double)count));
+	float extent = side * GRID_SPACING;
+	float width = extent * 1.5f + 1.0f;        // room between the bricks and the open edge
+	float depth = extent + 1.0f;
+
+	sim::Level base;
+	base.makeDefault();
+	unsigned int planeColor = base.getPlane().color;
+	unsigned int wallColor = base.getWalls()[0].color;
+	unsigned int brickColor = base.getBrickColor()[0];
+
+	std::vector<sim::LevelWall> walls;
+	walls.push_back(box(0.0f, depth / 2 + 0.06f, width, 0.12f, 0.12f, 0.3f, wallColor));
+	walls.push_back(box(0.0f, -depth / 2 - 0.06f, width, 0.12f, 0.12f, 0.3f, wallColor));
+	walls.push_back(box(-width / 2 - 0.06f, 0.0f, 0.12f, depth + 0.24f, 0.12f, 0.3f, wallColor));
+
+	std::vector<float> xs(count), zs(count);
+	for (int i = 0; i < count; i++) {
+		xs[i] = -width / 2 + 0.5f + (i / side) * GRID_SPACING;
+		zs[i] = -extent / 2 + (i % side) * GRID_SPACING;
+	}
+	sim::BrickAttr attr;
+	attr.hits = 1;
+	attr.shape = sim::BRICK_SPHERE;
+
+	level.assign(box(0.0f, 0.0f, width, depth, -0.0006f / 5, 0.03f, planeColor), walls, xs, zs,
+		std::vector<unsigned int>(count, brickColor), std::vector<sim::BrickAttr>(count, attr));
+}
+
+// the chunk files of a streamed level
+static int writeChunks(unsigned int seed, int count, const char* dir)
+{
+	long long bricks = 0;
+	for (int c = 0; c < count; c++) {
+		char path[1024];
+		snprintf(path, sizeof(path), CHUNK_FILE_FORMAT, dir, c);
+		sim::Level chunk;
+		chunk.makeChunk(seed, c);
+		if (!chunk.saveBinary(path)) {
+			fprintf(stderr, "can not write %s\n", path);
+			return 1;
+		}
+		bricks += chunk.getBrickCount();
+	}
+	printf("%s: %d chunks, %lld bricks\n", dir, count, bricks);
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	sim::Level level;
+	const char* out;
+
+	if (argc == 5 && strcmp(argv[1], "-chunks") == 0) {
+		int count = atoi(argv[3]);
+		if (count <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+		return writeChunks((unsigned int)strtoul(argv[2], NULL, 0), count, argv[4]);
+	}
+	if (argc == 3 && strcmp(argv[1], "-default") == 0) {
+		level.makeDefault();
+		out = argv[2];
+	}
+	else if (argc == 4 && strcmp(argv[1], "-grid") == 0) {
+		int count = atoi(argv[2]);
+		if (count <= 0) {
+			usage(argv[0]);
+			return 1;
+		}
+		makeGrid(level, count);
+		out = argv[3];
+	}
+	else if (argc == 3 && argv[1][0] != '-') {
+		if (!level.load(argv[1])) {
+			fprintf(stderr, "%s: %s\n", argv[1], level.getError());
+			return 1;
+		}
+		out = argv[2];
+	}
+	else {
+		usage(argv[0]);
+		return 1;
+	}
+
+	bool ok = isText(out) ? level.saveText(out) : level.saveBinary(out);
+	if (!ok) {
+		fprintf(stderr, "can not write %s\n", out);
+		return 1;
+	}
+	printf("%s: %d bricks, %d walls\n", out, level.getBrickCount(), level.getWallCount());
+	return 0;
+}
@@ -0,0 +1,452 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simBatch.cpp
+//
+// Desc: Batch engine: thousands of independent games stepped four at a time.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simBatch.h"
+#include "simKernel.h"
+#include "simThreads.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIM_BATCH_SSE2
+#include <emmintrin.h>
+#endif
+
+// the lane operations of a group. one set for SSE2, one plain C++ set with the same float
+// operations for other platforms, so both give the same results.
+namespace
+{
+#if defined(SIM_BATCH_SSE2)
+	typedef __m128 F4;                   // one float per game
+	typedef __m128 M4;                   // all bits set in the lanes a test passed
+
+	inline F4 vload(const float* p) { return _mm_loadu_ps(p); }
+	inline void vstore(float* p, F4 a) { _mm_storeu_ps(p, a); }
+	inline F4 vset(float f) { return _mm_set1_ps(f); }
+	inline F4 vadd(F4 a, F4 b) { return _mm_add_ps(a, b); }
+	inline F4 vsub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+	inline F4 vmul(F4 a, F4 b) { return _mm_mul_ps(a, b); }
+	inline F4 vmin(F4 a, F4 b) { return _mm_min_ps(a, b); }
+	inline F4 vmax(F4 a, F4 b) { return _mm_max_ps(a, b); }
+	inline F4 vabs(F4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	inline M4 vle(F4 a, F4 b) { return _mm_cmple_ps(a, b); }
+	inline M4 vlt(F4 a, F4 b) { return _mm_cmplt_ps(a, b); }
+	inline M4 vand(M4 a, M4 b) { return _mm_and_ps(a, b); }
+	inline M4 vor(M4 a, M4 b) { return _mm_or_ps(a, b); }
+	inline F4 vsel(M4 m, F4 a, F4 b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	inline int vbits(M4 m) { return _mm_movemask_ps(m); }
+
+	// smallest / largest of the four lanes
+	inline float vminLanes(F4 a)
+	{
+		a = _mm_min_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(_mm_min_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1))));
+	}
+	inline float vmaxLanes(F4 a)
+	{
+		a = _mm_max_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(_mm_max_ss(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1))));
+	}
+
+	// lane l passes when bit l of bits is set
+	inline M4 vlanes(int bits)
+	{
+		const __m128i lane = _mm_set_epi32(8, 4, 2, 1);
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), lane), lane));
+	}
+
+	// lane l passes when bit is set in words[l]
+	inline M4 vhasBit(const unsigned int* words, unsigned int bit)
+	{
+		const __m128i b = _mm_set1_epi32((int)bit);
+		__m128i w = _mm_loadu_si128((const __m128i*)words);
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(w, b), b));
+	}
+#else
+	struct F4 { float f[4]; };
+	struct M4 { bool b[4]; };
+
+	inline F4 vload(const float* p) { F4 r; for (int l = 0; l < 4; l++) r.f[l] = p[l]; return r; }
+	inline void vstore(float* p, F4 a) { for (int l = 0; l < 4; l++) p[l] = a.f[l]; }
+	inline F4 vset(float f) { F4 r; for (int l = 0; l < 4; l++) r.f[l] = f; return r; }
+	inline F4 vadd(F4 a, F4 b) { for (int l = 0; l < 4; l++) a.f[l] = a.f[l] + b.f[l]; return a; }
+	inline F4 vsub(F4 a, F4 b) { for (int l = 0; l < 4; l++) a.f[l] = a.f[l] - b.f[l]; return a; }
+	inline F4 vmul(F4 a, F4 b) { for (int l = 0; l < 4; l++) a.f[l] = a.f[l] * b.f[l]; return a; }
+	inline F4 vmin(F4 a, F4 b) { for (int l = 0; l < 4; l++) a.f[l] = a.f[l] < b.f[l] ? a.f[l] : b.f[l]; return a; }
+	inline F4 vmax(F4 a, F4 b) { for (int l = 0; l < 4; l++) a.f[l] = a.f[l] > b.f[l] ? a.f[l] : b.f[l]; return a; }
+	inline F4 vabs(F4 a) { for (int l = 0; l < 4; l++) a.f[l] = fabsf(a.f[l]); return a; }
+	inline M4 vle(F4 a, F4 b) { M4 m; for (int l = 0; l < 4; l++) m.b[l] = a.f[l] <= b.f[l]; return m; }
+	inline M4 vlt(F4 a, F4 b) { M4 m; for (int l = 0; l < 4; l++) m.b[l] = a.f[l] < b.f[l]; return m; }
+	inline M4 vand(M4 a, M4 b) { for (int l = 0; l < 4; l++) a.b[l] = a.b[l] && b.b[l]; return a; }
+	inline M4 vor(M4 a, M4 b) { for (int l = 0; l < 4; l++) a.b[l] = a.b[l] || b.b[l]; return a; }
+	inline F4 vsel(M4 m, F4 a, F4 b) { for (int l = 0; l < 4; l++) if (!m.b[l]) a.f[l] = b.f[l]; return a; }
+	inline int vbits(M4 m) { int bits = 0; for (int l = 0; l < 4; l++) if (m.b[l]) bits |= 1 << l; return bits; }
+	inline float vminLanes(F4 a) { float r = a.f[0]; for (int l = 1; l < 4; l++) r = a.f[l] < r ? a.f[l] : r; return r; }
+	inline float vmaxLanes(F4 a) { float r = a.f[0]; for (int l = 1; l < 4; l++) r = a.f[l] > r ? a.f[l] : r; return r; }
+	inline M4 vlanes(int bits) { M4 m; for (int l = 0; l < 4; l++) m.b[l] = ((bits >> l) & 1) != 0; return m; }
+	inline M4 vhasBit(const unsigned int* words, unsigned int bit) { M4 m; for (int l = 0; l < 4; l++) m.b[l] = (words[l] & bit) != 0; return m; }
+#endif
+
+	// lanes inside [minX, maxX] x [minZ, maxZ], the compares of Wall::hasIntersected
+	inline M4 vinside(F4 x, F4 z, float minX, float maxX, float minZ, float maxZ)
+	{
+		return vand(vand(vle(vset(minX), x), vle(x, vset(maxX))), vand(vle(vset(minZ), z), vle(z, vset(maxZ))));
+	}
+
+	// a sphere with the state of one lane, for the hit responses of Wall / Sphere
+	sim::Sphere laneSphere(float x, float y, float z, float vx, float vz, bool control)
+	{
+		sim::Sphere s;
+		s.setCenter(x, y, z);
+		s.setPower(vx, vz);
+		s.setControlBall(control);
+		return s;
+	}
+
+	// lanes of a group as plain floats, for the responses
+	struct Lanes
+	{
+		float f[4];
+		void load(F4 v) { vstore(f, v); }
+		F4 get(void) const { return vload(f); }
+	};
+
+	// bounds of the four lanes, grown by reach: minX, minZ, maxX, maxZ
+	inline void laneBox(F4 x, F4 z, float reach, float box[4])
+	{
+		box[0] = vminLanes(x) - reach;
+		box[1] = vminLanes(z) - reach;
+		box[2] = vmaxLanes(x) + reach;
+		box[3] = vmaxLanes(z) + reach;
+	}
+}
+
+sim::BatchWorld::BatchWorld(void)
+{
+	launchSpeed = 2.5f;
+	workers = NULL;
+	m_count = 0;
+	m_padded = 0;
+	m_actions = NULL;
+	m_timeDelta = 0.0f;
+}
+
+void sim::BatchWorld::setup(const Level& level, int count)
+{
+	m_count = count;
+	m_padded = (count + LANES - 1) / LANES * LANES;
+
+	// level: the same values World::setup and World::moveControl derive
+	const LevelWall& plane = level.getPlane();
+	int wallCount = level.getWallCount();
+	m_walls.assign(wallCount, Wall());
+	std::vector<float> wallMinX(wallCount), wallMinZ(wallCount), wallMaxX(wallCount), wallMaxZ(wallCount);
+	for (int j = 0; j < wallCount; j++) {
+		const LevelWall& w = level.getWalls()[j];
+		m_walls[j].setSize(w.width, w.height, w.depth);
+		m_walls[j].setPosition(w.x, w.y, w.z);
+		wallMinX[j] = w.x - m_walls[j].getWidth() / 2;
+		wallMaxX[j] = w.x + m_walls[j].getWidth() / 2;
+		wallMinZ[j] = w.z - m_walls[j].getDepth() / 2;
+		wallMaxZ[j] = w.z + m_walls[j].getDepth() / 2;
+	}
+	m_wallTree.build(wallMinX.data(), wallMinZ.data(), wallMaxX.data(), wallMaxZ.data(), wallCount);
+
+	int brickCount = level.getBrickCount();
+	m_brickX.assign(level.getBrickX(), level.getBrickX() + brickCount);
+	m_brickZ.assign(level.getBrickZ(), level.getBrickZ() + brickCount);
+	m_brickMinX = m_brickMinZ = 0.0f;
+	m_brickMaxX = m_brickMaxZ = -1.0f;
+	for (int i = 0; i < brickCount; i++) {
+		if (i == 0 || m_brickX[i] < m_brickMinX) m_brickMinX = m_brickX[i];
+		if (i == 0 || m_brickX[i] > m_brickMaxX) m_brickMaxX = m_brickX[i];
+		if (i == 0 || m_brickZ[i] < m_brickMinZ) m_brickMinZ = m_brickZ[i];
+		if (i == 0 || m_brickZ[i] > m_brickMaxZ) m_brickMaxZ = m_brickZ[i];
+	}
+
+	const float radius = (float)M_RADIUS;
+	float edge = plane.x + plane.width / 2;
+	m_ballY = (float)M_RADIUS;
+	float controlX = (float)(edge - M_RADIUS);
+	m_startX = (float)(edge - 3 * M_RADIUS);
+	m_outOfField = plane.x + plane.width / 2 + 3.5f;
+	if (wallCount >= 2) {
+		m_controlMaxZ = m_walls[0].getCenter().z - m_walls[0].getDepth() / 2 - radius;
+		m_controlMinZ = m_walls[1].getCenter().z + m_walls[1].getDepth() / 2 + radius;
+	}
+	else {
+		m_controlMaxZ = plane.z + plane.depth / 2 - radius;
+		m_controlMinZ = plane.z - plane.depth / 2 + radius;
+	}
+
+	// the smallest speed Sphere::isResting takes as moving, whatever the math mode
+	auto moving = [](float speed) { Sphere s; s.setPower(speed, 0.0); return !s.isResting(); };
+	m_restSpeed = 0.01f;
+	while (!moving(m_restSpeed)) m_restSpeed = nextafterf(m_restSpeed, 1.0f);
+	while (moving(nextafterf(m_restSpeed, 0.0f))) m_restSpeed = nextafterf(m_restSpeed, 0.0f);
+
+	// games, padding lanes included so every group is a full one
+	m_ballX.assign(m_padded, m_startX);
+	m_ballZ.assign(m_padded, 0.0f);
+	m_ballVX.assign(m_padded, 0.0f);
+	m_ballVZ.assign(m_padded, 0.0f);
+	m_controlX.assign(m_padded, controlX);
+	m_controlZ.assign(m_padded, 0.0f);
+	m_started.assign(m_padded, 0);
+	m_restarts.assign(m_padded, 0);
+
+	int words = HIT_MASK_WORDS(brickCount);
+	m_initialAlive.assign(words, 0);
+	for (int i = 0; i < brickCount; i++) m_initialAlive[i >> 5] |= 1u << (i & 31);
+	m_alive.resize((size_t)words * m_padded);
+	for (int w = 0; w < words; w++) {
+		std::fill(m_alive.begin() + (size_t)w * m_padded, m_alive.begin() + (size_t)(w + 1) * m_padded, m_initialAlive[w]);
+	}
+}
+
+void sim::BatchWorld::place(int game, const Vec3& ball, const Vec3& velocity)
+{
+	m_ballX[game] = ball.x;
+	m_ballZ[game] = ball.z;
+	m_ballVX[game] = velocity.x;
+	m_ballVZ[game] = velocity.z;
+	m_started[game] = 1;
+}
+
+bool sim::BatchWorld::isBrickAlive(int game, int brick) const
+{
+	return ((m_alive[(size_t)(brick >> 5) * m_padded + game] >> (brick & 31)) & 1) != 0;
+}
+
+int sim::BatchWorld::getLiveBricks(int game) const
+{
+	int n = 0;
+	for (int i = 0; i < getBrickCount(); i++) n += isBrickAlive(game, i) ? 1 : 0;
+	return n;
+}
+
+void sim::BatchWorld::step(const unsigned char* actions, float timeDelta)
+{
+	m_actions = actions;
+	m_timeDelta = timeDelta;
+
+	int groups = m_padded / LANES;
+	int parts = workers != NULL ? workers->getThreadCount() : 1;
+	if ((int)m_wallIds.size() < parts) m_wallIds.resize(parts);
+	if (workers != NULL) workers->run(groups, groupTask, this);
+	else groupTask(this, 0, 0, groups);
+}
+
+void sim::BatchWorld::groupTask(void* context, int part, int begin, int end)
+{
+	BatchWorld* batch = (BatchWorld*)context;
+	for (int g = begin; g < end; g++) batch->stepGroup(g, batch->m_wallIds[part]);
+}
+
+void sim::BatchWorld::stepGroup(int group, std::vector<int>& ids)
+{
+	const int base = group * LANES;
+	const int brickCount = getBrickCount();
+	const float radius = (float)M_RADIUS;
+	const F4 zero = vset(0.0f);
+
+	F4 x = vload(&m_ballX[base]);
+	F4 z = vload(&m_ballZ[base]);
+	F4 vx = vload(&m_ballVX[base]);
+	F4 vz = vload(&m_ballVZ[base]);
+	F4 cx = vload(&m_controlX[base]);
+	F4 cz = vload(&m_controlZ[base]);
+	Lanes lx, lz, lvx, lvz;
+
+	// actions, in the order of the input handler: move, move, launch
+	int left = 0, right = 0, launch = 0, started = 0;
+	for (int l = 0; l < LANES; l++) {
+		unsigned char a = base + l < m_count ? m_actions[base + l] : 0;
+		if (a & BATCH_LEFT) left |= 1 << l;
+		if (a & BATCH_RIGHT) right |= 1 << l;
+		if (a & BATCH_LAUNCH) launch |= 1 << l;
+		if (m_started[base + l]) started |= 1 << l;
+	}
+	const F4 minZ = vset(m_controlMinZ), maxZ = vset(m_controlMaxZ);
+	if (left) cz = vsel(vlanes(left), vmax(vmin(vadd(cz, vset(-BATCH_CONTROL_STEP)), maxZ), minZ), cz);
+	if (right) cz = vsel(vlanes(right), vmax(vmin(vadd(cz, vset(BATCH_CONTROL_STEP)), maxZ), minZ), cz);
+	if (launch & ~started) {
+		M4 go = vlanes(launch & ~started);
+		vx = vsel(go, vset(-launchSpeed), vx);
+		vz = vsel(go, zero, vz);
+		started |= launch;
+	}
+
+	// ballUpdate. the control ball never has a velocity, so it never moves.
+	{
+		const F4 rest = vset(m_restSpeed);
+		const F4 k = vset(TIME_SCALE * m_timeDelta);
+		M4 moving = vor(vle(rest, vabs(vx)), vle(rest, vabs(vz)));
+		x = vsel(moving, vadd(x, vmul(k, vx)), x);
+		z = vsel(moving, vadd(z, vmul(k, vz)), z);
+		vx = vsel(moving, vx, zero);
+		vz = vsel(moving, vz, zero);
+	}
+
+	// walls: World::hitWalls, at most WALL_PASSES passes over the walls, and a pass that
+	// hits nothing ends them. the tree gives the walls around the four balls in index order;
+	// after a hit the rest of the pass looks around the new positions.
+	const float wallReach = radius + WALL_TREE_MARGIN;
+	const int wallPasses = WALL_PASSES((int)m_walls.size());
+	for (int pass = 0; pass < wallPasses; pass++) {
+		int any = 0;
+		float box[4];
+		laneBox(x, z, wallReach, box);
+		ids.clear();
+		m_wallTree.query(box[0], box[1], box[2], box[3], ids);
+		for (int h = 0; h < (int)ids.size(); h++) {
+			const int j = ids[h];
+			Wall& wall = m_walls[j];
+			Vec3 c = wall.getCenter();
+			int bits = vbits(vinside(x, z,
+				c.x - wall.getWidth() / 2 - radius, c.x + wall.getWidth() / 2 + radius,
+				c.z - wall.getDepth() / 2 - radius, c.z + wall.getDepth() / 2 + radius));
+			if (!bits) continue;
+
+			lx.load(x); lz.load(z); lvx.load(vx); lvz.load(vz);
+			for (int l = 0; l < LANES; l++) {
+				if (!(bits & (1 << l))) continue;
+				Sphere ball = laneSphere(lx.f[l], m_ballY, lz.f[l], lvx.f[l], lvz.f[l], false);
+				wall.hitBy(ball);
+				lx.f[l] = ball.getCenter().x; lz.f[l] = ball.getCenter().z;
+				lvx.f[l] = (float)ball.getVelocity_X(); lvz.f[l] = (float)ball.getVelocity_Z();
+			}
+			x = lx.get(); z = lz.get(); vx = lvx.get(); vz = lvz.get();
+			any |= bits;
+
+			laneBox(x, z, wallReach, box);
+			ids.clear();
+			m_wallTree.query(box[0], box[1], box[2], box[3], ids);
+			h = (int)(std::upper_bound(ids.begin(), ids.end(), j) - ids.begin()) - 1;
+		}
+		if (!any) break;
+	}
+
+	// bricks, in index order. the ball does not move meanwhile, only its velocity
+	// changes, and only for the lanes a brick hits. like the grid query of
+	// World::touchedBricks, the float test only picks the candidates, padded by
+	// HIT_MASK_MARGIN, and hitBy decides.
+	const float reach = radius + radius;
+	const float brickNear = reach + HIT_MASK_MARGIN;
+	if (brickCount > 0 && vbits(vinside(x, z, m_brickMinX - brickNear, m_brickMaxX + brickNear, m_brickMinZ - brickNear,
+		m_brickMaxZ + brickNear))) {
+		const F4 r2 = vset(brickNear * brickNear);
+		bool loaded = false;
+		for (int i = 0; i < brickCount; i++) {
+			unsigned int* alive = &m_alive[(size_t)(i >> 5) * m_padded + base];
+			F4 dx = vsub(vset(m_brickX[i]), x);
+			F4 dz = vsub(vset(m_brickZ[i]), z);
+			int bits = vbits(vand(vlt(vadd(vmul(dx, dx), vmul(dz, dz)), r2), vhasBit(alive, 1u << (i & 31))));
+			if (!bits) continue;
+
+			if (!loaded) {
+				lx.load(x); lz.load(z); lvx.load(vx); lvz.load(vz);
+				loaded = true;
+			}
+			for (int l = 0; l < LANES; l++) {
+				if (!(bits & (1 << l))) continue;
+				Sphere brick = laneSphere(m_brickX[i], m_ballY, m_brickZ[i], 0.0f, 0.0f, false);
+				Sphere ball = laneSphere(lx.f[l], m_ballY, lz.f[l], lvx.f[l], lvz.f[l], false);
+				if (brick.hitBy(ball)) {
+					alive[l] &= ~(1u << (i & 31));
+					lvx.f[l] = (float)ball.getVelocity_X(); lvz.f[l] = (float)ball.getVelocity_Z();
+				}
+			}
+		}
+		if (loaded) { vx = lvx.get(); vz = lvz.get(); }
+	}
+
+	// control ball: walls push it back, then it bounces the ball
+	float box[4];
+	laneBox(cx, cz, wallReach, box);
+	ids.clear();
+	m_wallTree.query(box[0], box[1], box[2], box[3], ids);
+	for (int h = 0; h < (int)ids.size(); h++) {
+		const int j = ids[h];
+		Wall& wall = m_walls[j];
+		Vec3 c = wall.getCenter();
+		int bits = vbits(vinside(cx, cz,
+			c.x - wall.getWidth() / 2 - radius, c.x + wall.getWidth() / 2 + radius,
+			c.z - wall.getDepth() / 2 - radius, c.z + wall.getDepth() / 2 + radius));
+		if (!bits) continue;
+
+		Lanes lcx, lcz;
+		lcx.load(cx); lcz.load(cz);
+		for (int l = 0; l < LANES; l++) {
+			if (!(bits & (1 << l))) continue;
+			Sphere control = laneSphere(lcx.f[l], m_ballY, lcz.f[l], 0.0f, 0.0f, true);
+			wall.hitBy(control);
+			lcx.f[l] = control.getCenter().x; lcz.f[l] = control.getCenter().z;
+		}
+		cx = lcx.get(); cz = lcz.get();
+
+		laneBox(cx, cz, wallReach, box);
+		ids.clear();
+		m_wallTree.query(box[0], box[1], box[2], box[3], ids);
+		h = (int)(std::upper_bound(ids.begin(), ids.end(), j) - ids.begin()) - 1;
+	}
+	{
+		// Sphere::hasIntersected may compare in double, so this float test only picks the
+		// candidates with some margin and hitBy decides
+		const float near = reach + HIT_MASK_MARGIN;
+		F4 dx = vsub(cx, x);
+		F4 dz = vsub(cz, z);
+		int bits = vbits(vlt(vadd(vmul(dx, dx), vmul(dz, dz)), vset(near * near)));
+		if (bits) {
+			Lanes lcx, lcz;
+			lx.load(x); lz.load(z); lvx.load(vx); lvz.load(vz);
+			lcx.load(cx); lcz.load(cz);
+			for (int l = 0; l < LANES; l++) {
+				if (!(bits & (1 << l))) continue;
+				Sphere control = laneSphere(lcx.f[l], m_ballY, lcz.f[l], 0.0f, 0.0f, true);
+				Sphere ball = laneSphere(lx.f[l], m_ballY, lz.f[l], lvx.f[l], lvz.f[l], false);
+				if (control.hitBy(ball)) {
+					lvx.f[l] = (float)ball.getVelocity_X(); lvz.f[l] = (float)ball.getVelocity_Z();
+				}
+			}
+			vx = lvx.get(); vz = lvz.get();
+		}
+	}
+
+	// not started: the ball follows the control ball
+	const F4 followX = vsub(cx, vset(2 * radius));
+	if (started != 0xf) {
+		M4 follow = vlanes(~started & 0xf);
+		x = vsel(follow, followX, x);
+		z = vsel(follow, cz, z);
+	}
+
+	// out of field: restart the game
+	int out = vbits(vle(vset(m_outOfField), x));
+	if (out) {
+		M4 reset = vlanes(out);
+		x = vsel(reset, followX, x);
+		z = vsel(reset, cz, z);
+		vx = vsel(reset, zero, vx);
+		vz = vsel(reset, zero, vz);
+		started &= ~out;
+		for (int l = 0; l < LANES; l++) {
+			if (!(out & (1 << l))) continue;
+			m_restarts[base + l]++;
+			for (size_t w = 0; w < m_initialAlive.size(); w++) m_alive[w * m_padded + base + l] = m_initialAlive[w];
+		}
+	}
+
+	vstore(&m_ballX[base], x);
+	vstore(&m_ballZ[base], z);
+	vstore(&m_ballVX[base], vx);
+	vstore(&m_ballVZ[base], vz);
+	vstore(&m_controlX[base], cx);
+	vstore(&m_controlZ[base], cz);
+	for (int l = 0; l < LANES; l++) m_started[base + l] = (unsigned char)((started >> l) & 1);
+}
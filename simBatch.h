@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simBatch.h
+//
+// Desc: Batch engine: thousands of independent games of one level, kept as structure of
+//       arrays and stepped together, four games per SSE register. Every game takes its own
+//       action byte per step.
+//
+//       A game steps exactly like a World in discrete mode with one ball: the tests run
+//       across the games in SIMD, and the rare hit responses run per game through the same
+//       sim::Wall / sim::Sphere code World uses, so both give bit identical results. The
+//       bricks do not move (they never do in the game); only their alive bits are per game.
+//       Every brick plays as a one hit sphere: levels with other shapes or multi-hit bricks
+//       (BrickAttr) only step like a World when they have neither.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simBatchH__
+#define __simBatchH__
+
+#include "simCore.h"
+#include "simLevel.h"
+#include <vector>
+
+// action bits, applied in this order before the step: move, move, launch
+#define BATCH_LEFT   0x01               // World::moveControl(-BATCH_CONTROL_STEP)
+#define BATCH_RIGHT  0x02               // World::moveControl(+BATCH_CONTROL_STEP)
+#define BATCH_LAUNCH 0x04               // World::launch()
+
+// keyboard speed of the control ball (VK_LEFT / VK_RIGHT)
+#define BATCH_CONTROL_STEP 0.1f
+
+namespace sim
+{
+	class WorkerPool;
+
+	class BatchWorld
+	{
+	public:
+		enum { LANES = 4 };              // games per SIMD group
+
+		BatchWorld(void);
+
+		// count games, each in the state World::setup(level) leaves a world in
+		void setup(const Level& level, int count);
+
+		// one step of every game. actions holds one byte per game (BATCH_* bits).
+		void step(const unsigned char* actions, float timeDelta);
+
+		// puts the ball of game, launched, at ball moving at velocity (x and z), to check
+		// single positions against World
+		void place(int game, const Vec3& ball, const Vec3& velocity);
+
+		int getCount(void) const { return m_count; }
+		Vec3 getBall(int game) const { return Vec3(m_ballX[game], m_ballY, m_ballZ[game]); }
+		Vec3 getBallVelocity(int game) const { return Vec3(m_ballVX[game], 0.0f, m_ballVZ[game]); }
+		Vec3 getControl(int game) const { return Vec3(m_controlX[game], m_ballY, m_controlZ[game]); }
+		bool isStarted(int game) const { return m_started[game] != 0; }
+		int  getRestarts(int game) const { return m_restarts[game]; }
+		bool isBrickAlive(int game, int brick) const;
+		int  getLiveBricks(int game) const;
+		int  getBrickCount(void) const { return (int)m_brickX.size(); }
+
+		float       launchSpeed;         // as World::launchSpeed
+		WorkerPool* workers;             // not owned, NULL runs single threaded
+
+	private:
+		static void groupTask(void* context, int part, int begin, int end);
+		void stepGroup(int group, std::vector<int>& ids);    // ids: scratch of the wall tree
+
+		int m_count;
+		int m_padded;                    // m_count rounded up to LANES
+
+		// per game, m_padded long
+		std::vector<float> m_ballX, m_ballZ, m_ballVX, m_ballVZ;
+		std::vector<float> m_controlX, m_controlZ;
+		std::vector<unsigned char> m_started;
+		std::vector<int> m_restarts;
+		// alive bits, one row of m_padded words per 32 bricks: bit b of game g is
+		// bit (b % 32) of m_alive[(b / 32) * m_padded + g]
+		std::vector<unsigned int> m_alive;
+		std::vector<unsigned int> m_initialAlive;    // one row for a game after setup
+
+		// the level, shared by every game
+		std::vector<Wall>  m_walls;
+		WallTree           m_wallTree;
+		std::vector<float> m_brickX, m_brickZ;
+		float m_brickMinX, m_brickMinZ, m_brickMaxX, m_brickMaxZ;
+		float m_ballY;
+		float m_startX;                  // moveball x right after setup
+		float m_controlMinZ, m_controlMaxZ;
+		float m_outOfField;
+		float m_restSpeed;               // smallest float speed Sphere::isResting sees as moving
+
+		std::vector<std::vector<int> > m_wallIds;            // per worker scratch of the wall tree
+		const unsigned char* m_actions;  // of the running step
+		float m_timeDelta;
+	};
+}
+
+#endif // __simBatchH__
@@ -0,0 +1,2016 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simBench.cpp
+//
+// Desc: Micro-benchmarks of the simulation core. Runs headless.
+//
+//       Build (Linux):  g++ -std=c++14 -O2 -msse2 -pthread -o simBench simCore.cpp simKernel.cpp simGrid.cpp
+//                           simSweep.cpp simProfile.cpp simEvent.cpp simLevel.cpp simReplay.cpp
+//                           simThreads.cpp simJobs.cpp simBatch.cpp simSnapshot.cpp simMath.cpp
+//                           simWallTree.cpp simImpact.cpp simShapes.cpp simStream.cpp
+//                           simParticles.cpp simRender.cpp simRaster.cpp simBench.cpp
+//                       (add -mavx to benchmark the AVX kernel)
+//       Usage:          simBench [-bricks n,n,..] [-balls n,n,..] [-csv out.csv | -json out.json]
+//                                [benchmark ...]
+//                       no benchmark runs all of them. -bricks / -balls set the cases of the
+//                       physics benchmarks (sphere .. reset); their results also go to the CSV
+//                       or JSON file, one record per measurement, to track them over time.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simBatch.h"
+#include "simCore.h"
+#include "simEvent.h"
+#include "simKernel.h"
+#include "simGrid.h"
+#include "simImpact.h"
+#include "simJobs.h"
+#include "simParticles.h"
+#include "simRaster.h"
+#include "simRender.h"
+#include "simReplay.h"
+#include "simShapes.h"
+#include "simSnapshot.h"
+#include "simStream.h"
+#include "simThreads.h"
+#include "simWallTree.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <limits>
+#include <string>
+#include <vector>
+
+// total number of sphere tests per measurement, split over the repetitions
+#define TESTS_PER_RUN 20000000
+
+static volatile int g_sink = 0;
+
+static double now(void)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float randRange(float lo, float hi)
+{
+	return lo + (hi - lo) * ((float)rand() / (float)RAND_MAX);
+}
+
+// the default level, or bricks random bricks on the left half of the default field
+static void brickLevel(sim::Level& level, int bricks)
+{
+	level.makeDefault();
+	if (bricks == level.getBrickCount()) return;
+
+	std::vector<sim::LevelWall> walls(level.getWalls(), level.getWalls() + level.getWallCount());
+	std::vector<float> xs(bricks), zs(bricks);
+	for (int i = 0; i < bricks; i++) {
+		xs[i] = randRange(-4.2f, 0.0f);
+		zs[i] = randRange(-2.7f, 2.7f);
+	}
+	level.assign(level.getPlane(), walls, xs, zs, std::vector<unsigned int>(bricks, level.getBrickColor()[0]),
+		std::vector<sim::BrickAttr>(bricks, level.getBrickAttr()[0]));
+}
+
+// -----------------------------------------------------------------------------
+// collide: moving ball against all bricks
+// -----------------------------------------------------------------------------
+
+static bool checkKernel(const std::vector<float>& xs, const std::vector<float>& zs, int count)
+{
+	std::vector<unsigned int> simd(HIT_MASK_WORDS(count));
+	std::vector<unsigned int> scalar(HIT_MASK_WORDS(count));
+
+	for (int q = 0; q < 1000; q++) {
+		float bx = randRange(-4.5f, 0.0f);
+		float bz = randRange(-3.0f, 3.0f);
+		int a = sim::sphereHitMask(&xs[0], &zs[0], count, bx, bz, 2 * (float)M_RADIUS, &simd[0]);
+		int b = sim::sphereHitMaskScalar(&xs[0], &zs[0], count, bx, bz, 2 * (float)M_RADIUS, &scalar[0]);
+		if (a != b || simd != scalar) return false;
+	}
+	return true;
+}
+
+static void benchCollide(void)
+{
+	const int counts[] = { DEFAULT_LEVEL_BRICKS, 1000, 10000, 100000 };
+
+	printf("collide (kernel: %s)\n", sim::kernelName());
+	printf("%10s %16s %16s %16s\n", "bricks", "per-object ns", "scalar ns", "simd ns");
+
+	for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+		const int count = counts[c];
+		const int reps = TESTS_PER_RUN / count;
+
+		// bricks fill the left half of the field, the ball is tested on the right half so
+		// the per-object path never takes its hit branch.
+		std::vector<sim::Sphere> bricks(count);
+		std::vector<float> xs(count), zs(count);
+		for (int i = 0; i < count; i++) {
+			xs[i] = randRange(-4.5f, 0.0f);
+			zs[i] = randRange(-3.0f, 3.0f);
+			bricks[i].setCenter(xs[i], (float)M_RADIUS, zs[i]);
+		}
+		std::vector<sim::Sphere> balls(reps);
+		for (int r = 0; r < reps; r++) {
+			balls[r].setCenter(randRange(0.5f, 4.5f), (float)M_RADIUS, randRange(-3.0f, 3.0f));
+		}
+
+		if (!checkKernel(xs, zs, count)) {
+			printf("%10d  kernel mismatch against scalar reference\n", count);
+			continue;
+		}
+
+		std::vector<unsigned int> mask(HIT_MASK_WORDS(count));
+		int hits = 0;
+
+		double t0 = now();
+		for (int r = 0; r < reps; r++) {
+			for (int i = 0; i < count; i++) {
+				bricks[i].hitBy(balls[r]);
+			}
+		}
+		double t1 = now();
+		for (int r = 0; r < reps; r++) {
+			sim::Vec3 b = balls[r].getCenter();
+			hits += sim::sphereHitMaskScalar(&xs[0], &zs[0], count, b.x, b.z, 2 * (float)M_RADIUS, &mask[0]);
+		}
+		double t2 = now();
+		for (int r = 0; r < reps; r++) {
+			sim::Vec3 b = balls[r].getCenter();
+			hits += sim::sphereHitMask(&xs[0], &zs[0], count, b.x, b.z, 2 * (float)M_RADIUS, &mask[0]);
+		}
+		double t3 = now();
+		g_sink += hits;
+
+		double tests = (double)reps * count;
+		printf("%10d %16.3f %16.3f %16.3f\n", count,
+			(t1 - t0) * 1e9 / tests, (t2 - t1) * 1e9 / tests, (t3 - t2) * 1e9 / tests);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// boundary: ball positions right across the contact distance of every brick of the
+// default level. the float prefilters only pick candidates and Sphere::hasIntersected
+// decides, so every path has to hit the bricks the plain loop over all bricks hits.
+// -----------------------------------------------------------------------------
+
+#define BOUNDARY_ANGLES 64
+#define BOUNDARY_STEPS  64               // positions on each side of the contact distance
+#define BOUNDARY_STEP   4e-8f            // apart along the ray from the brick
+
+// the positions, leaving out the ones that touch a wall (those are pushed before the
+// bricks are tested)
+static void boundaryPositions(const sim::Level& level, std::vector<sim::Vec3>& positions)
+{
+	const float radiusSum = 2 * (float)M_RADIUS;
+	for (int i = 0; i < level.getBrickCount(); i++) {
+		for (int a = 0; a < BOUNDARY_ANGLES; a++) {
+			float angle = 6.2831853f * a / BOUNDARY_ANGLES;
+			for (int k = -BOUNDARY_STEPS; k <= BOUNDARY_STEPS; k++) {
+				float d = radiusSum + k * BOUNDARY_STEP;
+				sim::Vec3 p(level.getBrickX()[i] + d * cosf(angle), (float)M_RADIUS, level.getBrickZ()[i] + d * sinf(angle));
+				bool wall = false;
+				for (int j = 0; j < level.getWallCount() && !wall; j++) {
+					const sim::LevelWall& w = level.getWalls()[j];
+					wall = fabsf(p.x - w.x) < w.width / 2 + 2 * radiusSum && fabsf(p.z - w.z) < w.depth / 2 + 2 * radiusSum;
+				}
+				if (!wall) positions.push_back(p);
+			}
+		}
+	}
+}
+
+// the bricks the plain loop hits with the ball at p, in index order
+static void boundaryHits(std::vector<sim::Sphere>& bricks, const sim::Vec3& p, std::vector<int>& hits)
+{
+	sim::Sphere ball;
+	ball.setCenter(p.x, p.y, p.z);
+	hits.clear();
+	for (int i = 0; i < (int)bricks.size(); i++) {
+		if (bricks[i].hasIntersected(ball)) hits.push_back(i);
+	}
+}
+
+// the kernel as a prefilter of hasIntersected
+static void kernelHits(std::vector<sim::Sphere>& bricks, const sim::Level& level, const sim::Vec3& p, float radiusSum,
+	std::vector<unsigned int>& mask, std::vector<int>& hits)
+{
+	sim::Sphere ball;
+	ball.setCenter(p.x, p.y, p.z);
+	hits.clear();
+	if (sim::sphereHitMask(level.getBrickX(), level.getBrickZ(), level.getBrickCount(), p.x, p.z, radiusSum, &mask[0]) == 0) return;
+	for (int i = 0; i < (int)bricks.size(); i++) {
+		if ((mask[i >> 5] & (1u << (i & 31))) && bricks[i].hasIntersected(ball)) hits.push_back(i);
+	}
+}
+
+static void benchBoundary(void)
+{
+	sim::Level level;
+	level.makeDefault();
+	const int count = level.getBrickCount();
+	std::vector<sim::Sphere> bricks(count);
+	for (int i = 0; i < count; i++) bricks[i].setCenter(level.getBrickX()[i], (float)M_RADIUS, level.getBrickZ()[i]);
+
+	std::vector<sim::Vec3> positions;
+	boundaryPositions(level, positions);
+	std::vector<std::vector<int> > expected(positions.size());
+	int touching = 0;
+	for (size_t n = 0; n < positions.size(); n++) {
+		boundaryHits(bricks, positions[n], expected[n]);
+		if (!expected[n].empty()) touching++;
+	}
+
+	printf("boundary (%d bricks, %d positions, %d touching)\n", count, (int)positions.size(), touching);
+	printf("%-24s %10s %10s\n", "path", "differ", "result");
+
+	// the kernel without the margin is the reason for it, it is not expected to match
+	std::vector<unsigned int> mask(HIT_MASK_WORDS(count));
+	std::vector<int> hits;
+	const float radiusSum = 2 * (float)M_RADIUS;
+	const char* names[] = { "kernel without margin", "kernel prefilter" };
+	for (int m = 0; m < 2; m++) {
+		int differ = 0;
+		for (size_t n = 0; n < positions.size(); n++) {
+			kernelHits(bricks, level, positions[n], m == 0 ? radiusSum : radiusSum + HIT_MASK_MARGIN, mask, hits);
+			if (hits != expected[n]) differ++;
+		}
+		printf("%-24s %10d %10s\n", names[m], differ, m == 0 ? "-" : differ == 0 ? "same" : "DIFFERS");
+	}
+
+	// World::step, with the ball resting at the position: the grid and the shape buckets
+	sim::World world;
+	world.setup(level);
+	int differ = 0;
+	for (size_t n = 0; n < positions.size(); n++) {
+		world.game_start = true;
+		world.moveball.setCenter(positions[n].x, positions[n].y, positions[n].z);
+		world.moveball.setPower(0, 0);
+		world.step(0.0112f);
+		bool same = world.liveBricks.size() == count - (int)expected[n].size();
+		for (size_t h = 0; h < expected[n].size() && same; h++) same = !world.liveBricks.contains(expected[n][h]);
+		if (!same) differ++;
+		world.resetLevel();
+	}
+	printf("%-24s %10d %10s\n", "world", differ, differ == 0 ? "same" : "DIFFERS");
+
+	// BatchWorld, one game per position, against the plain loop and so against World
+	const int games = 4096;
+	const unsigned char none[games] = { 0 };
+	differ = 0;
+	for (size_t first = 0; first < positions.size(); first += games) {
+		int n = positions.size() - first < (size_t)games ? (int)(positions.size() - first) : games;
+		sim::BatchWorld batch;
+		batch.setup(level, n);
+		for (int g = 0; g < n; g++) batch.place(g, positions[first + g], sim::Vec3(0.0f, 0.0f, 0.0f));
+		batch.step(none, 0.0112f);
+		for (int g = 0; g < n; g++) {
+			const std::vector<int>& e = expected[first + g];
+			bool same = batch.getLiveBricks(g) == count - (int)e.size();
+			for (size_t h = 0; h < e.size() && same; h++) same = !batch.isBrickAlive(g, e[h]);
+			if (!same) differ++;
+		}
+	}
+	printf("%-24s %10d %10s\n", "batch", differ, differ == 0 ? "same" : "DIFFERS");
+}
+
+// -----------------------------------------------------------------------------
+// grid: broadphase query cost against brick count
+// -----------------------------------------------------------------------------
+
+static void benchGrid(void)
+{
+	const int counts[] = { DEFAULT_LEVEL_BRICKS, 1000, 10000, 100000 };
+	const int queries = 200000;
+
+	printf("grid\n");
+	printf("%10s %16s %16s %16s\n", "bricks", "full scan ns", "grid ns", "remove ns");
+
+	for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+		const int count = counts[c];
+
+		// keep the brick density of the default level (52 bricks on 4 x 5.6)
+		// and grow the field with the brick count
+		float side = sqrtf(count * (4.0f * 5.6f / DEFAULT_LEVEL_BRICKS));
+		std::vector<float> xs(count), zs(count);
+		for (int i = 0; i < count; i++) {
+			xs[i] = randRange(0.0f, side);
+			zs[i] = randRange(0.0f, side);
+		}
+		std::vector<float> bx(queries), bz(queries);
+		for (int q = 0; q < queries; q++) {
+			bx[q] = randRange(0.0f, side);
+			bz[q] = randRange(0.0f, side);
+		}
+
+		sim::BrickGrid grid;
+		grid.reset(0.0f, 0.0f, side, side, (float)(4 * M_RADIUS), count);
+		for (int i = 0; i < count; i++) grid.insert(i, xs[i], zs[i]);
+
+		// the full scan is slow at large counts, so it runs on fewer queries
+		const int scanQueries = queries / (count / DEFAULT_LEVEL_BRICKS + 1) + 1;
+		std::vector<unsigned int> mask(HIT_MASK_WORDS(count));
+		std::vector<int> hits;
+		int found = 0;
+
+		double t0 = now();
+		for (int q = 0; q < scanQueries; q++) {
+			found += sim::sphereHitMask(&xs[0], &zs[0], count, bx[q], bz[q], 2 * (float)M_RADIUS, &mask[0]);
+		}
+		double t1 = now();
+		for (int q = 0; q < queries; q++) {
+			hits.clear();
+			found += grid.query(bx[q], bz[q], 2 * (float)M_RADIUS, hits);
+		}
+		double t2 = now();
+		for (int i = 0; i < count; i++) grid.remove(i);
+		double t3 = now();
+		g_sink += found;
+
+		printf("%10d %16.1f %16.1f %16.1f\n", count,
+			(t1 - t0) * 1e9 / scanQueries, (t2 - t1) * 1e9 / queries, (t3 - t2) * 1e9 / count);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// sweep: continuous collision against substepping a fast ball
+// -----------------------------------------------------------------------------
+
+// runs frames steps of timeDelta split into substeps. returns the seconds spent and
+// counts the frames the ball ended up behind a wall.
+static double runFast(bool continuous, int substeps, int frames, float timeDelta, long& escapes)
+{
+	sim::World world;
+	world.setup();
+	world.continuous = continuous;
+	world.launchSpeed = 40.0f;
+	escapes = 0;
+
+	double t0 = now();
+	for (int f = 0; f < frames; f++) {
+		world.launch();
+		for (int s = 0; s < substeps; s++) world.step(timeDelta / substeps);
+
+		sim::Vec3 ball = world.moveball.getCenter();
+		if (ball.z > 3.0f || ball.z < -3.0f || ball.x < -4.5f) {
+			escapes++;
+			world.resetLevel();
+		}
+	}
+	return now() - t0;
+}
+
+static void benchSweep(void)
+{
+	const int frames = 100000;
+	const float timeDelta = 0.03f;
+	// substeps that keep the move of one substep under a ball radius
+	const int substeps = (int)ceilf(40.0f * TIME_SCALE * timeDelta / (float)M_RADIUS);
+	long escapes;
+
+	printf("sweep (speed 40, timeDelta %.3f)\n", timeDelta);
+	printf("%24s %16s %10s\n", "mode", "ns/frame", "escapes");
+
+	double t = runFast(false, 1, frames, timeDelta, escapes);
+	printf("%24s %16.1f %10ld\n", "discrete", t * 1e9 / frames, escapes);
+	t = runFast(false, substeps, frames, timeDelta, escapes);
+	char name[32];
+	sprintf(name, "discrete x%d substeps", substeps);
+	printf("%24s %16.1f %10ld\n", name, t * 1e9 / frames, escapes);
+	t = runFast(true, 1, frames, timeDelta, escapes);
+	printf("%24s %16.1f %10ld\n", "continuous", t * 1e9 / frames, escapes);
+}
+
+// -----------------------------------------------------------------------------
+// sleep: integration cost against the number of awake bodies
+// -----------------------------------------------------------------------------
+
+static void benchSleep(void)
+{
+	const int counts[] = { 1000, 10000, 100000 };
+	const int awakePercent[] = { 0, 1, 10, 100 };
+	const float timeDelta = 16.0f * 0.0007f;
+
+	printf("sleep\n");
+	printf("%10s %8s %16s %16s\n", "bodies", "awake %", "all ns/step", "awake ns/step");
+
+	for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+		const int count = counts[c];
+		const int steps = 20000000 / count;
+
+		for (int a = 0; a < (int)(sizeof(awakePercent) / sizeof(awakePercent[0])); a++) {
+			std::vector<sim::Sphere> bodies(count);
+			sim::LiveSet awake;
+			awake.clear(count);
+			for (int i = 0; i < count; i++) {
+				bodies[i].setCenter(randRange(-4.5f, 4.5f), (float)M_RADIUS, randRange(-3.0f, 3.0f));
+				if (i % 100 < awakePercent[a]) {
+					bodies[i].setPower(0.02, 0.0);   // just above the rest threshold
+					awake.insert(i);
+				}
+			}
+
+			double t0 = now();
+			for (int s = 0; s < steps; s++) {
+				for (int i = 0; i < count; i++) bodies[i].ballUpdate(timeDelta);
+			}
+			double t1 = now();
+			for (int s = 0; s < steps; s++) {
+				sim::integrate(&bodies[0], awake, timeDelta, NULL);
+			}
+			double t2 = now();
+			g_sink += awake.size();
+
+			printf("%10d %8d %16.1f %16.1f\n", count, awakePercent[a],
+				(t1 - t0) * 1e9 / steps, (t2 - t1) * 1e9 / steps);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// events: cost of posting an event against writing a line straight to a file
+// -----------------------------------------------------------------------------
+
+static void benchEvents(void)
+{
+	const char* path = "simBench_events.tmp";
+	const int posts = 10000000;
+	const int lines = 200000;
+
+	printf("events (ring of %d)\n", 1 << 16);
+	printf("%24s %16s %16s\n", "mode", "ns/event", "lost %");
+
+	double t0 = now();
+	for (int i = 0; i < posts; i++) sim::eventPost(sim::EVENT_COLLISION, i, i & 63, 0.0f, 0.0f);
+	double t1 = now();
+	printf("%24s %16.2f %16s\n", "stopped", (t1 - t0) * 1e9 / posts, "-");
+
+	// one event per 1000 ns or so, far more than a game posts, and a flood
+	const int paces[] = { 1000, 0 };
+	for (int p = 0; p < 2; p++) {
+		if (!sim::eventStart(path, sim::EVENT_BINARY)) {
+			printf("%24s  can not write %s\n", "ring", path);
+			return;
+		}
+		int count = paces[p] ? posts / 100 : posts;
+		t0 = now();
+		for (int i = 0; i < count; i++) {
+			sim::eventPost(sim::EVENT_COLLISION, i, i & 63, 0.0f, 0.0f);
+			if (paces[p]) {
+				double until = now() + paces[p] * 1e-9;
+				while (now() < until) {}
+			}
+		}
+		t1 = now();
+		sim::eventStop();
+		if (paces[p]) printf("%24s %16s %16.2f\n", "ring, paced", "-", 100.0 * sim::eventDropped() / count);
+		else printf("%24s %16.2f %16.2f\n", "ring, flood", (t1 - t0) * 1e9 / count, 100.0 * sim::eventDropped() / count);
+	}
+
+	// what the collision code used to do: a line and a flush per hit
+	FILE* fp = fopen(path, "w");
+	if (fp != NULL) {
+		t0 = now();
+		for (int i = 0; i < lines; i++) {
+			fprintf(fp, "hasInters\n");
+			fflush(fp);
+		}
+		t1 = now();
+		fclose(fp);
+		printf("%24s %16.2f %16s\n", "fprintf + fflush", (t1 - t0) * 1e9 / lines, "-");
+	}
+	remove(path);
+}
+
+// -----------------------------------------------------------------------------
+// level: loading a level file against its brick count
+// -----------------------------------------------------------------------------
+
+static void benchLevel(void)
+{
+	const int counts[] = { 1000, 100000, 1000000 };
+	const char* binPath = "simBench_level.tmp";
+	const char* textPath = "simBench_level.tmp.txt";
+
+	printf("level\n");
+	printf("%10s %14s %14s %14s %14s\n", "bricks", "map ms", "read pos ms", "text ms", "setup ms");
+
+	for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+		const int count = counts[c];
+
+		sim::Level source;
+		source.makeDefault();
+		std::vector<sim::LevelWall> walls(source.getWalls(), source.getWalls() + source.getWallCount());
+		std::vector<float> xs(count), zs(count);
+		for (int i = 0; i < count; i++) {
+			xs[i] = randRange(-4.5f, 0.0f);
+			zs[i] = randRange(-3.0f, 3.0f);
+		}
+		source.assign(source.getPlane(), walls, xs, zs, std::vector<unsigned int>(count, source.getBrickColor()[0]),
+			std::vector<sim::BrickAttr>(count, source.getBrickAttr()[0]));
+		if (!source.saveBinary(binPath) || !source.saveText(textPath)) {
+			printf("%10d  can not write the level\n", count);
+			continue;
+		}
+
+		sim::Level level;
+		double t0 = now();
+		bool loaded = level.loadBinary(binPath);
+		double t1 = now();
+		// first touch of the positions pages the mapping in
+		float sum = 0.0f;
+		const float* bx = level.getBrickX();
+		const float* bz = level.getBrickZ();
+		for (int i = 0; loaded && i < count; i++) sum += bx[i] + bz[i];
+		double t2 = now();
+		sim::Level text;
+		loaded = text.loadText(textPath) && loaded;
+		double t3 = now();
+		sim::World world;
+		if (loaded) world.setup(level);
+		double t4 = now();
+		g_sink += (int)sum + world.brickCount;
+
+		if (!loaded) {
+			printf("%10d  can not load the level\n", count);
+			continue;
+		}
+		printf("%10d %14.3f %14.3f %14.3f %14.3f\n", count,
+			(t1 - t0) * 1e3, (t2 - t1) * 1e3, (t3 - t2) * 1e3, (t4 - t3) * 1e3);
+	}
+	remove(binPath);
+	remove(textPath);
+}
+
+// -----------------------------------------------------------------------------
+// multiball: step time of many balls against the number of threads
+// -----------------------------------------------------------------------------
+
+static void benchMultiball(void)
+{
+	const int ballCounts[] = { 64, 256, 1024 };
+	const int bricks = 1024;
+	const int steps = 2000;
+	const float timeDelta = 16.0f * 0.0007f;
+
+	sim::Level level;
+	brickLevel(level, bricks);
+
+	// at least up to 4 threads, so the determinism check also runs on small machines
+	std::vector<int> threadCounts;
+	int hardware = sim::WorkerPool::hardwareThreads();
+	int most = hardware > 4 ? hardware : 4;
+	for (int t = 1; t < most; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(most);
+
+	printf("multiball (%d bricks, %d hardware threads)\n", bricks, hardware);
+	printf("%10s %8s %16s %10s %14s\n", "balls", "threads", "ns/step", "speedup", "deterministic");
+
+	for (int b = 0; b < (int)(sizeof(ballCounts) / sizeof(ballCounts[0])); b++) {
+		double single = 0.0;
+		unsigned long long reference = 0;
+
+		for (size_t t = 0; t < threadCounts.size(); t++) {
+			sim::WorkerPool pool(threadCounts[t]);
+			sim::World world;
+			world.setup(level);
+			world.workers = &pool;
+			world.launch();
+			world.spawnBalls(ballCounts[b]);
+
+			double t0 = now();
+			for (int s = 0; s < steps; s++) world.step(timeDelta);
+			double t1 = now();
+
+			unsigned long long hash = sim::worldHash(world);
+			if (t == 0) {
+				single = t1 - t0;
+				reference = hash;
+			}
+			printf("%10d %8d %16.1f %10.2f %14s\n", ballCounts[b], threadCounts[t],
+				(t1 - t0) * 1e9 / steps, single / (t1 - t0), hash == reference ? "yes" : "NO");
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// batch: game steps per second of the batch engine, checked against World
+// -----------------------------------------------------------------------------
+
+// ACTION_STEPS steps of random actions per game, repeated
+#define ACTION_STEPS 256
+
+static void randomActions(std::vector<unsigned char>& actions, int games)
+{
+	actions.resize((size_t)ACTION_STEPS * games);
+	for (size_t i = 0; i < actions.size(); i++) {
+		int r = rand() % 16;
+		actions[i] = (unsigned char)(r < 4 ? BATCH_LEFT : r < 8 ? BATCH_RIGHT : r == 8 ? BATCH_LAUNCH : 0);
+	}
+}
+
+// number of games of batch that differ from a World fed the same actions
+static int batchMismatches(const sim::Level& level, int games, int steps, float timeDelta)
+{
+	std::vector<unsigned char> actions;
+	randomActions(actions, games);
+
+	sim::BatchWorld batch;
+	batch.setup(level, games);
+	std::vector<sim::World> worlds(games);
+	for (int g = 0; g < games; g++) worlds[g].setup(level);
+
+	for (int s = 0; s < steps; s++) {
+		const unsigned char* a = &actions[(size_t)(s % ACTION_STEPS) * games];
+		batch.step(a, timeDelta);
+		for (int g = 0; g < games; g++) {
+			if (a[g] & BATCH_LEFT) worlds[g].moveControl(-BATCH_CONTROL_STEP);
+			if (a[g] & BATCH_RIGHT) worlds[g].moveControl(BATCH_CONTROL_STEP);
+			if (a[g] & BATCH_LAUNCH) worlds[g].launch();
+			worlds[g].step(timeDelta);
+		}
+	}
+
+	int mismatches = 0;
+	for (int g = 0; g < games; g++) {
+		const sim::World& w = worlds[g];
+		sim::Vec3 ball = batch.getBall(g), control = batch.getControl(g);
+		bool same = ball.x == w.moveball.getCenter().x && ball.z == w.moveball.getCenter().z &&
+			batch.getBallVelocity(g).x == (float)w.moveball.getVelocity_X() &&
+			batch.getBallVelocity(g).z == (float)w.moveball.getVelocity_Z() &&
+			control.x == w.controlball.getCenter().x && control.z == w.controlball.getCenter().z &&
+			batch.isStarted(g) == w.game_start && batch.getRestarts(g) == w.restarts;
+		for (int i = 0; i < w.brickCount && same; i++) same = batch.isBrickAlive(g, i) == w.liveBricks.contains(i);
+		if (!same) mismatches++;
+	}
+	return mismatches;
+}
+
+static void benchBatch(void)
+{
+	const int gameCounts[] = { 1024, 4096, 16384 };
+	const int steps = 2000;
+	const int checkGames = 256;
+	const int checkSteps = 4000;
+	const float timeDelta = 16.0f * 0.0007f;
+
+	sim::Level level;
+	level.makeDefault();
+
+	// the walls alone must hold the balls too
+	sim::Level walled;
+	walled.assign(level.getPlane(), std::vector<sim::LevelWall>(level.getWalls(), level.getWalls() + level.getWallCount()),
+		std::vector<float>(), std::vector<float>(), std::vector<unsigned int>(), std::vector<sim::BrickAttr>());
+
+	int mismatches = batchMismatches(level, checkGames, checkSteps, timeDelta);
+	int walledMismatches = batchMismatches(walled, checkGames, checkSteps, timeDelta);
+	printf("batch (%d bricks, %d games x %d steps match World: %s, without bricks: %s)\n", level.getBrickCount(),
+		checkGames, checkSteps, mismatches == 0 ? "yes" : "NO", walledMismatches == 0 ? "yes" : "NO");
+	if (mismatches) printf("  %d games differ\n", mismatches);
+	if (walledMismatches) printf("  %d games without bricks differ\n", walledMismatches);
+
+	std::vector<int> threadCounts(1, 1);
+	int hardware = sim::WorkerPool::hardwareThreads();
+	if (hardware > 1) threadCounts.push_back(hardware);
+
+	printf("%10s %8s %16s %16s %10s\n", "games", "threads", "ns/game-step", "M game-steps/s", "restarts");
+	for (int c = 0; c < (int)(sizeof(gameCounts) / sizeof(gameCounts[0])); c++) {
+		int games = gameCounts[c];
+		std::vector<unsigned char> actions;
+		randomActions(actions, games);
+
+		for (size_t t = 0; t < threadCounts.size(); t++) {
+			sim::WorkerPool pool(threadCounts[t]);
+			sim::BatchWorld batch;
+			batch.setup(level, games);
+			batch.workers = &pool;
+
+			double t0 = now();
+			for (int s = 0; s < steps; s++) batch.step(&actions[(size_t)(s % ACTION_STEPS) * games], timeDelta);
+			double t1 = now();
+
+			long long restarts = 0;
+			for (int g = 0; g < games; g++) restarts += batch.getRestarts(g);
+			double gameSteps = (double)games * steps;
+			printf("%10d %8d %16.2f %16.2f %10lld\n", games, threadCounts[t],
+				(t1 - t0) * 1e9 / gameSteps, gameSteps / (t1 - t0) * 1e-6, restarts);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// jobs: cost per job, parallel-for scaling, and a stress test of dependencies
+// -----------------------------------------------------------------------------
+
+#define STRESS_JOBS   1000
+#define STRESS_ROUNDS 50
+
+static void emptyJob(void*) {}
+
+static void spinRange(void* context, int part, int begin, int end)
+{
+	float* out = (float*)context;
+	for (int i = begin; i < end; i++) {
+		float x = (float)i;
+		for (int k = 0; k < 256; k++) x = x * 0.999f + 0.5f;
+		out[i] = x;
+	}
+}
+
+struct StressJob
+{
+	std::atomic<int>* done;              // of all jobs of the round
+	std::atomic<int>* errors;
+	std::atomic<int>  childSum;
+	int before[3];                       // jobs that must have finished, -1 for none
+	int self;
+	sim::JobSystem* jobs;
+};
+
+static void stressChild(void* context, int part, int begin, int end)
+{
+	StressJob* job = (StressJob*)context;
+	job->childSum.fetch_add(end - begin);
+}
+
+static void stressJob(void* context)
+{
+	StressJob* job = (StressJob*)context;
+	for (int d = 0; d < 3; d++) {
+		if (job->before[d] >= 0 && job->done[job->before[d]].load() == 0) job->errors->fetch_add(1);
+	}
+	// nested parallel-for from inside a job
+	job->childSum = 0;
+	job->jobs->parallelFor(64, 4, stressChild, job);
+	if (job->childSum.load() != 64) job->errors->fetch_add(1);
+	job->done[job->self].store(1);
+}
+
+// number of dependency or nesting errors over STRESS_ROUNDS random job graphs
+static int stressJobs(sim::JobSystem& jobs)
+{
+	std::vector<StressJob> stress(STRESS_JOBS);
+	std::unique_ptr<std::atomic<int>[]> done(new std::atomic<int>[STRESS_JOBS]);
+	std::atomic<int> errors(0);
+	std::vector<sim::Job*> handles(STRESS_JOBS);
+
+	for (int round = 0; round < STRESS_ROUNDS; round++) {
+		sim::Job* root = jobs.create(NULL, NULL);
+		for (int i = 0; i < STRESS_JOBS; i++) {
+			done[i] = 0;
+			stress[i].done = done.get();
+			stress[i].errors = &errors;
+			stress[i].self = i;
+			stress[i].jobs = &jobs;
+			handles[i] = jobs.create(stressJob, &stress[i], root);
+			for (int d = 0; d < 3; d++) {
+				int before = (i > 0 && rand() % 2) ? rand() % i : -1;
+				if (before >= 0 && !jobs.depend(handles[i], handles[before])) before = -1;
+				stress[i].before[d] = before;
+			}
+		}
+		// submitted backwards, so most jobs are queued before their dependencies ran
+		for (int i = STRESS_JOBS - 1; i >= 0; i--) jobs.submit(handles[i]);
+		jobs.submit(root);
+		jobs.wait(root);
+
+		for (int i = 0; i < STRESS_JOBS; i++) {
+			if (done[i].load() == 0) errors.fetch_add(1);
+		}
+	}
+	return errors.load();
+}
+
+static void benchJobs(void)
+{
+	const int emptyJobs = 2000;
+	const int emptyRounds = 200;
+	const int items = 1 << 18;
+	const int grain = 1024;
+
+	std::vector<int> threadCounts;
+	int hardware = sim::WorkerPool::hardwareThreads();
+	int most = hardware > 4 ? hardware : 4;
+	for (int t = 1; t < most; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(most);
+
+	// multi-ball on the jobs must give the hash of the plain pool
+	sim::World reference;
+	reference.setup();
+	reference.launch();
+	reference.spawnBalls(64);
+	sim::World onJobs = reference;
+	for (int s = 0; s < 500; s++) reference.step(0.0112f);
+
+	std::vector<float> out(items);
+	printf("jobs (%d hardware threads)\n", hardware);
+	printf("%8s %12s %14s %10s %8s %10s\n", "threads", "ns/job", "parallel-for ms", "speedup", "stress", "multiball");
+
+	double single = 0.0;
+	for (size_t t = 0; t < threadCounts.size(); t++) {
+		sim::JobSystem jobs(threadCounts[t]);
+
+		double t0 = now();
+		for (int r = 0; r < emptyRounds; r++) {
+			sim::Job* root = jobs.create(NULL, NULL);
+			for (int j = 0; j < emptyJobs; j++) jobs.submit(jobs.create(emptyJob, NULL, root));
+			jobs.submit(root);
+			jobs.wait(root);
+		}
+		double t1 = now();
+		jobs.parallelFor(items, grain, spinRange, &out[0]);
+		double t2 = now();
+		if (t == 0) single = t2 - t1;
+
+		int errors = stressJobs(jobs);
+
+		sim::WorkerPool pool(jobs);
+		sim::World world = onJobs;
+		world.workers = &pool;
+		for (int s = 0; s < 500; s++) world.step(0.0112f);
+		bool same = sim::worldHash(world) == sim::worldHash(reference);
+
+		printf("%8d %12.1f %14.3f %10.2f %8s %10s\n", threadCounts[t],
+			(t1 - t0) * 1e9 / ((double)emptyJobs * emptyRounds), (t2 - t1) * 1e3, single / (t2 - t1),
+			errors == 0 ? "ok" : "FAILED", same ? "same" : "DIFFERS");
+	}
+	g_sink += (int)out[items / 2];
+}
+
+// -----------------------------------------------------------------------------
+// snapshot: save and restore time of the full world state against the brick count
+// -----------------------------------------------------------------------------
+
+static void benchSnapshot(void)
+{
+	const int brickCounts[] = { DEFAULT_LEVEL_BRICKS, 1024, 16384, 131072 };
+	const int replaySteps = 300;
+	const float timeDelta = 16.0f * 0.0007f;
+
+	printf("snapshot\n");
+	printf("%10s %12s %12s %14s %10s %14s\n", "bricks", "bytes", "save ns", "restore ns", "changed", "deterministic");
+
+	for (int b = 0; b < (int)(sizeof(brickCounts) / sizeof(brickCounts[0])); b++) {
+		int bricks = brickCounts[b];
+		sim::Level level;
+		brickLevel(level, bricks);
+
+		sim::World world;
+		world.setup(level);
+		world.moveControl(1.0f);
+		world.launch();
+
+		sim::SnapshotArena arena;
+		arena.reset(world, 4, 0);
+		int a = arena.save(world);
+		unsigned long long hashA = sim::worldHash(world);
+		// run into the bricks, but not out of the field
+		for (int s = 0; s < 400 && world.restarts == 0; s++) {
+			sim::World next = world;
+			next.step(timeDelta);
+			if (next.restarts != 0) break;
+			world = next;
+		}
+		int changed = bricks - world.liveBricks.size();
+		int c = arena.save(world);
+		unsigned long long hashC = sim::worldHash(world);
+
+		int iterations = 4000000 / bricks;
+		if (iterations < 20) iterations = 20;
+
+		sim::SnapshotArena scratch;
+		scratch.reset(world, 2, 0);
+		double t0 = now();
+		for (int n = 0; n < iterations; n++) scratch.save(world);
+		double t1 = now();
+		for (int n = 0; n < iterations; n++) arena.restore(world, (n & 1) ? c : a);
+		double t2 = now();
+
+		// restored states hash like the saved ones and step the same way again
+		arena.restore(world, a);
+		bool same = sim::worldHash(world) == hashA;
+		arena.restore(world, c);
+		same = same && sim::worldHash(world) == hashC;
+		for (int s = 0; s < replaySteps; s++) world.step(timeDelta);
+		unsigned long long first = sim::worldHash(world);
+		arena.restore(world, a);
+		arena.restore(world, c);
+		for (int s = 0; s < replaySteps; s++) world.step(timeDelta);
+		same = same && sim::worldHash(world) == first;
+
+		printf("%10d %12d %12.1f %14.1f %10d %14s\n", bricks, (int)arena.getSnapshotBytes(),
+			(t1 - t0) * 1e9 / iterations, (t2 - t1) * 1e9 / iterations, changed, same ? "yes" : "NO");
+	}
+}
+
+// -----------------------------------------------------------------------------
+// replay: a recorded game played back at full speed, and the recording corrupted in ways
+// Replay::load or Replay::run have to refuse without crashing
+// -----------------------------------------------------------------------------
+
+#define REPLAY_BENCH_PATH "simBench.rec"
+
+static bool writeBytes(const char* path, const std::vector<unsigned char>& bytes)
+{
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+	bool ok = bytes.empty() || fwrite(&bytes[0], 1, bytes.size(), fp) == bytes.size();
+	return fclose(fp) == 0 && ok;
+}
+
+static bool readBytes(const char* path, std::vector<unsigned char>& bytes)
+{
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL) return false;
+	bytes.clear();
+	unsigned char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) bytes.insert(bytes.end(), buffer, buffer + n);
+	fclose(fp);
+	return true;
+}
+
+// loads and plays the recording at path. true when it ran and matched its hash, otherwise
+// error says why.
+static bool playRecording(const char* path, const sim::Level& level, const char*& error)
+{
+	sim::Replay replay;
+	error = NULL;
+	if (!replay.load(path)) {
+		error = replay.getError();
+		return false;
+	}
+	sim::World world;
+	world.setup(level);
+	if (!replay.run(world)) error = "corrupt input stream";
+	else if (sim::worldHash(world) != replay.getHeader().finalHash) error = "final hash differs";
+	return error == NULL;
+}
+
+static void recordInput(sim::World& world, sim::InputRecorder& recorder, int type, float value)
+{
+	sim::Input input;
+	input.tick = world.ticks;
+	input.type = type;
+	input.value = value;
+	sim::applyInput(world, input);
+	recorder.record(input);
+}
+
+static void benchReplay(void)
+{
+	const int steps = 20000;
+	const float timeDelta = 16.0f * 0.0007f;
+
+	sim::Level level;
+	level.makeDefault();
+	sim::World world;
+	world.setup(level);
+	sim::InputRecorder recorder;
+	recorder.start(world, level.getHash(), timeDelta);
+	// the spawn goes first: its count is the float after the first tick delta and type
+	recordInput(world, recorder, sim::INPUT_SPAWN, 4.0f);
+	recordInput(world, recorder, sim::INPUT_LAUNCH, 0.0f);
+	for (int s = 0; s < steps; s++) {
+		if (s % 100 == 50) recordInput(world, recorder, sim::INPUT_MOVE, (s / 100) % 2 ? 0.3f : -0.3f);
+		if (s % 1000 == 999) recordInput(world, recorder, sim::INPUT_LAUNCH, 0.0f);
+		world.step(timeDelta);
+	}
+	std::vector<unsigned char> recorded;
+	if (!recorder.stop(world, REPLAY_BENCH_PATH) || !readBytes(REPLAY_BENCH_PATH, recorded)) {
+		printf("replay: can not write %s\n", REPLAY_BENCH_PATH);
+		return;
+	}
+
+	const char* error;
+	double t0 = now();
+	bool match = playRecording(REPLAY_BENCH_PATH, level, error);
+	double t1 = now();
+	printf("replay (%d steps, %d inputs, %d bytes: %.0f steps/s)\n", steps, recorder.getInputCount(), (int)recorded.size(),
+		steps / (t1 - t0));
+	printf("%-22s %10s  %s\n", "recording", "result", "error");
+	printf("%-22s %10s  %s\n", "as recorded", match ? "match" : "DIFFERS", error != NULL ? error : "");
+
+	const size_t spawnValue = sizeof(sim::ReplayHeader) + 2;
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	const float huge = 1e9f;
+	for (int c = 0; c < 4; c++) {
+		std::vector<unsigned char> bytes = recorded;
+		const char* name = "";
+		if (c == 0) {
+			name = "stream size 2^62";
+			sim::ReplayHeader header;
+			memcpy(&header, &bytes[0], sizeof(header));
+			header.streamBytes = 1ull << 62;
+			memcpy(&bytes[0], &header, sizeof(header));
+		}
+		else if (c == 1) {
+			name = "truncated stream";
+			bytes.resize(bytes.size() - 3);
+		}
+		else if (c == 2) {
+			name = "spawn count NaN";
+			memcpy(&bytes[spawnValue], &nan, sizeof(float));
+		}
+		else {
+			name = "spawn count 1e9";
+			memcpy(&bytes[spawnValue], &huge, sizeof(float));
+		}
+		if (!writeBytes(REPLAY_BENCH_PATH, bytes)) {
+			printf("%-22s %10s  can not write %s\n", name, "-", REPLAY_BENCH_PATH);
+			continue;
+		}
+		bool played = playRecording(REPLAY_BENCH_PATH, level, error);
+		printf("%-22s %10s  %s\n", name, played ? "ACCEPTED" : "refused", error != NULL ? error : "");
+	}
+	remove(REPLAY_BENCH_PATH);
+}
+
+// -----------------------------------------------------------------------------
+// impact: whole games frame stepped in continuous mode against the event driven mode
+// -----------------------------------------------------------------------------
+
+// plays frames frames of timeDelta, relaunching whenever the ball is back on the control
+// ball. chunk > 1 advances the event driven mode chunk frames at a time (a server catching
+// up, or a headless run); it only relaunches between chunks, so it plays fewer games.
+// returns the seconds spent.
+static double runImpact(const sim::Level& level, bool impacts, int chunk, int frames, float timeDelta,
+	float speed, long long& count, int& live)
+{
+	sim::World world;
+	world.setup(level);
+	world.continuous = true;
+	world.launchSpeed = speed;
+	sim::ImpactSim impactSim;
+	impactSim.attach(world);
+
+	double t0 = now();
+	for (int f = 0; f < frames; f += chunk) {
+		if (!world.game_start) {
+			world.launch();
+			if (impacts) impactSim.sync();
+		}
+		if (impacts) impactSim.advance(chunk * timeDelta);
+		else world.step(timeDelta);
+	}
+	double t1 = now();
+
+	count = impactSim.getImpacts();
+	live = world.liveBricks.size();
+	return t1 - t0;
+}
+
+static void benchImpact(void)
+{
+	const int frames = 200000;
+	const float timeDelta = 16.0f * 0.0007f;
+	const int brickCounts[] = { DEFAULT_LEVEL_BRICKS, 1024 };
+	const float speeds[] = { 1.0f, 40.0f };
+
+	printf("impact (%d frames of %.4f)\n", frames, timeDelta);
+	printf("%10s %8s %22s %14s %12s %12s\n", "bricks", "speed", "mode", "ns/frame", "impacts", "live bricks");
+
+	for (int b = 0; b < (int)(sizeof(brickCounts) / sizeof(brickCounts[0])); b++) {
+		sim::Level level;
+		brickLevel(level, brickCounts[b]);
+		for (int v = 0; v < (int)(sizeof(speeds) / sizeof(speeds[0])); v++) {
+			long long count;
+			int live;
+			double t = runImpact(level, false, 1, frames, timeDelta, speeds[v], count, live);
+			printf("%10d %8.0f %22s %14.1f %12s %12d\n", brickCounts[b], speeds[v], "continuous", t * 1e9 / frames, "-", live);
+			t = runImpact(level, true, 1, frames, timeDelta, speeds[v], count, live);
+			printf("%10d %8.0f %22s %14.1f %12lld %12d\n", brickCounts[b], speeds[v], "event driven", t * 1e9 / frames, count, live);
+			t = runImpact(level, true, 100, frames, timeDelta, speeds[v], count, live);
+			printf("%10d %8.0f %22s %14.1f %12lld %12d\n", brickCounts[b], speeds[v], "event driven x100", t * 1e9 / frames, count, live);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// layout: the same brick passes on the game's old brick objects, on Sphere objects, and
+// on the BrickStore arrays
+// -----------------------------------------------------------------------------
+
+// a brick as CSphere held it before the simulation core: the physics next to the
+// transform, the material and the mesh of the renderer
+struct FatBrick
+{
+	FatBrick(void) : mesh(NULL), dirty(false)
+	{
+		memset(local, 0, sizeof(local));
+		memset(material, 0, sizeof(material));
+	}
+
+	sim::Sphere body;
+	float  local[16];                    // D3DXMATRIX
+	float  material[17];                 // D3DMATERIAL9
+	void*  mesh;                         // ID3DXMesh*
+	bool   dirty;
+};
+
+static void benchLayout(void)
+{
+	const int counts[] = { 1024, 100000 };
+	const float timeDelta = 16.0f * 0.0007f;
+	const float radiusSum = 2 * (float)M_RADIUS;
+
+	printf("layout\n");
+	printf("%10s %10s %12s %14s %14s %14s %10s\n", "bricks", "layout", "bytes/brick", "scan ns/brick",
+		"random ns/brick", "update ns/brick", "same");
+
+	for (int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+		const int count = counts[c];
+		const int reps = 50000000 / count;
+
+		std::vector<FatBrick> fat(count);
+		std::vector<sim::Sphere> objects(count);
+		sim::BrickStore store;
+		store.assign(count);
+		sim::LiveSet awakeObjects, awakeStore;
+		awakeObjects.fill(count);
+		awakeStore.fill(count);
+		for (int i = 0; i < count; i++) {
+			objects[i].setCenter(randRange(-4.5f, 4.5f), (float)M_RADIUS, randRange(-3.0f, 3.0f));
+			objects[i].setPower(randRange(-0.1f, 0.1f), randRange(-0.1f, 0.1f));
+			fat[i].body = objects[i];
+			store.set(i, objects[i]);
+		}
+		// the visiting order of a broadphase: every brick once, scattered over memory
+		std::vector<int> order(count);
+		for (int i = 0; i < count; i++) order[i] = i;
+		for (int i = count - 1; i > 0; i--) std::swap(order[i], order[rand() % (i + 1)]);
+
+		// scan: the distance test of every brick against a ball, in index order
+		int hits[3] = { 0, 0, 0 };
+		double scan[3], random[3], update[3];
+		double t0 = now();
+		for (int r = 0; r < reps; r++) {
+			float bx = -4.5f + 9.0f * r / reps;
+			for (int i = 0; i < count; i++) {
+				sim::Vec3 p = fat[i].body.getCenter();
+				hits[0] += (p.x - bx) * (p.x - bx) + p.z * p.z < radiusSum * radiusSum;
+			}
+		}
+		double t1 = now();
+		for (int r = 0; r < reps; r++) {
+			float bx = -4.5f + 9.0f * r / reps;
+			for (int i = 0; i < count; i++) {
+				sim::Vec3 p = objects[i].getCenter();
+				hits[1] += (p.x - bx) * (p.x - bx) + p.z * p.z < radiusSum * radiusSum;
+			}
+		}
+		double t2 = now();
+		for (int r = 0; r < reps; r++) {
+			float bx = -4.5f + 9.0f * r / reps;
+			const float* xs = store.x.data();
+			const float* zs = store.z.data();
+			for (int i = 0; i < count; i++) hits[2] += (xs[i] - bx) * (xs[i] - bx) + zs[i] * zs[i] < radiusSum * radiusSum;
+		}
+		double t3 = now();
+		scan[0] = t1 - t0; scan[1] = t2 - t1; scan[2] = t3 - t2;
+
+		// random: the same test in broadphase order, where every brick can be a cache miss
+		int randomHits[3] = { 0, 0, 0 };
+		const int randomReps = reps / 4 > 0 ? reps / 4 : 1;
+		t0 = now();
+		for (int r = 0; r < randomReps; r++) {
+			for (int n = 0; n < count; n++) {
+				sim::Vec3 p = fat[order[n]].body.getCenter();
+				randomHits[0] += p.x * p.x + p.z * p.z < radiusSum * radiusSum;
+			}
+		}
+		t1 = now();
+		for (int r = 0; r < randomReps; r++) {
+			for (int n = 0; n < count; n++) {
+				sim::Vec3 p = objects[order[n]].getCenter();
+				randomHits[1] += p.x * p.x + p.z * p.z < radiusSum * radiusSum;
+			}
+		}
+		t2 = now();
+		for (int r = 0; r < randomReps; r++) {
+			const float* xs = store.x.data();
+			const float* zs = store.z.data();
+			for (int n = 0; n < count; n++) {
+				int i = order[n];
+				randomHits[2] += xs[i] * xs[i] + zs[i] * zs[i] < radiusSum * radiusSum;
+			}
+		}
+		t3 = now();
+		random[0] = t1 - t0; random[1] = t2 - t1; random[2] = t3 - t2;
+
+		// update: integrate of every brick, all of them moving
+		const int updateReps = reps / 4 > 0 ? reps / 4 : 1;
+		t0 = now();
+		for (int r = 0; r < updateReps; r++) {
+			for (int i = 0; i < count; i++) {
+				fat[i].body.ballUpdate(timeDelta);
+				fat[i].dirty = true;
+			}
+		}
+		t1 = now();
+		for (int r = 0; r < updateReps; r++) sim::integrate(&objects[0], awakeObjects, timeDelta, NULL);
+		t2 = now();
+		for (int r = 0; r < updateReps; r++) sim::integrate(store, awakeStore, timeDelta, NULL);
+		t3 = now();
+		update[0] = t1 - t0; update[1] = t2 - t1; update[2] = t3 - t2;
+
+		// the three layouts computed the same thing
+		bool same = hits[0] == hits[1] && hits[1] == hits[2] && randomHits[0] == randomHits[1] && randomHits[1] == randomHits[2];
+		for (int i = 0; i < count && same; i++) {
+			sim::Vec3 a = fat[i].body.getCenter(), b = objects[i].getCenter(), d = store[i].getCenter();
+			same = a.x == b.x && a.z == b.z && b.x == d.x && b.z == d.z;
+		}
+
+		const char* names[3] = { "object", "Sphere", "BrickStore" };
+		const int bytes[3] = { (int)sizeof(FatBrick), (int)sizeof(sim::Sphere), 5 * (int)sizeof(float) };
+		for (int l = 0; l < 3; l++) {
+			printf("%10d %10s %12d %14.2f %14.2f %14.2f %10s\n", count, names[l], bytes[l],
+				scan[l] * 1e9 / ((double)reps * count), random[l] * 1e9 / ((double)randomReps * count),
+				update[l] * 1e9 / ((double)updateReps * count), same ? "yes" : "NO");
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// shapes: the narrowphase of a mixed level three ways: a brick object per shape behind a
+// virtual call, a switch on the shape of every brick, and the shape buckets of the World
+// -----------------------------------------------------------------------------
+
+struct ShapeBrick
+{
+	ShapeBrick(float cx, float cz) : x(cx), z(cz) {}
+	virtual ~ShapeBrick(void) {}
+	virtual bool overlaps(float bx, float bz, float radius) const = 0;
+
+	float x, z;
+};
+
+template <int SHAPE>
+struct ShapeBrickOf : public ShapeBrick
+{
+	ShapeBrickOf(float cx, float cz) : ShapeBrick(cx, cz) {}
+	virtual bool overlaps(float bx, float bz, float radius) const
+	{
+		return sim::ShapeKernel<SHAPE>::overlaps(x, z, bx, bz, radius);
+	}
+};
+
+static bool switchOverlaps(int shape, float cx, float cz, float bx, float bz, float radius)
+{
+	switch (shape) {
+	case sim::BRICK_BOX:     return sim::ShapeKernel<sim::BRICK_BOX>::overlaps(cx, cz, bx, bz, radius);
+	case sim::BRICK_CAPSULE: return sim::ShapeKernel<sim::BRICK_CAPSULE>::overlaps(cx, cz, bx, bz, radius);
+	default:                 return sim::ShapeKernel<sim::BRICK_SPHERE>::overlaps(cx, cz, bx, bz, radius);
+	}
+}
+
+static void benchShapes(void)
+{
+	const int brickCount = 100000;
+	const int candidateCounts[] = { 16, 256, brickCount };
+	const float radius = (float)M_RADIUS;
+
+	std::vector<float> xs(brickCount), zs(brickCount);
+	std::vector<unsigned char> shapes(brickCount);
+	std::vector<ShapeBrick*> objects(brickCount);
+	for (int i = 0; i < brickCount; i++) {
+		xs[i] = randRange(-4.5f, 4.5f);
+		zs[i] = randRange(-3.0f, 3.0f);
+		shapes[i] = (unsigned char)(rand() % sim::BRICK_SHAPES);
+		if (shapes[i] == sim::BRICK_BOX) objects[i] = new ShapeBrickOf<sim::BRICK_BOX>(xs[i], zs[i]);
+		else if (shapes[i] == sim::BRICK_CAPSULE) objects[i] = new ShapeBrickOf<sim::BRICK_CAPSULE>(xs[i], zs[i]);
+		else objects[i] = new ShapeBrickOf<sim::BRICK_SPHERE>(xs[i], zs[i]);
+	}
+
+	printf("shapes (%d bricks, the shapes mixed)\n", brickCount);
+	printf("%12s %16s %16s %16s %10s\n", "candidates", "virtual ns/brick", "switch ns/brick", "bucket ns/brick", "same");
+
+	for (int c = 0; c < (int)(sizeof(candidateCounts) / sizeof(candidateCounts[0])); c++) {
+		const int count = candidateCounts[c];
+		const int queries = 20000000 / count;
+
+		// the candidate lists of a grid query: ascending ids around the ball
+		const int lists = count < brickCount ? 64 : 1;
+		std::vector<std::vector<int> > candidates(lists);
+		std::vector<float> bxs(lists), bzs(lists);
+		for (int l = 0; l < lists; l++) {
+			if (count < brickCount) {
+				for (int k = 0; k < count; k++) candidates[l].push_back(rand() % brickCount);
+				std::sort(candidates[l].begin(), candidates[l].end());
+				int ball = candidates[l][rand() % count];
+				bxs[l] = xs[ball] + randRange(-radius, radius);
+				bzs[l] = zs[ball] + randRange(-radius, radius);
+			}
+			else {
+				for (int i = 0; i < brickCount; i++) candidates[l].push_back(i);
+				bxs[l] = 0.0f;
+				bzs[l] = 0.0f;
+			}
+		}
+
+		std::vector<int> out(count);
+		long long hits[3] = { 0, 0, 0 };
+		double t0 = now();
+		for (int q = 0; q < queries; q++) {
+			const std::vector<int>& ids = candidates[q % lists];
+			float bx = bxs[q % lists], bz = bzs[q % lists];
+			int found = 0;
+			for (int k = 0; k < count; k++) {
+				out[found] = ids[k];
+				found += objects[ids[k]]->overlaps(bx, bz, radius) ? 1 : 0;
+			}
+			hits[0] += found;
+		}
+		double t1 = now();
+		for (int q = 0; q < queries; q++) {
+			const std::vector<int>& ids = candidates[q % lists];
+			float bx = bxs[q % lists], bz = bzs[q % lists];
+			int found = 0;
+			for (int k = 0; k < count; k++) {
+				int i = ids[k];
+				out[found] = i;
+				found += switchOverlaps(shapes[i], xs[i], zs[i], bx, bz, radius) ? 1 : 0;
+			}
+			hits[1] += found;
+		}
+		double t2 = now();
+		// the buckets are what the World scatters the candidates into, counted in the time
+		std::vector<int> buckets[sim::BRICK_SHAPES];
+		for (int s = 0; s < sim::BRICK_SHAPES; s++) buckets[s].reserve(count);
+		for (int q = 0; q < queries; q++) {
+			const std::vector<int>& ids = candidates[q % lists];
+			float bx = bxs[q % lists], bz = bzs[q % lists];
+			for (int s = 0; s < sim::BRICK_SHAPES; s++) buckets[s].clear();
+			for (int k = 0; k < count; k++) buckets[shapes[ids[k]]].push_back(ids[k]);
+			int found = 0;
+			for (int s = 0; s < sim::BRICK_SHAPES; s++) {
+				if (buckets[s].empty()) continue;
+				found += sim::bucketOverlaps(s, xs.data(), zs.data(), buckets[s].data(), (int)buckets[s].size(),
+					bx, bz, radius, &out[found]);
+			}
+			hits[2] += found;
+		}
+		double t3 = now();
+
+		double bricks = (double)queries * count;
+		printf("%12d %16.2f %16.2f %16.2f %10s\n", count, (t1 - t0) * 1e9 / bricks, (t2 - t1) * 1e9 / bricks,
+			(t3 - t2) * 1e9 / bricks, hits[0] == hits[1] && hits[1] == hits[2] ? "yes" : "NO");
+	}
+
+	for (int i = 0; i < brickCount; i++) delete objects[i];
+}
+
+// -----------------------------------------------------------------------------
+// stream: a streamed level played with the control ball under the ball. the time update() takes on
+// the simulation thread, against the step, and the memory of the chunks in play against
+// the whole level.
+// -----------------------------------------------------------------------------
+
+static void benchStream(void)
+{
+	const int frames = 200000;
+	const float timeDelta = 16.0f * 0.0007f;
+	const int chunkCounts[] = { 256, STREAM_MAX_CHUNKS };
+
+	printf("stream (%d frames of %.4f, generated chunks)\n", frames, timeDelta);
+	printf("%8s %9s %12s %12s %12s %12s %10s %8s %14s %14s\n", "chunks", "lockstep", "update ns", "update p50",
+		"update max", "step ns", "loads", "misses", "resident bytes", "level bytes");
+
+	for (int c = 0; c < (int)(sizeof(chunkCounts) / sizeof(chunkCounts[0])); c++) {
+		// the memory of the whole level
+		size_t levelBytes = 0;
+		for (int k = 0; k < chunkCounts[c]; k++) {
+			sim::Level chunk;
+			chunk.makeChunk(1, k);
+			levelBytes += chunk.getSize();
+		}
+
+		for (int lockstep = 0; lockstep < 2; lockstep++) {
+			sim::World world;
+			sim::ChunkStreamer streamer;
+			streamer.setSeed(1);
+			streamer.lockstep = lockstep != 0;
+			streamer.start(world, chunkCounts[c]);
+
+			sim::Histogram update;
+			double stepTime = 0.0;
+			for (int f = 0; f < frames; f++) {
+				long long u0 = sim::profileNow();
+				streamer.update(world);
+				update.record(sim::profileNow() - u0);
+				double t1 = now();
+				if (!world.game_start) world.launch();
+				float dz = world.moveball.getCenter().z + 0.15f - world.controlball.getCenter().z;
+				world.moveControl(std::min(std::max(dz, -0.1f), 0.1f));
+				world.step(timeDelta);
+				stepTime += now() - t1;
+			}
+			const sim::StreamStats& st = streamer.getStats();
+			printf("%8d %9s %12.1f %12lld %12lld %12.1f %10lld %8lld %14zu %14zu\n", chunkCounts[c],
+				lockstep ? "yes" : "no", update.getMean(), update.percentile(50), update.getMax(), stepTime * 1e9 / frames,
+				st.loaded, st.misses, st.residentBytesPeak, levelBytes);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------
+// particles: the debris pool kept at a number of live particles, bursts of a destroyed
+// brick refilling what expired, updated with the scalar and the SIMD kernel
+// -----------------------------------------------------------------------------
+
+// frames of the pool at about live particles, returns the seconds update() took
+static double runParticles(sim::ParticlePool& pool, int live, int frames, float timeDelta, bool scalar)
+{
+	double t = 0.0;
+	for (int f = 0; f < frames; f++) {
+		while (pool.getCount() + PARTICLES_PER_BRICK <= live) {
+			pool.spawn(randRange(-4.0f, 4.0f), (float)M_RADIUS, randRange(-3.0f, 3.0f), 0xffffff00u, PARTICLES_PER_BRICK);
+		}
+		double t0 = now();
+		pool.update(timeDelta, scalar);
+		t += now() - t0;
+	}
+	return t;
+}
+
+static void benchParticles(void)
+{
+	const int lives[] = { 1000, 10000, 60000 };
+	const float timeDelta = 16.0f * 0.0007f;
+
+	printf("particles (%s)\n", sim::kernelName());
+	printf("%10s %18s %18s %14s %10s\n", "live", "scalar ns/particle", "simd ns/particle", "frame us simd", "same");
+
+	for (int l = 0; l < (int)(sizeof(lives) / sizeof(lives[0])); l++) {
+		const int live = lives[l];
+		const int frames = 20000000 / live;
+
+		// the same spawns for both pools
+		sim::ParticlePool scalarPool, simdPool;
+		srand(1);
+		double scalar = runParticles(scalarPool, live, frames, timeDelta, true);
+		srand(1);
+		double simd = runParticles(simdPool, live, frames, timeDelta, false);
+
+		bool same = scalarPool.getCount() == simdPool.getCount() && scalarPool.getSpawned() == simdPool.getSpawned();
+		for (int i = 0; i < scalarPool.getCount() && same; i++) {
+			same = scalarPool.getX()[i] == simdPool.getX()[i] && scalarPool.getY()[i] == simdPool.getY()[i] &&
+				scalarPool.getZ()[i] == simdPool.getZ()[i] && scalarPool.getLife()[i] == simdPool.getLife()[i];
+		}
+
+		double particles = (double)frames * live;
+		printf("%10d %18.3f %18.3f %14.1f %10s\n", live, scalar * 1e9 / particles, simd * 1e9 / particles,
+			simd * 1e6 / frames, same ? "yes" : "NO");
+	}
+}
+
+// -----------------------------------------------------------------------------
+// raster: CPU rendering of a game frame by thread count, with the image of one thread
+// as the reference every other count must match bit for bit
+// -----------------------------------------------------------------------------
+
+static void benchRaster(void)
+{
+	const int width = 1024;
+	const int height = 768;
+	const int frames = 20;
+
+	std::vector<int> threadCounts;
+	int hardware = sim::WorkerPool::hardwareThreads();
+	int most = hardware > 4 ? hardware : 4;
+	for (int t = 1; t < most; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(most);
+
+	// the default level in play, with debris in the air
+	sim::Level level;
+	level.makeDefault();
+	sim::World world;
+	world.setup(level);
+	world.launch();
+	world.spawnBalls(16);
+	sim::ParticlePool particles;
+	world.onBrickHit = sim::ParticlePool::brickHit;
+	world.onBrickHitContext = &particles;
+	for (int s = 0; s < 60; s++) {
+		world.step(0.0112f);
+		particles.update(0.0112f, false);
+	}
+
+	sim::RenderFrame frame;
+	sim::renderSetup(frame, world, level, width, height);
+	sim::renderUpdate(frame, world, world.controlball.getCenter(), world.moveball.getCenter(), &particles, NULL);
+
+	printf("raster (%dx%d, %d items, %d points)\n", width, height, (int)frame.items.size(), (int)frame.points.size());
+	printf("%8s %12s %10s %10s %12s %8s\n", "threads", "ms/frame", "frames/s", "speedup", "triangles", "image");
+
+	std::vector<unsigned int> reference;
+	double single = 0.0;
+	for (size_t t = 0; t < threadCounts.size(); t++) {
+		sim::JobSystem* jobs = threadCounts[t] > 1 ? new sim::JobSystem(threadCounts[t]) : NULL;
+		sim::Rasterizer raster;
+		raster.render(frame, jobs);
+
+		double t0 = now();
+		for (int f = 0; f < frames; f++) raster.render(frame, jobs);
+		double seconds = (now() - t0) / frames;
+		if (t == 0) {
+			single = seconds;
+			reference.assign(raster.getPixels(), raster.getPixels() + width * height);
+		}
+		bool same = memcmp(raster.getPixels(), reference.data(), reference.size() * sizeof(unsigned int)) == 0;
+
+		printf("%8d %12.2f %10.1f %10.2f %12d %8s\n", threadCounts[t], seconds * 1e3, 1.0 / seconds, single / seconds,
+			raster.getTriangleCount(), same ? "same" : "DIFFERS");
+		delete jobs;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// physics: the object level calls and the frame loop, by brick and ball count.
+// every measurement is a result record, see -csv / -json.
+// -----------------------------------------------------------------------------
+
+// time per measurement, the repetitions are sized to it
+#define SUITE_SECONDS 0.2
+
+struct Result
+{
+	std::string benchmark;
+	std::string name;
+	int    bricks;
+	int    balls;
+	double value;
+	const char* unit;
+};
+
+static std::vector<Result> g_results;
+static std::vector<int> g_brickCounts;
+static std::vector<int> g_ballCounts;
+
+static void result(const char* benchmark, const char* name, int bricks, int balls, double value, const char* unit)
+{
+	Result r;
+	r.benchmark = benchmark;
+	r.name = name;
+	r.bricks = bricks;
+	r.balls = balls;
+	r.value = value;
+	r.unit = unit;
+	g_results.push_back(r);
+	printf("%10s %-22s %8d %6d %14.2f %s\n", benchmark, name, bricks, balls, value, unit);
+}
+
+static void resultHeader(void)
+{
+	printf("%10s %-22s %8s %6s %14s %s\n", "benchmark", "case", "bricks", "balls", "value", "unit");
+}
+
+// repetitions of a loop of cost seconds per repetition that fill SUITE_SECONDS
+static int repetitions(double cost)
+{
+	double n = SUITE_SECONDS / (cost > 1e-9 ? cost : 1e-9);
+	return n < 1.0 ? 1 : n > 1e8 ? 100000000 : (int)n;
+}
+
+// spheres on the left half of the field
+static std::vector<sim::Sphere> randomSpheres(int count)
+{
+	std::vector<sim::Sphere> spheres(count);
+	for (int i = 0; i < count; i++) spheres[i].setCenter(randRange(-4.2f, 0.0f), (float)M_RADIUS, randRange(-2.7f, 2.7f));
+	return spheres;
+}
+
+static void benchSphere(void)
+{
+	resultHeader();
+	for (size_t c = 0; c < g_brickCounts.size(); c++) {
+		int count = g_brickCounts[c];
+		std::vector<sim::Sphere> bricks = randomSpheres(count);
+		std::vector<sim::Sphere> balls = randomSpheres(64);
+		for (size_t k = 0; k < balls.size(); k++) balls[k].setPower(2.0, 1.0);
+
+		// hasIntersected: every ball against every brick
+		int hits = 0;
+		double t0 = now();
+		for (size_t k = 0; k < balls.size(); k++) {
+			for (int i = 0; i < count; i++) hits += bricks[i].hasIntersected(balls[k]) ? 1 : 0;
+		}
+		int reps = repetitions((now() - t0) / balls.size());
+		t0 = now();
+		for (int r = 0; r < reps; r++) {
+			sim::Sphere& ball = balls[r & 63];
+			for (int i = 0; i < count; i++) hits += bricks[i].hasIntersected(ball) ? 1 : 0;
+		}
+		double t1 = now();
+		result("sphere", "hasIntersected", count, 1, (t1 - t0) * 1e9 / ((double)reps * count), "ns/call");
+
+		// hitBy, hit every time: the brick is put back before each call
+		std::vector<sim::Sphere> copy = bricks;
+		reps = repetitions(50e-9 * count);
+		t0 = now();
+		for (int r = 0; r < reps; r++) {
+			for (int i = 0; i < count; i++) {
+				sim::Sphere& ball = balls[i & 63];
+				sim::Vec3 c = ball.getCenter();
+				copy[i].setCenter(c.x + 0.1f, c.y, c.z);
+				hits += copy[i].hitBy(ball) ? 1 : 0;
+			}
+		}
+		t1 = now();
+		result("sphere", "hitBy hit", count, 1, (t1 - t0) * 1e9 / ((double)reps * count), "ns/call");
+
+		// hitBy of a ball far from all bricks
+		sim::Sphere far;
+		far.setCenter(10.0f, (float)M_RADIUS, 10.0f);
+		reps = repetitions(10e-9 * count);
+		t0 = now();
+		for (int r = 0; r < reps; r++) {
+			for (int i = 0; i < count; i++) hits += bricks[i].hitBy(far) ? 1 : 0;
+		}
+		t1 = now();
+		result("sphere", "hitBy miss", count, 1, (t1 - t0) * 1e9 / ((double)reps * count), "ns/call");
+		g_sink += hits;
+	}
+}
+
+static void benchWall(void)
+{
+	const int calls = 1 << 20;
+	sim::World world;
+	world.setup();
+
+	// balls spread over the field, about one in ten touches a wall
+	std::vector<sim::Sphere> balls(1024);
+	for (size_t k = 0; k < balls.size(); k++) {
+		balls[k].setCenter(randRange(-4.6f, 4.6f), (float)M_RADIUS, randRange(-3.2f, 3.2f));
+		balls[k].setPower(randRange(-2.0f, 2.0f), randRange(-2.0f, 2.0f));
+	}
+
+	resultHeader();
+	int hits = 0;
+	for (int j = 0; j < world.wallCount; j++) {
+		std::vector<sim::Sphere> copy = balls;
+		double t0 = now();
+		for (int n = 0; n < calls; n++) {
+			sim::Sphere& ball = copy[n & 1023];
+			if (world.legowall[j].hitBy(ball)) {
+				hits++;
+				ball = balls[n & 1023];
+			}
+		}
+		double t1 = now();
+		char name[32];
+		sprintf(name, "hitBy wall %d", j);
+		result("wall", name, 0, 1, (t1 - t0) * 1e9 / calls, "ns/call");
+	}
+	result("wall", "hit ratio", 0, 1, 100.0 * hits / ((double)calls * world.wallCount), "%");
+	g_sink += hits;
+}
+
+static void benchUpdate(void)
+{
+	const float timeDelta = 16.0f * 0.0007f;
+
+	resultHeader();
+	for (size_t c = 0; c < g_ballCounts.size(); c++) {
+		int count = g_ballCounts[c] > 0 ? g_ballCounts[c] : 1;
+		std::vector<sim::Sphere> balls = randomSpheres(count);
+		for (int k = 0; k < count; k++) balls[k].setPower(randRange(-2.0f, 2.0f), randRange(-2.0f, 2.0f));
+
+		// tiny steps, so the balls stay on the field and keep moving
+		int reps = repetitions(3e-9 * count);
+		double t0 = now();
+		for (int r = 0; r < reps; r++) {
+			for (int k = 0; k < count; k++) balls[k].ballUpdate(timeDelta * 1e-3f);
+		}
+		double t1 = now();
+		result("update", "ballUpdate", 0, count, (t1 - t0) * 1e9 / ((double)reps * count), "ns/ball");
+		g_sink += (int)balls[0].getCenter().x;
+	}
+}
+
+// a world of the level with the game running and balls extra balls
+static void startWorld(sim::World& world, const sim::Level& level, int balls)
+{
+	world.setup(level);
+	world.launch();
+	if (balls > 0) world.spawnBalls(balls);
+}
+
+static void benchFrame(void)
+{
+	const float timeDelta = 16.0f * 0.0007f;
+	const int chunk = 64;
+
+	resultHeader();
+	for (size_t c = 0; c < g_brickCounts.size(); c++) {
+		sim::Level level;
+		brickLevel(level, g_brickCounts[c]);
+
+		for (size_t b = 0; b < g_ballCounts.size(); b++) {
+			int balls = g_ballCounts[b];
+			sim::World world;
+			startWorld(world, level, balls);
+
+			// steps in chunks. once the game ended or lost half of the balls it starts
+			// over, outside of the timing.
+			double total = 0.0;
+			long long steps = 0;
+			while (total < SUITE_SECONDS) {
+				double t0 = now();
+				for (int s = 0; s < chunk; s++) world.step(timeDelta);
+				total += now() - t0;
+				steps += chunk;
+				if (world.restarts != 0 || (int)world.balls.size() < balls / 2) startWorld(world, level, balls);
+			}
+			result("frame", "World::step", g_brickCounts[c], balls, total * 1e9 / steps, "ns/step");
+		}
+	}
+}
+
+// the built-in level with count small obstacle boxes over the brick area. the field grows
+// with the count, so there are about OBSTACLE_DENSITY per unit square whatever the count.
+#define OBSTACLE_DENSITY 10.0f
+
+static void obstacleLevel(sim::Level& level, int count)
+{
+	level.makeDefault();
+	float scale = sqrtf(count / (OBSTACLE_DENSITY * 4.2f * 5.4f));
+	if (scale < 1.0f) scale = 1.0f;
+
+	// plane, walls and bricks spread out, the walls only grow along their length
+	sim::LevelWall plane = level.getPlane();
+	plane.x *= scale; plane.z *= scale;
+	plane.width *= scale; plane.depth *= scale;
+	std::vector<sim::LevelWall> walls(level.getWalls(), level.getWalls() + level.getWallCount());
+	for (size_t j = 0; j < walls.size(); j++) {
+		walls[j].x *= scale; walls[j].z *= scale;
+		if (walls[j].width > walls[j].depth) walls[j].width *= scale;
+		else walls[j].depth *= scale;
+	}
+	int bricks = level.getBrickCount();
+	std::vector<float> xs(bricks), zs(bricks);
+	for (int i = 0; i < bricks; i++) {
+		xs[i] = level.getBrickX()[i] * scale;
+		zs[i] = level.getBrickZ()[i] * scale;
+	}
+
+	for (int n = 0; n < count; n++) {
+		sim::LevelWall w = walls[0];
+		w.x = randRange(-4.2f, 0.0f) * scale;
+		w.z = randRange(-2.7f, 2.7f) * scale;
+		w.width = randRange(0.05f, 0.15f);
+		w.depth = randRange(0.05f, 0.15f);
+		walls.push_back(w);
+	}
+	std::vector<unsigned int> colors(level.getBrickColor(), level.getBrickColor() + bricks);
+	std::vector<sim::BrickAttr> attrs(level.getBrickAttr(), level.getBrickAttr() + bricks);
+	level.assign(plane, walls, xs, zs, colors, attrs);
+}
+
+static void benchWallTree(void)
+{
+	const int obstacleCounts[] = { 0, 100, 1000, 10000 };
+	const float timeDelta = 16.0f * 0.0007f;
+	const float reach = (float)M_RADIUS + WALL_TREE_MARGIN;
+
+	resultHeader();
+	for (int c = 0; c < (int)(sizeof(obstacleCounts) / sizeof(obstacleCounts[0])); c++) {
+		sim::Level level;
+		obstacleLevel(level, obstacleCounts[c]);
+		sim::World world;
+		world.setup(level);
+		const int walls = world.wallCount;
+		char name[32];
+
+		// balls over the obstacle area
+		float scale = -world.legowall[2].getCenter().x / 4.56f;
+		std::vector<sim::Sphere> balls(1024);
+		for (size_t k = 0; k < balls.size(); k++) {
+			balls[k].setCenter(randRange(-4.2f, 0.0f) * scale, (float)M_RADIUS, randRange(-2.7f, 2.7f) * scale);
+		}
+
+		// every wall the exact test hits has to come out of the tree
+		int missed = 0;
+		for (size_t k = 0; k < balls.size(); k++) {
+			sim::Vec3 b = balls[k].getCenter();
+			std::vector<int> found;
+			world.wallTree.query(b.x - reach, b.z - reach, b.x + reach, b.z + reach, found);
+			for (int j = 0; j < walls; j++) {
+				if (world.legowall[j].hasIntersected(balls[k]) && !std::binary_search(found.begin(), found.end(), j)) missed++;
+			}
+		}
+		if (missed) printf("  %d walls missed by the tree\n", missed);
+
+		int reps = repetitions(1024 * 10e-9 * (1 + world.wallTree.getDepth()));
+		int hits = 0;
+		std::vector<int> ids;
+		double t0 = now();
+		for (int r = 0; r < reps; r++) {
+			for (size_t k = 0; k < balls.size(); k++) {
+				sim::Vec3 b = balls[k].getCenter();
+				ids.clear();
+				world.wallTree.query(b.x - reach, b.z - reach, b.x + reach, b.z + reach, ids);
+				for (size_t h = 0; h < ids.size(); h++) hits += world.legowall[ids[h]].hasIntersected(balls[k]) ? 1 : 0;
+			}
+		}
+		double t1 = now();
+		sprintf(name, "tree %d walls", walls);
+		result("walltree", name, world.brickCount, 1, (t1 - t0) * 1e9 / ((double)reps * balls.size()), "ns/query");
+
+		reps = repetitions(1024 * 2e-9 * walls);
+		t0 = now();
+		for (int r = 0; r < reps; r++) {
+			for (size_t k = 0; k < balls.size(); k++) {
+				for (int j = 0; j < walls; j++) hits += world.legowall[j].hasIntersected(balls[k]) ? 1 : 0;
+			}
+		}
+		t1 = now();
+		sprintf(name, "linear %d walls", walls);
+		result("walltree", name, world.brickCount, 1, (t1 - t0) * 1e9 / ((double)reps * balls.size()), "ns/query");
+		g_sink += hits;
+
+		// a running game, started over when the ball is lost
+		double total = 0.0;
+		long long steps = 0;
+		startWorld(world, level, 0);
+		while (total < SUITE_SECONDS) {
+			t0 = now();
+			for (int s = 0; s < 64; s++) world.step(timeDelta);
+			total += now() - t0;
+			steps += 64;
+			if (world.restarts != 0) startWorld(world, level, 0);
+		}
+		sprintf(name, "World::step %d walls", walls);
+		result("walltree", name, world.brickCount, 1, total * 1e9 / steps, "ns/step");
+
+		// the batch engine walks the same tree for four games at once
+		sprintf(name, "batch diff %d walls", walls);
+		result("walltree", name, world.brickCount, 1, batchMismatches(level, 64, 2000, timeDelta), "games");
+	}
+}
+
+static void benchReset(void)
+{
+	resultHeader();
+	for (size_t c = 0; c < g_brickCounts.size(); c++) {
+		sim::Level level;
+		brickLevel(level, g_brickCounts[c]);
+		sim::World world;
+		world.setup(level);
+
+		int reps = repetitions(20e-9 * g_brickCounts[c]);
+		double t0 = now();
+		for (int r = 0; r < reps; r++) world.resetLevel();
+		double t1 = now();
+		result("reset", "World::resetLevel", g_brickCounts[c], 0, (t1 - t0) * 1e9 / reps, "ns/call");
+
+		reps = repetitions(100e-9 * g_brickCounts[c]);
+		t0 = now();
+		for (int r = 0; r < reps; r++) world.setup(level);
+		t1 = now();
+		result("reset", "World::setup", g_brickCounts[c], 0, (t1 - t0) * 1e9 / reps, "ns/call");
+	}
+}
+
+static bool writeResults(const char* path, bool json)
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL) return false;
+
+	// what the numbers were measured with, repeated on every record so files can be merged
+	char stamp[32];
+	time_t t = time(NULL);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+	const char* kernel = sim::kernelName();
+
+	if (json) fprintf(fp, "[\n");
+	else fprintf(fp, "time,kernel,benchmark,case,bricks,balls,value,unit\n");
+	for (size_t i = 0; i < g_results.size(); i++) {
+		const Result& r = g_results[i];
+		if (json) {
+			fprintf(fp, "  { \"time\": \"%s\", \"kernel\": \"%s\", \"benchmark\": \"%s\", \"case\": \"%s\", "
+				"\"bricks\": %d, \"balls\": %d, \"value\": %.3f, \"unit\": \"%s\" }%s\n",
+				stamp, kernel, r.benchmark.c_str(), r.name.c_str(), r.bricks, r.balls, r.value, r.unit,
+				i + 1 < g_results.size() ? "," : "");
+		}
+		else {
+			fprintf(fp, "%s,%s,%s,%s,%d,%d,%.3f,%s\n", stamp, kernel, r.benchmark.c_str(), r.name.c_str(),
+				r.bricks, r.balls, r.value, r.unit);
+		}
+	}
+	if (json) fprintf(fp, "]\n");
+	return fclose(fp) == 0;
+}
+
+// "1,2,3" into counts; false on anything else
+static bool parseCounts(const char* text, std::vector<int>& counts)
+{
+	counts.clear();
+	while (*text) {
+		char* end;
+		long n = strtol(text, &end, 10);
+		if (end == text || n < 0) return false;
+		counts.push_back((int)n);
+		text = *end == ',' ? end + 1 : end;
+		if (*end != ',' && *end != '\0') return false;
+	}
+	return !counts.empty();
+}
+
+// -----------------------------------------------------------------------------
+// main
+// -----------------------------------------------------------------------------
+
+struct Benchmark
+{
+	const char* name;
+	void (*run)(void);
+};
+
+static const Benchmark g_benchmarks[] = {
+	{ "collide", benchCollide },
+	{ "boundary", benchBoundary },
+	{ "grid",    benchGrid },
+	{ "sweep",   benchSweep },
+	{ "sleep",   benchSleep },
+	{ "events",  benchEvents },
+	{ "level",   benchLevel },
+	{ "multiball", benchMultiball },
+	{ "batch",   benchBatch },
+	{ "jobs",    benchJobs },
+	{ "snapshot", benchSnapshot },
+	{ "replay",  benchReplay },
+	{ "impact",  benchImpact },
+	{ "layout",  benchLayout },
+	{ "shapes",  benchShapes },
+	{ "stream",  benchStream },
+	{ "particles", benchParticles },
+	{ "raster",  benchRaster },
+	{ "sphere",  benchSphere },
+	{ "wall",    benchWall },
+	{ "walltree", benchWallTree },
+	{ "update",  benchUpdate },
+	{ "frame",   benchFrame },
+	{ "reset",   benchReset },
+};
+
+int main(int argc, char* argv[])
+{
+	const int benchmarkCount = (int)(sizeof(g_benchmarks) / sizeof(g_benchmarks[0]));
+	const int brickCounts[] = { DEFAULT_LEVEL_BRICKS, 1024, 16384 };
+	const int ballCounts[] = { 0, 16, 256 };
+	g_brickCounts.assign(brickCounts, brickCounts + 3);
+	g_ballCounts.assign(ballCounts, ballCounts + 3);
+
+	const char* resultPath = NULL;
+	bool json = false;
+	std::vector<int> run;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-bricks") == 0 && i + 1 < argc) {
+			if (!parseCounts(argv[++i], g_brickCounts)) {
+				fprintf(stderr, "bad brick counts: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-balls") == 0 && i + 1 < argc) {
+			if (!parseCounts(argv[++i], g_ballCounts)) {
+				fprintf(stderr, "bad ball counts: %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if ((strcmp(argv[i], "-csv") == 0 || strcmp(argv[i], "-json") == 0) && i + 1 < argc) {
+			json = strcmp(argv[i], "-json") == 0;
+			resultPath = argv[++i];
+		}
+		else {
+			int b = 0;
+			for (; b < benchmarkCount; b++) {
+				if (strcmp(argv[i], g_benchmarks[b].name) == 0) break;
+			}
+			if (b == benchmarkCount) {
+				fprintf(stderr, "unknown benchmark: %s\n", argv[i]);
+				return 1;
+			}
+			run.push_back(b);
+		}
+	}
+	if (run.empty()) {
+		for (int b = 0; b < benchmarkCount; b++) run.push_back(b);
+	}
+
+	srand(1);
+	for (size_t r = 0; r < run.size(); r++) g_benchmarks[run[r]].run();
+
+	if (resultPath != NULL && !writeResults(resultPath, json)) {
+		fprintf(stderr, "can not write %s\n", resultPath);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,997 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simCore.cpp
+//
+// Desc: Direct3D-free simulation core of the game.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simCore.h"
+#include "simEvent.h"
+#include "simKernel.h"
+#include "simProfile.h"
+#include "simShapes.h"
+#include "simSweep.h"
+#include "simThreads.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// contacts resolved for the moving ball in one step of the continuous mode
+#define MAX_SWEEP_CONTACTS 8
+
+// -----------------------------------------------------------------------------
+// Sphere
+// -----------------------------------------------------------------------------
+
+sim::Sphere::Sphere(void)
+{
+	center_x = center_y = center_z = 0.0f;
+	m_radius = (float)(M_RADIUS);
+	m_velocity_x = 0;
+	m_velocity_z = 0;
+	isControlball = false;
+}
+
+bool sim::Sphere::hasIntersected(Sphere& ball)
+{
+	Vec3 cord = this->getCenter();
+	Vec3 ball_cord = ball.getCenter();
+#if defined(SIM_DETERMINISTIC)
+	// float only, the squared distance against the squared radii (the test of sphereHitMask)
+	float dx = cord.x - ball_cord.x;
+	float dz = cord.z - ball_cord.z;
+	float radii = this->getRadius() + ball.getRadius();
+	return dx * dx + dz * dz < radii * radii;
+#else
+	double xDistance = fabs((cord.x - ball_cord.x) * (cord.x - ball_cord.x));
+	double zDistance = fabs((cord.z - ball_cord.z) * (cord.z - ball_cord.z));
+	double totalDistance = sqrt(xDistance + zDistance);
+
+	if (totalDistance < (this->getRadius() + ball.getRadius()))
+	{
+		return true;
+	}
+
+	return false;
+#endif
+}
+
+bool sim::Sphere::hitBy(Sphere& ball)
+{
+	if (hasIntersected(ball)) {
+		bounce(ball);
+		return true;
+	}
+	return false;
+}
+
+void sim::Sphere::bounce(Sphere& ball)
+{
+	deflect(ball, center_x, center_z);
+
+	// the control ball is never destroyed, bricks are parked outside the field
+	if (!this->isControlBall()) {
+		this->setCenter(-10.0f, -10.0f, 0.0f);
+	}
+}
+
+void sim::deflect(Sphere& ball, float cx, float cz)
+{
+	// bounce the ball away from (cx, cz). only the direction of the hit matters,
+	// so the ball keeps its speed and takes the direction of the center difference.
+	float delta_x = ball.getCenter().x - cx;
+	float delta_z = ball.getCenter().z - cz;
+	float multiple;
+
+#if defined(SIM_DETERMINISTIC)
+	float bvx = (float)ball.getVelocity_X();
+	float bvz = (float)ball.getVelocity_Z();
+	float velocity_vector_scala = sqrtf(bvx * bvx + bvz * bvz);
+	float distance_vector_scala = sqrtf(delta_x * delta_x + delta_z * delta_z); // direction vector
+#else
+	float velocity_vector_scala = sqrt(ball.getVelocity_X() * ball.getVelocity_X() + ball.getVelocity_Z() * ball.getVelocity_Z());
+	float distance_vector_scala = sqrt(delta_x * delta_x + delta_z * delta_z); // direction vector
+#endif
+	multiple = velocity_vector_scala / distance_vector_scala;
+
+	float new_velocity_x = multiple * delta_x;
+	float new_velocity_z = multiple * delta_z;
+
+	ball.setPower(new_velocity_x, new_velocity_z);
+}
+
+void sim::Sphere::ballUpdate(float timeDiff)
+{
+	Vec3 cord = this->getCenter();
+
+	if (!isResting())
+	{
+		float tX = cord.x + TIME_SCALE * timeDiff * m_velocity_x;
+		float tZ = cord.z + TIME_SCALE * timeDiff * m_velocity_z;
+
+		this->setCenter(tX, cord.y, tZ);
+	}
+	else { this->setPower(0, 0); }
+}
+
+// below the speed ballUpdate moves at, for Sphere and BrickStore alike
+static bool resting(float vx, float vz)
+{
+#if defined(SIM_DETERMINISTIC)
+	return !(fabsf(vx) > 0.01f || fabsf(vz) > 0.01f);
+#else
+	double ax = fabs((double)vx);
+	double az = fabs((double)vz);
+	return !(ax > 0.01 || az > 0.01);
+#endif
+}
+
+bool sim::Sphere::isResting(void) const
+{
+	return resting(m_velocity_x, m_velocity_z);
+}
+
+void sim::Sphere::setPower(double vx, double vz)
+{
+	this->m_velocity_x = (float)vx;
+	this->m_velocity_z = (float)vz;
+}
+
+void sim::Sphere::setCenter(float x, float y, float z)
+{
+	center_x = x;	center_y = y;	center_z = z;
+}
+
+// -----------------------------------------------------------------------------
+// Wall
+// -----------------------------------------------------------------------------
+
+sim::Wall::Wall(void)
+{
+	m_x = m_y = m_z = 0.0f;
+	m_width = 0;
+	m_depth = 0;
+	m_height = 0;
+}
+
+void sim::Wall::setSize(float iwidth, float iheight, float idepth)
+{
+	m_width = iwidth;
+	m_height = iheight;
+	m_depth = idepth;
+}
+
+void sim::Wall::setPosition(float x, float y, float z)
+{
+	m_x = x;
+	m_y = y;
+	m_z = z;
+}
+
+bool sim::Wall::hasIntersected(Sphere& ball)
+{
+	float cord_x = ball.getCenter().x;
+	float cord_z = ball.getCenter().z;
+
+	float hit_boundary_min_x = this->m_x - this->getWidth() / 2 - ball.getRadius();
+	float hit_boundary_max_x = this->m_x + this->getWidth() / 2 + ball.getRadius();
+	float hit_boundary_min_z = this->m_z - this->getDepth() / 2 - ball.getRadius();
+	float hit_boundary_max_z = this->m_z + this->getDepth() / 2 + ball.getRadius();
+
+	if ((hit_boundary_min_x <= cord_x && cord_x <= hit_boundary_max_x) && (hit_boundary_min_z <= cord_z && cord_z <= hit_boundary_max_z)) {
+		return true;
+	}
+	return false;
+}
+
+bool sim::Wall::hitBy(Sphere& ball)
+{
+	if (hasIntersected(ball)) {
+
+		float cord_x = ball.getCenter().x;
+		float cord_z = ball.getCenter().z;
+
+		float boundary_min_x = this->m_x - this->getWidth() / 2;
+		float boundary_max_x = this->m_x + this->getWidth() / 2;
+		float boundary_min_z = this->m_z - this->getDepth() / 2;
+		float boundary_max_z = this->m_z + this->getDepth() / 2;
+
+		if ((boundary_min_x <= cord_x && cord_x <= boundary_max_x) && !(boundary_min_z <= cord_z && cord_z <= boundary_max_z)) {
+			if (boundary_min_z - ball.getRadius() <= cord_z && cord_z <= this->m_z) {
+				cord_z = boundary_min_z - ball.getRadius() - COR_VAL;
+			}
+			else {
+				cord_z = boundary_max_z + ball.getRadius() + COR_VAL;
+			}
+			ball.setPower(ball.getVelocity_X(), -ball.getVelocity_Z());
+		}
+
+		if (!(boundary_min_x <= cord_x && cord_x <= boundary_max_x) && (boundary_min_z <= cord_z && cord_z <= boundary_max_z)) {
+			if (boundary_min_x - ball.getRadius() <= cord_x && cord_x <= this->m_x) {
+				cord_x = boundary_min_x - ball.getRadius() - COR_VAL;
+			}
+			else {
+				cord_x = boundary_max_x + ball.getRadius() + COR_VAL;
+			}
+			ball.setPower(-ball.getVelocity_X(), ball.getVelocity_Z());
+		}
+
+		if (ball.isControlBall()) {
+			ball.setPower(0.0, 0.0);
+		}
+
+		ball.setCenter(cord_x, ball.getCenter().y, cord_z);
+		return true;
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------
+// LiveSet
+// -----------------------------------------------------------------------------
+
+void sim::LiveSet::fill(int count)
+{
+	m_ids.resize(count);
+	m_slot.resize(count);
+	for (int i = 0; i < count; i++) {
+		m_ids[i] = i;
+		m_slot[i] = i;
+	}
+}
+
+void sim::LiveSet::clear(int count)
+{
+	m_ids.clear();
+	m_ids.reserve(count);
+	m_slot.assign(count, -1);
+}
+
+void sim::LiveSet::insert(int id)
+{
+	if (m_slot[id] >= 0) return;
+	m_slot[id] = (int)m_ids.size();
+	m_ids.push_back(id);
+}
+
+void sim::LiveSet::remove(int id)
+{
+	int slot = m_slot[id];
+	if (slot < 0) return;
+
+	int last = m_ids.back();
+	m_ids[slot] = last;
+	m_slot[last] = slot;
+	m_ids.pop_back();
+	m_slot[id] = -1;
+}
+
+void sim::LiveSet::assign(const int* ids, int count, const int* slots)
+{
+	m_ids.assign(ids, ids + count);
+	std::copy(slots, slots + m_slot.size(), m_slot.begin());
+}
+
+void sim::integrate(Sphere* spheres, LiveSet& awake, float timeDelta, BrickGrid* grid)
+{
+	// backwards, so the id swapped in by a removal has already been updated
+	for (int n = awake.size() - 1; n >= 0; n--) {
+		int i = awake[n];
+		Vec3 before = spheres[i].getCenter();
+		spheres[i].ballUpdate(timeDelta);
+		Vec3 after = spheres[i].getCenter();
+
+		if (grid != NULL && (before.x != after.x || before.z != after.z)) {
+			grid->move(i, after.x, after.z);
+		}
+		if (spheres[i].isResting()) awake.remove(i);
+	}
+}
+
+void sim::integrate(BrickStore& bricks, LiveSet& awake, float timeDelta, BrickGrid* grid)
+{
+	// ballUpdate on the arrays: a brick costs its x, z, vx and vz, not a whole object
+	const float step = TIME_SCALE * timeDelta;
+	float* x = bricks.x.data();
+	float* z = bricks.z.data();
+	float* vx = bricks.vx.data();
+	float* vz = bricks.vz.data();
+
+	for (int n = awake.size() - 1; n >= 0; n--) {
+		int i = awake[n];
+		if (resting(vx[i], vz[i])) {
+			vx[i] = vz[i] = 0.0f;
+			awake.remove(i);
+			continue;
+		}
+		float nx = x[i] + step * vx[i];
+		float nz = z[i] + step * vz[i];
+		if (grid != NULL && (nx != x[i] || nz != z[i])) grid->move(i, nx, nz);
+		x[i] = nx;
+		z[i] = nz;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BrickStore
+// -----------------------------------------------------------------------------
+
+void sim::BrickStore::assign(int count)
+{
+	x.assign(count, 0.0f);
+	y.assign(count, 0.0f);
+	z.assign(count, 0.0f);
+	vx.assign(count, 0.0f);
+	vz.assign(count, 0.0f);
+	shape.assign(count, BRICK_SPHERE);
+	hits.assign(count, 1);
+	BrickCold blank;
+	memset(&blank, 0, sizeof(blank));
+	cold.assign(count, blank);
+}
+
+void sim::BrickStore::copyHot(const BrickStore& from)
+{
+	std::copy(from.x.begin(), from.x.end(), x.begin());
+	std::copy(from.y.begin(), from.y.end(), y.begin());
+	std::copy(from.z.begin(), from.z.end(), z.begin());
+	std::copy(from.vx.begin(), from.vx.end(), vx.begin());
+	std::copy(from.vz.begin(), from.vz.end(), vz.begin());
+	std::copy(from.hits.begin(), from.hits.end(), hits.begin());
+}
+
+sim::Sphere sim::BrickStore::get(int i) const
+{
+	Sphere s;
+	s.setCenter(x[i], y[i], z[i]);
+	s.setPower(vx[i], vz[i]);
+	return s;
+}
+
+void sim::BrickStore::set(int i, const Sphere& s)
+{
+	Vec3 c = s.getCenter();
+	x[i] = c.x;
+	y[i] = c.y;
+	z[i] = c.z;
+	vx[i] = (float)s.getVelocity_X();
+	vz[i] = (float)s.getVelocity_Z();
+}
+
+bool sim::BrickRef::hitBy(Sphere& ball)
+{
+	Sphere s = m_store->get(m_id);
+	if (!s.hitBy(ball)) return false;
+	m_store->set(m_id, s);
+	return true;
+}
+
+void sim::BrickRef::bounce(Sphere& ball)
+{
+	Sphere s = m_store->get(m_id);
+	s.bounce(ball);
+	m_store->set(m_id, s);
+}
+
+// -----------------------------------------------------------------------------
+// World
+// -----------------------------------------------------------------------------
+
+sim::World::World(void)
+{
+	brickCount = 0;
+	wallCount = 0;
+	game_start = false;
+	restarts = 0;
+	ticks = 0;
+	continuous = false;
+	launchSpeed = 2.5f;
+	workers = NULL;
+	onBrickHit = NULL;
+	onBrickHitContext = NULL;
+	ballTimeDelta = 0.0f;
+	gridMinX = 0.0f;
+	gridMaxX = 0.0f;
+	brickShapes = 0;
+	brickBound = (float)M_RADIUS;
+}
+
+void sim::World::setup(void)
+{
+	Level level;
+	level.makeDefault();
+	setup(level);
+}
+
+void sim::World::setup(const Level& level)
+{
+	setup(level, 0);
+}
+
+void sim::World::setup(const Level& level, int spareBricks)
+{
+	ticks = 0;
+	restarts = 0;
+
+	// plane and walls of the level
+	const LevelWall& plane = level.getPlane();
+	legoPlane.setSize(plane.width, plane.height, plane.depth);
+	legoPlane.setPosition(plane.x, plane.y, plane.z);
+
+	wallCount = level.getWallCount();
+	legowall.assign(wallCount, Wall());
+	for (int j = 0; j < wallCount; j++) {
+		const LevelWall& w = level.getWalls()[j];
+		legowall[j].setSize(w.width, w.height, w.depth);
+		legowall[j].setPosition(w.x, w.y, w.z);
+	}
+	buildWallTree();
+
+	// bricks, read straight from the level arrays
+	const int levelBricks = level.getBrickCount();
+	brickCount = levelBricks + spareBricks;
+	const float* brickX = level.getBrickX();
+	const float* brickZ = level.getBrickZ();
+	const unsigned int* brickColor = level.getBrickColor();
+	const BrickAttr* brickAttr = level.getBrickAttr();
+	sphere.assign(brickCount);
+	sphere.x.assign(brickX, brickX + levelBricks);
+	sphere.y.assign(levelBricks, (float)M_RADIUS);
+	sphere.z.assign(brickZ, brickZ + levelBricks);
+	// spare bricks wait where destroyed ones are parked
+	sphere.x.resize(brickCount, -10.0f);
+	sphere.y.resize(brickCount, -10.0f);
+	sphere.z.resize(brickCount, 0.0f);
+	brickShapes = 0;
+	for (int i = 0; i < levelBricks; i++) {
+		sphere.shape[i] = (unsigned char)brickAttr[i].shape;
+		sphere.hits[i] = brickAttr[i].hits > 0 ? brickAttr[i].hits : 1;
+		sphere.cold[i].color = brickColor[i];
+		sphere.cold[i].attr = brickAttr[i];
+		brickShapes |= 1 << brickAttr[i].shape;
+	}
+	brickBound = shapeBound(brickShapes | (1 << BRICK_SPHERE));
+	liveBricks.clear(brickCount);
+	awakeBricks.clear(brickCount);
+	for (int i = 0; i < levelBricks; i++) {
+		liveBricks.insert(i);
+		if (!resting(sphere.vx[i], sphere.vz[i])) awakeBricks.insert(i);
+	}
+	gridMaxX = plane.x + plane.width / 2;
+	gridMinX = spareBricks > 0 ? gridMaxX - (float)(4 * M_RADIUS) : plane.x - plane.width / 2;
+	buildGrid();
+
+	initialSphere = sphere;
+	initialLiveBricks = liveBricks;
+	initialAwakeBricks = awakeBricks;
+	initialGrid = brickGrid;
+
+	// the balls start at the open right edge of the plane
+	float edge = plane.x + plane.width / 2;
+	controlball.setCenter(edge - M_RADIUS, (float)M_RADIUS, .0f);
+	controlball.setControlBall(true);
+
+	moveball.setCenter(edge - 3 * M_RADIUS, (float)M_RADIUS, .0f);
+	moveball.setPower(0, 0);
+	// extra balls of a world set up again (a recording starts from here, and does not have them)
+	balls.clear();
+
+	game_start = false;
+}
+
+void sim::World::step(float timeDelta)
+{
+	SIM_PROFILE_SCOPE(STAGE_STEP);
+	ticks++;
+
+	// update the position of balls.
+	{
+		SIM_PROFILE_SCOPE(STAGE_UPDATE);
+		if (!continuous) moveball.ballUpdate(timeDelta);
+		controlball.ballUpdate(timeDelta);
+		integrate(sphere, awakeBricks, timeDelta, &brickGrid);
+	}
+
+	// continuous mode: move the ball along its path. the discrete tests below then
+	// only catch a ball that already started the step overlapping something.
+	if (continuous) {
+		SIM_PROFILE_SCOPE(STAGE_SWEEP);
+		sweepMoveball(timeDelta);
+	}
+
+	// check whether moveball hit by walls. a ball pushed out of one wall into another is
+	// resolved on the next pass, and a pass that hits nothing ends them. every wall can
+	// push the ball once, so there is one pass more than walls (never by the bricks: a
+	// level without bricks still has its walls).
+	{
+		SIM_PROFILE_SCOPE(STAGE_WALL_COLLISION);
+		hitWalls(moveball, WALL_PASSES(wallCount), true, wallHits);
+	}
+
+	// check whether any brick hit by moveball and update the direction of moveball.
+	// the grid only returns the bricks around the ball. they are resolved in index order
+	// and the ball does not move meanwhile, so this is the same as calling hitBy on every
+	// brick in order. destroyed bricks leave the grid.
+	{
+		SIM_PROFILE_SCOPE(STAGE_BRICK_COLLISION);
+		touchedBricks(moveball, brickHits, brickBuckets);
+		for (size_t h = 0; h < brickHits.size(); h++) strikeBrick(brickHits[h], moveball, -1);
+	}
+
+	{
+		SIM_PROFILE_SCOPE(STAGE_CONTROL_COLLISION);
+
+		// check whether legowall hit by controlball.
+		hitWalls(controlball, 1, false, wallHits);
+
+		// check whether controlball hit by moveball.
+		if (controlball.hitBy(moveball)) eventPost(EVENT_COLLISION, ticks, -1, moveball.getCenter().x, moveball.getCenter().z);
+	}
+
+	if (!balls.empty()) {
+		SIM_PROFILE_SCOPE(STAGE_BALLS);
+		stepBalls(timeDelta);
+	}
+
+	// If game not started, moveball follows controlball
+	if (!game_start) moveball.setCenter(controlball.getCenter().x - 2 * controlball.getRadius(), controlball.getCenter().y, controlball.getCenter().z);
+
+	// If ball out of field, restart game
+	if (moveball.getCenter().x >= legoPlane.getCenter().x + legoPlane.getWidth() / 2 + 3.5f) {
+		SIM_PROFILE_SCOPE(STAGE_RESET);
+		resetLevel();
+	}
+}
+
+void sim::World::resetLevel(void)
+{
+	game_start = false;
+	restarts++;
+	eventPost(EVENT_RESET, ticks, -1, moveball.getCenter().x, moveball.getCenter().z);
+	moveball.setCenter(controlball.getCenter().x - 2 * controlball.getRadius(), controlball.getCenter().y, controlball.getCenter().z);
+	moveball.setPower(0, 0);
+	balls.clear();
+
+	// bricks back to the initial layout: bulk copies, no per brick setup
+	sphere.copyHot(initialSphere);
+	liveBricks = initialLiveBricks;
+	awakeBricks = initialAwakeBricks;
+	brickGrid = initialGrid;
+}
+
+void sim::World::buildGrid(void)
+{
+	// the grid covers the plane, or the window of it. cells are two ball diameters wide,
+	// so a ball never touches more than 2x2 of them.
+	Vec3 center = legoPlane.getCenter();
+	float halfDepth = legoPlane.getDepth() / 2;
+	brickGrid.reset(gridMinX, center.z - halfDepth, gridMaxX, center.z + halfDepth, (float)(4 * M_RADIUS), brickCount);
+
+	for (int n = 0; n < liveBricks.size(); n++) {
+		int i = liveBricks[n];
+		brickGrid.insert(i, sphere.x[i], sphere.z[i]);
+	}
+}
+
+void sim::World::placeBrick(int i, float x, float z, unsigned int color, const BrickAttr& attr)
+{
+	sphere.x[i] = x;
+	sphere.y[i] = (float)M_RADIUS;
+	sphere.z[i] = z;
+	sphere.vx[i] = 0.0f;
+	sphere.vz[i] = 0.0f;
+	sphere.shape[i] = (unsigned char)attr.shape;
+	sphere.hits[i] = attr.hits > 0 ? attr.hits : 1;
+	sphere.cold[i].color = color;
+	sphere.cold[i].attr = attr;
+	if (!(brickShapes & (1 << attr.shape))) {
+		brickShapes |= 1 << attr.shape;
+		brickBound = shapeBound(brickShapes | (1 << BRICK_SPHERE));
+	}
+	liveBricks.insert(i);
+	brickGrid.insert(i, x, z);
+}
+
+void sim::World::removeBrick(int i)
+{
+	sphere[i].setCenter(-10.0f, -10.0f, 0.0f);
+	liveBricks.remove(i);
+	awakeBricks.remove(i);
+	brickGrid.remove(i);
+}
+
+void sim::World::setGridWindow(float minX, float maxX)
+{
+	gridMinX = minX;
+	gridMaxX = maxX;
+	buildGrid();
+
+	Vec3 center = legoPlane.getCenter();
+	float halfDepth = legoPlane.getDepth() / 2;
+	initialGrid.reset(gridMinX, center.z - halfDepth, gridMaxX, center.z + halfDepth, (float)(4 * M_RADIUS), brickCount);
+	for (int n = 0; n < initialLiveBricks.size(); n++) {
+		int i = initialLiveBricks[n];
+		initialGrid.insert(i, initialSphere.x[i], initialSphere.z[i]);
+	}
+}
+
+void sim::World::setBrickPower(int i, double vx, double vz)
+{
+	sphere[i].setPower(vx, vz);
+	wakeBrick(i);
+}
+
+void sim::World::wakeBrick(int i)
+{
+	if (liveBricks.contains(i) && !sphere[i].isResting()) awakeBricks.insert(i);
+}
+
+void sim::World::touchedBricks(const Sphere& ball, std::vector<int>& hits, ShapeBuckets& buckets) const
+{
+	const Vec3 c = ball.getCenter();
+	const float radius = ball.getRadius();
+	hits.clear();
+	buckets.candidates.clear();
+	// the grid tests in float, bucketOverlaps decides (in double for spheres): the margin
+	// keeps the grid from dropping a brick right at the contact distance
+	if (brickGrid.query(c.x, c.z, brickBound + radius + HIT_MASK_MARGIN, buckets.candidates, buckets.mask) == 0) return;
+
+	// a level of one shape needs no bucketing, the candidates are its bucket
+	const bool mixed = (brickShapes & (brickShapes - 1)) != 0;
+	if (mixed) {
+		for (int s = 0; s < BRICK_SHAPES; s++) buckets.ids[s].clear();
+		for (size_t k = 0; k < buckets.candidates.size(); k++) {
+			int i = buckets.candidates[k];
+			buckets.ids[sphere.shape[i]].push_back(i);
+		}
+	}
+
+	for (int s = 0; s < BRICK_SHAPES; s++) {
+		if (!(brickShapes & (1 << s))) continue;
+		const std::vector<int>& ids = mixed ? buckets.ids[s] : buckets.candidates;
+		if (ids.empty()) continue;
+		size_t at = hits.size();
+		hits.resize(at + ids.size());
+		int found = bucketOverlaps(s, sphere.x.data(), sphere.z.data(), ids.data(), (int)ids.size(), c.x, c.z, radius, &hits[at]);
+		hits.resize(at + found);
+	}
+	std::sort(hits.begin(), hits.end());
+}
+
+bool sim::World::strikeBrick(int i, Sphere& ball, int axis)
+{
+	const int shape = sphere.shape[i];
+	if (sphere.hits[i] > 1 && shapeLeaving(shape, sphere.x[i], sphere.z[i], ball)) return false;
+
+	Vec3 c = ball.getCenter();
+	eventPost(EVENT_COLLISION, ticks, i, c.x, c.z);
+	shapeBounce(shape, sphere.x[i], sphere.z[i], ball, axis);
+
+	const bool destroyed = sphere.hits[i] <= 1;
+	if (onBrickHit != NULL) onBrickHit(onBrickHitContext, i, sphere.x[i], sphere.z[i], sphere.cold[i].color, destroyed);
+
+	if (!destroyed) {
+		sphere.hits[i]--;
+		return true;
+	}
+	// destroyed bricks are parked outside the field, like Sphere::bounce did
+	sphere[i].setCenter(-10.0f, -10.0f, 0.0f);
+	destroyBrick(i, ball);
+	return true;
+}
+
+void sim::World::destroyBrick(int i, const Sphere& ball)
+{
+	eventPost(EVENT_BRICK_DESTROYED, ticks, i, ball.getCenter().x, ball.getCenter().z);
+	liveBricks.remove(i);
+	awakeBricks.remove(i);
+	brickGrid.remove(i);
+}
+
+void sim::World::sweepMoveball(float timeDelta)
+{
+	// same rest threshold as ballUpdate
+	if (moveball.isResting()) {
+		moveball.setPower(0, 0);
+		return;
+	}
+
+	float remaining = 1.0f;
+	for (int contact = 0; contact < MAX_SWEEP_CONTACTS && remaining > 0.0f; contact++) {
+		Vec3 p = moveball.getCenter();
+		float dx = TIME_SCALE * timeDelta * remaining * (float)moveball.getVelocity_X();
+		float dz = TIME_SCALE * timeDelta * remaining * (float)moveball.getVelocity_Z();
+
+		float first;
+		int index, axis;
+		int kind = firstContact(moveball, dx, dz, first, index, axis);
+		if (kind == CONTACT_NONE) {
+			moveball.setCenter(p.x + dx, p.y, p.z + dz);
+			break;
+		}
+
+		remaining *= (1.0f - first);
+		resolveContact(moveball, kind, index, axis, p.x + first * dx, p.z + first * dz, dx, dz);
+	}
+}
+
+int sim::World::firstContact(const Sphere& ball, float dx, float dz, float& first, int& index, int& axis)
+{
+	const Vec3 p = ball.getCenter();
+	const float radius = ball.getRadius();
+	const float reach = brickBound + radius;
+
+	// earliest contact. on equal times walls win over bricks over the control ball,
+	// and lower indices win, the order of the discrete tests.
+	first = 2.0f;
+	index = -1;
+	axis = 0;
+	int kind = CONTACT_NONE;
+	float t;
+	int a;
+
+	const float minX = (dx < 0 ? p.x + dx : p.x) - radius - WALL_TREE_MARGIN;
+	const float minZ = (dz < 0 ? p.z + dz : p.z) - radius - WALL_TREE_MARGIN;
+	const float maxX = (dx > 0 ? p.x + dx : p.x) + radius + WALL_TREE_MARGIN;
+	const float maxZ = (dz > 0 ? p.z + dz : p.z) + radius + WALL_TREE_MARGIN;
+	wallHits.clear();
+	wallTree.query(minX, minZ, maxX, maxZ, wallHits);
+	for (size_t h = 0; h < wallHits.size(); h++) {
+		int j = wallHits[h];
+		Vec3 c = legowall[j].getCenter();
+		if (sweepBox(p.x, p.z, dx, dz, c.x, c.z, legowall[j].getWidth() / 2, legowall[j].getDepth() / 2, radius, t, a) && t < first) {
+			first = t; kind = CONTACT_WALL; index = j; axis = a;
+		}
+	}
+
+	brickHits.clear();
+	brickGrid.queryBox((dx < 0 ? p.x + dx : p.x) - reach, (dz < 0 ? p.z + dz : p.z) - reach,
+		(dx > 0 ? p.x + dx : p.x) + reach, (dz > 0 ? p.z + dz : p.z) + reach, brickHits);
+	std::sort(brickHits.begin(), brickHits.end());
+	if (!brickHits.empty()) {
+		// the earliest brick of each shape bucket, the lowest index on a tie
+		ShapeBuckets& buckets = brickBuckets;
+		for (int s = 0; s < BRICK_SHAPES; s++) buckets.ids[s].clear();
+		for (size_t h = 0; h < brickHits.size(); h++) buckets.ids[sphere.shape[brickHits[h]]].push_back(brickHits[h]);
+
+		bool found = false;
+		float brickFirst = 2.0f;
+		int brickIndex = -1, brickAxis = 0;
+		for (int s = 0; s < BRICK_SHAPES; s++) {
+			const std::vector<int>& ids = buckets.ids[s];
+			if (ids.empty()) continue;
+			float bt;
+			int bi, ba;
+			if (bucketSweep(s, sphere.x.data(), sphere.z.data(), ids.data(), (int)ids.size(), p.x, p.z, dx, dz, radius, bt, bi, ba) &&
+				(!found || bt < brickFirst || (bt == brickFirst && bi < brickIndex))) {
+				brickFirst = bt; brickIndex = bi; brickAxis = ba;
+				found = true;
+			}
+		}
+		if (found && brickFirst < first) {
+			first = brickFirst; kind = CONTACT_BRICK; index = brickIndex; axis = brickAxis;
+		}
+	}
+
+	Vec3 c = controlball.getCenter();
+	if (sweepSphere(p.x, p.z, dx, dz, c.x, c.z, controlball.getRadius() + radius, t) && t < first) {
+		first = t; kind = CONTACT_CONTROL; index = -1;
+	}
+	return kind;
+}
+
+void sim::World::resolveContact(Sphere& ball, int kind, int index, int axis, float x, float z, float dx, float dz)
+{
+	const float y = ball.getCenter().y;
+	const float radius = ball.getRadius();
+
+	if (kind == CONTACT_WALL) {
+		// same correction as Wall::hitBy: leave the ball COR_VAL outside of the face
+		Vec3 w = legowall[index].getCenter();
+		if (axis == 0) {
+			float half = legowall[index].getWidth() / 2 + radius + COR_VAL;
+			x = (dx > 0) ? w.x - half : w.x + half;
+			ball.setPower(-ball.getVelocity_X(), ball.getVelocity_Z());
+		}
+		else {
+			float half = legowall[index].getDepth() / 2 + radius + COR_VAL;
+			z = (dz > 0) ? w.z - half : w.z + half;
+			ball.setPower(ball.getVelocity_X(), -ball.getVelocity_Z());
+		}
+		ball.setCenter(x, y, z);
+		eventPost(EVENT_WALL_BOUNCE, ticks, index, x, z);
+	}
+	else if (kind == CONTACT_BRICK) {
+		ball.setCenter(x, y, z);
+		strikeBrick(index, ball, axis);
+	}
+	else if (kind == CONTACT_CONTROL) {
+		ball.setCenter(x, y, z);
+		eventPost(EVENT_COLLISION, ticks, -1, x, z);
+		controlball.bounce(ball);
+	}
+}
+
+void sim::World::buildWallTree(void)
+{
+	std::vector<float> minX(wallCount), minZ(wallCount), maxX(wallCount), maxZ(wallCount);
+	for (int j = 0; j < wallCount; j++) {
+		Vec3 c = legowall[j].getCenter();
+		minX[j] = c.x - legowall[j].getWidth() / 2;
+		maxX[j] = c.x + legowall[j].getWidth() / 2;
+		minZ[j] = c.z - legowall[j].getDepth() / 2;
+		maxZ[j] = c.z + legowall[j].getDepth() / 2;
+	}
+	wallTree.build(minX.data(), minZ.data(), maxX.data(), maxZ.data(), wallCount);
+}
+
+int sim::World::hitWalls(Sphere& ball, int passes, bool post, std::vector<int>& ids)
+{
+	// the walls the tree skips do not overlap the ball, so their hitBy would do nothing.
+	// after a hit the ball moved and the rest of the pass looks around the new position.
+	const float reach = ball.getRadius() + WALL_TREE_MARGIN;
+	int last = -1;
+	for (int pass = 0; pass < passes; pass++) {
+		bool hit = false;
+		Vec3 c = ball.getCenter();
+		ids.clear();
+		wallTree.query(c.x - reach, c.z - reach, c.x + reach, c.z + reach, ids);
+		for (int h = 0; h < (int)ids.size(); h++) {
+			int j = ids[h];
+			if (!legowall[j].hitBy(ball)) continue;
+			c = ball.getCenter();
+			if (post) eventPost(EVENT_WALL_BOUNCE, ticks, j, c.x, c.z);
+			last = j;
+			hit = true;
+
+			ids.clear();
+			wallTree.query(c.x - reach, c.z - reach, c.x + reach, c.z + reach, ids);
+			h = (int)(std::upper_bound(ids.begin(), ids.end(), j) - ids.begin()) - 1;
+		}
+		if (!hit) break;
+	}
+	return last;
+}
+
+void sim::World::launch(void)
+{
+	if (!game_start) {
+		game_start = true;
+		moveball.setPower(-launchSpeed, 0.0);
+	}
+}
+
+void sim::World::spawnBalls(int count)
+{
+	// spread over 120 degrees around -x, at the launch speed
+	const float spread = 2.0943951f;
+	Vec3 p = moveball.getCenter();
+	for (int n = 0; n < count; n++) {
+		float angle = spread * ((n + 0.5f) / count - 0.5f);
+		Sphere ball;
+		ball.setCenter(p.x, p.y, p.z);
+#if defined(SIM_DETERMINISTIC)
+		ball.setPower(-launchSpeed * detCos(angle), launchSpeed * detSin(angle));
+#else
+		ball.setPower(-launchSpeed * cosf(angle), launchSpeed * sinf(angle));
+#endif
+		balls.push_back(ball);
+	}
+}
+
+void sim::World::ballTask(void* context, int part, int begin, int end)
+{
+	World& world = *(World*)context;
+	ShapeBuckets& buckets = world.ballBuckets[part];
+
+	// only this ball is written: walls, bricks and the grid are read only here
+	for (int k = begin; k < end; k++) {
+		Sphere& ball = world.balls[k];
+		BallContacts& contacts = world.ballContacts[k];
+
+		ball.ballUpdate(world.ballTimeDelta);
+
+		contacts.wall = world.hitWalls(ball, 1, false, world.ballWalls[part]);
+
+		world.touchedBricks(ball, contacts.bricks, buckets);
+	}
+}
+
+void sim::World::stepBalls(float timeDelta)
+{
+	int count = (int)balls.size();
+	int parts = workers != NULL ? workers->getThreadCount() : 1;
+	if ((int)ballContacts.size() < count) ballContacts.resize(count);
+	if ((int)ballBuckets.size() < parts) ballBuckets.resize(parts);
+	if ((int)ballWalls.size() < parts) ballWalls.resize(parts);
+
+	// update, walls and brick queries of every ball, in parallel
+	ballTimeDelta = timeDelta;
+	if (workers != NULL) workers->run(count, ballTask, this);
+	else ballTask(this, 0, 0, count);
+
+	// hits are resolved in ball order, so a brick goes to the lowest ball index that
+	// touches it. the balls did not move since their queries.
+	int kept = 0;
+	float outOfField = legoPlane.getCenter().x + legoPlane.getWidth() / 2 + 3.5f;
+	for (int k = 0; k < count; k++) {
+		Sphere& ball = balls[k];
+		const BallContacts& contacts = ballContacts[k];
+		Vec3 c = ball.getCenter();
+
+		if (contacts.wall >= 0) eventPost(EVENT_WALL_BOUNCE, ticks, contacts.wall, c.x, c.z);
+		for (size_t h = 0; h < contacts.bricks.size(); h++) {
+			int i = contacts.bricks[h];
+			if (liveBricks.contains(i)) strikeBrick(i, ball, -1);
+		}
+		if (controlball.hitBy(ball)) eventPost(EVENT_COLLISION, ticks, -1, c.x, c.z);
+
+		// balls out of field are dropped, the others keep their order
+		if (c.x < outOfField) {
+			if (kept != k) balls[kept] = ball;
+			kept++;
+		}
+	}
+	balls.resize(kept);
+}
+
+void sim::World::moveControl(float dz)
+{
+	// levels without these walls clamp to the plane
+	float boundary_max_z, boundary_min_z;
+	if (wallCount >= 2) {
+		boundary_max_z = legowall[0].getCenter().z - legowall[0].getDepth() / 2 - controlball.getRadius();
+		boundary_min_z = legowall[1].getCenter().z + legowall[1].getDepth() / 2 + controlball.getRadius();
+	}
+	else {
+		boundary_max_z = legoPlane.getCenter().z + legoPlane.getDepth() / 2 - controlball.getRadius();
+		boundary_min_z = legoPlane.getCenter().z - legoPlane.getDepth() / 2 + controlball.getRadius();
+	}
+
+	Vec3 coord3d = controlball.getCenter();
+	float new_z = coord3d.z + dz;
+
+	if (new_z > boundary_max_z) {
+		new_z = boundary_max_z;
+	}
+
+	if (new_z < boundary_min_z) {
+		new_z = boundary_min_z;
+	}
+
+	controlball.setCenter(coord3d.x, coord3d.y, new_z);
+}
+
+// -----------------------------------------------------------------------------
+// FixedStep
+// -----------------------------------------------------------------------------
+
+sim::FixedStep::FixedStep(float stepTime, int maxSteps)
+{
+	m_stepTime = stepTime;
+	m_maxSteps = maxSteps;
+	m_accumulator = 0.0f;
+	m_dropped = 0;
+}
+
+int sim::FixedStep::advance(float timeDelta)
+{
+	m_accumulator += timeDelta;
+
+	int steps = (int)(m_accumulator / m_stepTime);
+	if (steps > m_maxSteps) {
+		m_dropped += steps - m_maxSteps;
+		m_accumulator -= (float)(steps - m_maxSteps) * m_stepTime;
+		steps = m_maxSteps;
+	}
+	m_accumulator -= (float)steps * m_stepTime;
+	if (m_accumulator < 0.0f) m_accumulator = 0.0f;
+	return steps;
+}
+
+float sim::FixedStep::getAlpha(void) const
+{
+	float alpha = m_accumulator / m_stepTime;
+	return alpha < 1.0f ? alpha : 0.999999f;
+}
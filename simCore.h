@@ -0,0 +1,381 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simCore.h
+//
+// Desc: Direct3D-free simulation core of the game. Holds the ball/brick/wall physics that
+//       used to live inside CSphere and CWall so it can be stepped without a device
+//       (see simRunner.cpp for the headless batch runner).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simCoreH__
+#define __simCoreH__
+
+#include "simGrid.h"
+#include "simLevel.h"
+#include "simMath.h"
+#include "simWallTree.h"
+#include <vector>
+
+#define COR_VAL 0.01f
+
+#define M_RADIUS 0.21   // ball radius
+#define TIME_SCALE 3.3f  // velocity to distance per timeDelta
+#define M_HEIGHT 0.01
+#define DECREASE_RATE 0.9982
+
+// most wall passes of the moving ball per step (World::hitWalls, BatchWorld)
+#define WALL_PASSES(walls) ((walls) + 1)
+
+namespace sim
+{
+	class WorkerPool;
+
+	//
+	// Math Objects
+	//
+
+	struct Vec3
+	{
+		Vec3() : x(0.0f), y(0.0f), z(0.0f) {}
+		Vec3(float ix, float iy, float iz) : x(ix), y(iy), z(iz) {}
+
+		float x, y, z;
+	};
+
+	inline Vec3 lerp(const Vec3& a, const Vec3& b, float t)
+	{
+		return Vec3(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+	}
+
+	//
+	// Sphere: bricks, the control ball (paddle) and the moving ball
+	//
+
+	class Sphere
+	{
+	public:
+		Sphere(void);
+
+		bool hasIntersected(Sphere& ball);
+		bool hitBy(Sphere& ball);        // true when ball was hit (and bounced)
+		void bounce(Sphere& ball);       // hit response of hitBy, without the intersection test
+		void ballUpdate(float timeDiff);
+		bool isResting(void) const;      // below the speed ballUpdate moves at
+
+		double getVelocity_X() const { return m_velocity_x; }
+		double getVelocity_Z() const { return m_velocity_z; }
+		void setPower(double vx, double vz);
+
+		void setCenter(float x, float y, float z);
+		Vec3 getCenter(void) const { return Vec3(center_x, center_y, center_z); }
+		float getRadius(void) const { return m_radius; }
+
+		void setControlBall(bool l_isControlball) { isControlball = l_isControlball; }
+		bool isControlBall(void) const { return isControlball; }
+
+	private:
+		float center_x, center_y, center_z;
+		float m_radius;
+		float m_velocity_x;
+		float m_velocity_z;
+		bool  isControlball;
+	};
+
+	// the response of Sphere::bounce: ball keeps its speed and takes the direction from
+	// (cx, cz) to its center
+	void deflect(Sphere& ball, float cx, float cz);
+
+	//
+	// Wall: axis aligned box on the xz plane (the play field and its borders)
+	//
+
+	class Wall
+	{
+	public:
+		Wall(void);
+
+		void setSize(float iwidth, float iheight, float idepth);
+		void setPosition(float x, float y, float z);
+
+		bool hasIntersected(Sphere& ball);
+		bool hitBy(Sphere& ball);        // true when ball was hit (and pushed out)
+
+		Vec3 getCenter(void) const { return Vec3(m_x, m_y, m_z); }
+		float getHeight(void) const { return m_height; }
+		float getDepth(void) const { return m_depth; }
+		float getWidth(void) const { return m_width; }
+
+	private:
+		float m_x, m_y, m_z;
+		float m_width;
+		float m_depth;
+		float m_height;
+	};
+
+	//
+	// LiveSet: dense list of ids (live bricks, awake bricks). removal swaps the last id
+	// into the freed slot, so iteration only ever touches ids in the set.
+	//
+
+	class LiveSet
+	{
+	public:
+		void fill(int count);            // ids 0 .. count-1, in order
+		void clear(int count);           // no ids, room for ids 0 .. count-1
+		void insert(int id);             // no-op when id is already in the set
+		void remove(int id);             // no-op when id is not in the set
+		bool contains(int id) const { return m_slot[id] >= 0; }
+
+		int size(void) const { return (int)m_ids.size(); }
+		int operator[](int n) const { return m_ids[n]; }
+
+		// flat copies for snapshots: the size() ids, and the slot of every id (-1 when not in
+		// the set). assign takes them back; slots must cover the same ids as now.
+		const int* getIds(void) const { return m_ids.data(); }
+		const int* getSlots(void) const { return m_slot.data(); }
+		int getCapacity(void) const { return (int)m_slot.size(); }
+		void assign(const int* ids, int count, const int* slots);
+
+	private:
+		std::vector<int> m_ids;
+		std::vector<int> m_slot;         // per id: index in m_ids, -1 when removed
+	};
+
+	//
+	// BrickStore: the bricks as structure of arrays. the physics passes (integrate, the
+	// collision tests, snapshots, reset) stream only the hot arrays; the level data a brick
+	// is drawn with sits in the cold table next to them. sphere[i] is a BrickRef, a view
+	// with the calls of Sphere, so code written against brick objects keeps working.
+	//
+	// the size of a brick follows from its shape (simShapes.h), so no radius array is kept.
+	// whether a brick is alive is the slot table of World::liveBricks.
+	//
+
+	struct BrickCold
+	{
+		unsigned int color;              // ARGB, from the level
+		BrickAttr    attr;
+	};
+
+	class BrickRef;
+
+	class BrickStore
+	{
+	public:
+		void assign(int count);          // count one hit spheres at the origin, at rest
+		void copyHot(const BrickStore& from);    // the changing arrays of a store of the same size
+
+		int size(void) const { return (int)x.size(); }
+		BrickRef operator[](int i);
+		Sphere operator[](int i) const { return get(i); }
+		Sphere get(int i) const;         // a copy of brick i as an object
+		void set(int i, const Sphere& s);
+
+		// hot
+		std::vector<float> x, y, z;      // center
+		std::vector<float> vx, vz;       // velocity
+		std::vector<unsigned char> shape;            // BRICK_*, fixed by the level
+		std::vector<int> hits;           // hits left before the brick is destroyed
+		// cold
+		std::vector<BrickCold> cold;
+	};
+
+	class BrickRef
+	{
+	public:
+		BrickRef(BrickStore& store, int id) : m_store(&store), m_id(id) {}
+
+		Vec3 getCenter(void) const { return Vec3(m_store->x[m_id], m_store->y[m_id], m_store->z[m_id]); }
+		void setCenter(float x, float y, float z) { m_store->x[m_id] = x; m_store->y[m_id] = y; m_store->z[m_id] = z; }
+		float getRadius(void) const { return (float)(M_RADIUS); }
+
+		double getVelocity_X() const { return m_store->vx[m_id]; }
+		double getVelocity_Z() const { return m_store->vz[m_id]; }
+		void setPower(double vx, double vz) { m_store->vx[m_id] = (float)vx; m_store->vz[m_id] = (float)vz; }
+
+		// the Sphere calls on a copy of the brick, written back when they change it
+		bool isResting(void) const { return m_store->get(m_id).isResting(); }
+		bool hasIntersected(Sphere& ball) const { return m_store->get(m_id).hasIntersected(ball); }
+		bool hitBy(Sphere& ball);
+		void bounce(Sphere& ball);
+
+		operator Sphere() const { return m_store->get(m_id); }
+
+	private:
+		BrickStore* m_store;
+		int         m_id;
+	};
+
+	inline BrickRef BrickStore::operator[](int i) { return BrickRef(*this, i); }
+
+	// ballUpdate for the awake spheres only. spheres that come to rest fall asleep (leave
+	// the set); a grid, when given, follows the spheres that moved.
+	void integrate(Sphere* spheres, LiveSet& awake, float timeDelta, BrickGrid* grid);
+	void integrate(BrickStore& bricks, LiveSet& awake, float timeDelta, BrickGrid* grid);
+
+	// a brick was hit: its id, center and color, and whether the hit destroyed it
+	typedef void (*BrickHitFunc)(void* context, int brick, float x, float z, unsigned int color, bool destroyed);
+
+	//
+	// World: everything Setup() places and Display() steps
+	//
+
+	class World
+	{
+	public:
+		World(void);
+
+		void setup(void);                // the built-in level (Level::makeDefault)
+		void setup(const Level& level);  // layout of plane, walls, bricks and balls
+		// with spareBricks ids after the bricks of the level, out of play until placeBrick.
+		// the grid then only covers the open edge of the plane until setGridWindow.
+		void setup(const Level& level, int spareBricks);
+		void step(float timeDelta);      // one frame of update and collision
+		void resetLevel(void);           // ball out of field: restart the game
+
+		void launch(void);               // VK_SPACE
+		void spawnBalls(int count);      // multi-ball: count balls at moveball, fanned out towards -x
+		void moveControl(float dz);      // move the control ball along z, clamped by walls 0 and 1
+
+		// bricks at rest are not integrated. giving a brick speed has to go through here
+		// (or wakeBrick after sphere[i].setPower) so it is integrated again.
+		void setBrickPower(int i, double vx, double vz);
+		void wakeBrick(int i);
+
+		// bricks coming and going while the game runs (simStream.h). placeBrick puts brick i,
+		// which is not in play, into play at rest; removeBrick takes it out without a
+		// destroyed event. setGridWindow moves the grid to the part [minX, maxX] of the plane
+		// and builds it again over the bricks in play, also the grid resetLevel restores.
+		void placeBrick(int i, float x, float z, unsigned int color, const BrickAttr& attr);
+		void removeBrick(int i);
+		void setGridWindow(float minX, float maxX);
+
+		// building blocks of the sweeping modes (continuous, ImpactSim). firstContact finds
+		// the earliest thing ball touches when it moves by (dx, dz): a CONTACT_* kind, with
+		// t in [0, 1] the fraction of the move, the wall or brick index (-1 for the control
+		// ball) and the face axis of a wall. resolveContact puts the ball at the contact
+		// point (x, z) and applies the bounce, the brick destruction and the events.
+		enum { CONTACT_NONE, CONTACT_WALL, CONTACT_BRICK, CONTACT_CONTROL };
+		int firstContact(const Sphere& ball, float dx, float dz, float& t, int& index, int& axis);
+		void resolveContact(Sphere& ball, int kind, int index, int axis, float x, float z, float dx, float dz);
+
+		int    brickCount;
+		int    wallCount;
+		Wall   legoPlane;
+		std::vector<Wall>   legowall;    // static: wallTree is built from them by setup()
+		WallTree            wallTree;
+		BrickStore          sphere;      // the bricks, sphere[i] reads like a Sphere
+		Sphere controlball;
+		Sphere moveball;
+
+		bool  game_start;
+		int   restarts;                  // number of resetLevel() calls
+		unsigned int ticks;              // number of step() calls, stamps the events
+
+		// continuous collision: the moving ball is swept along its path every step and
+		// bounces on walls, bricks and the control ball in time order, so it can not skip
+		// through them at high speed or with a long timeDelta.
+		bool  continuous;
+		float launchSpeed;               // speed given to moveball by launch()
+
+		// bricks still on the field, the moving ones among them, and the broadphase
+		LiveSet   liveBricks;
+		LiveSet   awakeBricks;
+		BrickGrid brickGrid;
+
+		// multi-ball: balls next to moveball, which is ball 0; balls[k] is ball k + 1. they
+		// use the discrete tests and leave the game at the out of field line. their wall and
+		// brick tests run on the workers when set. a brick hit by several balls in one step
+		// goes to the lowest ball index, whatever the number of threads.
+		std::vector<Sphere> balls;
+		WorkerPool*         workers;     // not owned, NULL runs single threaded
+
+		// called for every brick hit, on the thread that steps the world, in the order the
+		// hits are resolved (effects, see ParticlePool::brickHit). NULL for none.
+		BrickHitFunc onBrickHit;
+		void*        onBrickHitContext;
+
+	private:
+		void buildGrid(void);
+		void buildWallTree(void);
+
+		// Wall::hitBy of every wall against ball, in index order, repeated until a pass hits
+		// nothing or for at most passes passes. only the walls the tree finds around the ball
+		// are tested, ids is the scratch of the queries. post: a wall bounce event per hit.
+		// returns the last wall hit, -1 for none.
+		int hitWalls(Sphere& ball, int passes, bool post, std::vector<int>& ids);
+		void destroyBrick(int i, const Sphere& ball);    // ball: the one that hit it
+
+		// brick narrowphase: the grid candidates of a query, bucketed by shape
+		struct ShapeBuckets
+		{
+			std::vector<int> candidates;
+			std::vector<int> ids[BRICK_SHAPES];
+			std::vector<unsigned int> mask;      // scratch of the grid
+		};
+
+		// the live bricks ball overlaps, ascending, into hits. read only, safe to call from
+		// several threads at once with their own buckets.
+		void touchedBricks(const Sphere& ball, std::vector<int>& hits, ShapeBuckets& buckets) const;
+		// brick i was hit by ball: the collision event, the bounce of its shape (axis as for
+		// shapeBounce) and one hit off the brick. false when it only grazed a brick with hits
+		// left that ball already moves away from, so slow balls do not hit it twice.
+		bool strikeBrick(int i, Sphere& ball, int axis);
+
+		float gridMinX, gridMaxX;        // the part of the plane the grid covers
+		int   brickShapes;               // bit s set when the level has bricks of shape s
+		float brickBound;                // shapeBound(brickShapes)
+
+		// per ball result of the parallel part of stepBalls
+		struct BallContacts
+		{
+			std::vector<int> bricks;     // intersected bricks, ascending
+			int wall;                    // last wall bounced off, -1 for none
+		};
+
+		void stepBalls(float timeDelta);
+		static void ballTask(void* context, int part, int begin, int end);
+
+		std::vector<BallContacts> ballContacts;
+		std::vector<ShapeBuckets> ballBuckets;                // per worker scratch of the bricks
+		std::vector<std::vector<int> > ballWalls;             // per worker scratch of the wall tree
+		float ballTimeDelta;
+
+		// state of the bricks right after setup(), restored by resetLevel()
+		BrickStore initialSphere;
+		LiveSet   initialLiveBricks;
+		LiveSet   initialAwakeBricks;
+		BrickGrid initialGrid;
+		void sweepMoveball(float timeDelta);
+
+		std::vector<int> brickHits;
+		std::vector<int> wallHits;
+		ShapeBuckets     brickBuckets;
+	};
+
+	//
+	// FixedStep: accumulator that turns variable frame times into fixed simulation steps
+	//
+
+	class FixedStep
+	{
+	public:
+		// stepTime is in timeDelta units. at most maxSteps are run per frame, time beyond
+		// that is dropped so a slow frame can not snowball into ever longer ones.
+		FixedStep(float stepTime, int maxSteps);
+
+		int advance(float timeDelta);    // adds a frame time, returns the steps to run now
+		float getAlpha(void) const;      // left over time as a fraction of a step, in [0, 1)
+		float getStepTime(void) const { return m_stepTime; }
+		int getDropped(void) const { return m_dropped; }
+
+	private:
+		float m_stepTime;
+		int   m_maxSteps;
+		float m_accumulator;
+		int   m_dropped;                 // steps skipped because of maxSteps
+	};
+}
+
+#endif // __simCoreH__
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simEvent.cpp
+//
+// Desc: Structured event log of the simulation.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simEvent.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+// events the simulation can post ahead of the drain thread
+#define EVENT_RING_CAPACITY (1 << 16)
+// the drain thread sleeps this long when the ring is empty
+#define EVENT_DRAIN_SLEEP_MS 1
+
+static const char* g_eventNames[sim::EVENT_TYPE_COUNT] = {
+	"collision",
+	"brick_destroyed",
+	"wall_bounce",
+	"reset",
+};
+
+const char* sim::eventName(int type)
+{
+	return (type >= 0 && type < EVENT_TYPE_COUNT) ? g_eventNames[type] : "unknown";
+}
+
+// -----------------------------------------------------------------------------
+// EventRing
+// -----------------------------------------------------------------------------
+
+sim::EventRing::EventRing(int capacity)
+{
+	unsigned int size = 1;
+	while ((int)size < capacity) size <<= 1;
+	m_events.resize(size);
+	m_mask = size - 1;
+	m_head.store(0, std::memory_order_relaxed);
+	m_tail.store(0, std::memory_order_relaxed);
+}
+
+bool sim::EventRing::push(const Event& e)
+{
+	// head/tail count up forever, their difference is the fill level
+	unsigned int head = m_head.load(std::memory_order_relaxed);
+	if (head - m_tail.load(std::memory_order_acquire) > m_mask) return false;
+
+	m_events[head & m_mask] = e;
+	m_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool sim::EventRing::pop(Event& e)
+{
+	unsigned int tail = m_tail.load(std::memory_order_relaxed);
+	if (tail == m_head.load(std::memory_order_acquire)) return false;
+
+	e = m_events[tail & m_mask];
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Event log
+// -----------------------------------------------------------------------------
+
+static sim::EventRing            g_ring(EVENT_RING_CAPACITY);
+static std::atomic<bool>         g_running(false);
+static std::atomic<unsigned int> g_filter(EVENT_MASK_ALL);
+static std::atomic<long long>    g_dropped(0);
+static std::thread               g_drainThread;
+static FILE*                     g_sink = NULL;
+static sim::EventFormat          g_format = sim::EVENT_TEXT;
+
+static void writeEvent(const sim::Event& e)
+{
+	if (g_format == sim::EVENT_BINARY) {
+		fwrite(&e, sizeof(e), 1, g_sink);
+	}
+	else {
+		fprintf(g_sink, "%u %s %d %f %f\n", e.tick, sim::eventName(e.type), e.index, e.x, e.z);
+	}
+}
+
+static void drain(void)
+{
+	sim::Event e;
+	for (;;) {
+		// read the flag first: once it is seen cleared, the producer has posted its last event
+		bool running = g_running.load(std::memory_order_acquire);
+		bool any = false;
+		while (g_ring.pop(e)) {
+			writeEvent(e);
+			any = true;
+		}
+		if (!running) break;
+		if (!any) std::this_thread::sleep_for(std::chrono::milliseconds(EVENT_DRAIN_SLEEP_MS));
+	}
+}
+
+bool sim::eventStart(const char* path, EventFormat format)
+{
+	if (g_running.load()) eventStop();
+
+	g_sink = fopen(path, format == EVENT_BINARY ? "wb" : "w");
+	if (g_sink == NULL) return false;
+	g_format = format;
+	if (format == EVENT_BINARY) fwrite("SIMEVT1", 8, 1, g_sink);
+
+	// anything left from an earlier run was already drained by eventStop
+	g_dropped.store(0);
+	g_running.store(true, std::memory_order_release);
+	g_drainThread = std::thread(drain);
+	return true;
+}
+
+void sim::eventStop(void)
+{
+	if (!g_running.load()) return;
+
+	g_running.store(false, std::memory_order_release);
+	g_drainThread.join();
+	fclose(g_sink);
+	g_sink = NULL;
+}
+
+bool sim::eventRunning(void)
+{
+	return g_running.load(std::memory_order_relaxed);
+}
+
+void sim::eventSetFilter(unsigned int mask)
+{
+	g_filter.store(mask, std::memory_order_relaxed);
+}
+
+unsigned int sim::eventGetFilter(void)
+{
+	return g_filter.load(std::memory_order_relaxed);
+}
+
+long long sim::eventDropped(void)
+{
+	return g_dropped.load(std::memory_order_relaxed);
+}
+
+void sim::eventPost(int type, unsigned int tick, int index, float x, float z)
+{
+	if (!g_running.load(std::memory_order_relaxed)) return;
+	if (!(g_filter.load(std::memory_order_relaxed) & EVENT_BIT(type))) return;
+
+	Event e;
+	e.tick = tick;
+	e.type = type;
+	e.index = index;
+	e.x = x;
+	e.z = z;
+	if (!g_ring.push(e)) g_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+sim::EventFormat sim::eventFormatOf(const char* path)
+{
+	size_t len = strlen(path);
+	if (len >= 4 && strcmp(path + len - 4, ".bin") == 0) return EVENT_BINARY;
+	return EVENT_TEXT;
+}
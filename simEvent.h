@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simEvent.h
+//
+// Desc: Structured event log of the simulation (collisions, destroyed bricks, wall bounces,
+//       resets). The simulation thread only writes fixed size records into a preallocated
+//       single-producer/single-consumer ring; a background thread drains the ring to a
+//       text or binary file. Posting never blocks, allocates or does I/O: when the ring is
+//       full the event is dropped and counted.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simEventH__
+#define __simEventH__
+
+#include <atomic>
+#include <vector>
+
+namespace sim
+{
+	enum EventType
+	{
+		EVENT_COLLISION,                 // moving ball hit a brick or the control ball
+		EVENT_BRICK_DESTROYED,           // brick left the field
+		EVENT_WALL_BOUNCE,               // a ball bounced off a wall
+		EVENT_RESET,                     // level restarted
+		EVENT_TYPE_COUNT
+	};
+
+	#define EVENT_BIT(type) (1u << (type))
+	#define EVENT_MASK_ALL ((1u << sim::EVENT_TYPE_COUNT) - 1)
+
+	const char* eventName(int type);
+
+	// one record, also the record layout of the binary sink
+	struct Event
+	{
+		unsigned int tick;               // World::ticks when the event happened
+		int   type;                      // EventType
+		int   index;                     // brick / wall index, -1 for the control ball or none
+		float x, z;                      // position of the ball
+	};
+
+	//
+	// EventRing: wait-free single-producer/single-consumer ring of events. capacity is
+	// rounded up to a power of two. push() is only called by the producer thread, pop()
+	// only by the consumer thread.
+	//
+
+	class EventRing
+	{
+	public:
+		explicit EventRing(int capacity);
+
+		bool push(const Event& e);       // false when full
+		bool pop(Event& e);              // false when empty
+
+		int getCapacity(void) const { return (int)m_mask + 1; }
+
+	private:
+		EventRing(const EventRing&);
+		EventRing& operator=(const EventRing&);
+
+		std::vector<Event> m_events;
+		unsigned int       m_mask;
+
+		// head and tail on their own cache lines so producer and consumer do not share one
+		alignas(64) std::atomic<unsigned int> m_head;    // next slot to write (producer)
+		alignas(64) std::atomic<unsigned int> m_tail;    // next slot to read (consumer)
+	};
+
+	//
+	// Event log: one process wide log, fed by the simulation thread
+	//
+
+	enum EventFormat { EVENT_TEXT, EVENT_BINARY };
+
+	// opens the sink and starts the drain thread. binary files start with the 8 byte
+	// magic "SIMEVT1\0" followed by raw Event records. start and stop from the thread
+	// that posts, so no event is in flight meanwhile.
+	bool eventStart(const char* path, EventFormat format);
+	void eventStop(void);                        // drains what is left and closes the sink
+	bool eventRunning(void);
+
+	void eventSetFilter(unsigned int mask);      // EVENT_BIT of the types to keep
+	unsigned int eventGetFilter(void);
+	long long eventDropped(void);                // events lost to a full ring
+
+	// simulation thread only. a no-op when the log is stopped or the type filtered out.
+	void eventPost(int type, unsigned int tick, int index, float x, float z);
+
+	// *.bin selects the binary format, anything else text
+	EventFormat eventFormatOf(const char* path);
+}
+
+#endif // __simEventH__
@@ -0,0 +1,149 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simGrid.cpp
+//
+// Desc: Uniform grid broadphase over the play field.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simGrid.h"
+#include "simKernel.h"
+#include <cmath>
+
+sim::BrickGrid::BrickGrid(void)
+{
+	m_minX = m_minZ = 0.0f;
+	m_cellSize = 1.0f;
+	m_columns = m_rows = 0;
+}
+
+void sim::BrickGrid::reset(float minX, float minZ, float maxX, float maxZ, float cellSize, int idCount)
+{
+	m_minX = minX;
+	m_minZ = minZ;
+	m_cellSize = cellSize;
+	m_columns = (int)ceil((maxX - minX) / cellSize);
+	m_rows = (int)ceil((maxZ - minZ) / cellSize);
+	if (m_columns < 1) m_columns = 1;
+	if (m_rows < 1) m_rows = 1;
+
+	// keep the cell storage around so a level reset does not reallocate
+	m_cells.resize(m_columns * m_rows);
+	for (size_t c = 0; c < m_cells.size(); c++) {
+		m_cells[c].xs.clear();
+		m_cells[c].zs.clear();
+		m_cells[c].ids.clear();
+	}
+	m_cellOf.assign(idCount, -1);
+	m_slotOf.assign(idCount, -1);
+}
+
+int sim::BrickGrid::column(float x) const
+{
+	int c = (int)floor((x - m_minX) / m_cellSize);
+	if (c < 0) return 0;
+	if (c >= m_columns) return m_columns - 1;
+	return c;
+}
+
+int sim::BrickGrid::row(float z) const
+{
+	int r = (int)floor((z - m_minZ) / m_cellSize);
+	if (r < 0) return 0;
+	if (r >= m_rows) return m_rows - 1;
+	return r;
+}
+
+void sim::BrickGrid::insert(int id, float x, float z)
+{
+	if (m_cellOf[id] >= 0) remove(id);
+
+	int c = row(z) * m_columns + column(x);
+	Cell& cell = m_cells[c];
+	m_cellOf[id] = c;
+	m_slotOf[id] = (int)cell.ids.size();
+	cell.xs.push_back(x);
+	cell.zs.push_back(z);
+	cell.ids.push_back(id);
+}
+
+void sim::BrickGrid::remove(int id)
+{
+	int c = m_cellOf[id];
+	if (c < 0) return;
+
+	// swap the last brick of the cell into the freed slot
+	Cell& cell = m_cells[c];
+	int slot = m_slotOf[id];
+	int last = (int)cell.ids.size() - 1;
+	if (slot != last) {
+		cell.xs[slot] = cell.xs[last];
+		cell.zs[slot] = cell.zs[last];
+		cell.ids[slot] = cell.ids[last];
+		m_slotOf[cell.ids[slot]] = slot;
+	}
+	cell.xs.pop_back();
+	cell.zs.pop_back();
+	cell.ids.pop_back();
+
+	m_cellOf[id] = -1;
+	m_slotOf[id] = -1;
+}
+
+void sim::BrickGrid::move(int id, float x, float z)
+{
+	int c = row(z) * m_columns + column(x);
+	if (c == m_cellOf[id]) {
+		m_cells[c].xs[m_slotOf[id]] = x;
+		m_cells[c].zs[m_slotOf[id]] = z;
+		return;
+	}
+	insert(id, x, z);
+}
+
+int sim::BrickGrid::query(float bx, float bz, float radiusSum, std::vector<int>& hits)
+{
+	return query(bx, bz, radiusSum, hits, m_mask);
+}
+
+int sim::BrickGrid::query(float bx, float bz, float radiusSum, std::vector<int>& hits, std::vector<unsigned int>& mask) const
+{
+	int found = 0;
+	int c0 = column(bx - radiusSum), c1 = column(bx + radiusSum);
+	int r0 = row(bz - radiusSum), r1 = row(bz + radiusSum);
+
+	for (int r = r0; r <= r1; r++) {
+		for (int c = c0; c <= c1; c++) {
+			const Cell& cell = m_cells[r * m_columns + c];
+			int count = (int)cell.ids.size();
+			if (count == 0) continue;
+
+			if ((int)mask.size() < HIT_MASK_WORDS(count)) mask.resize(HIT_MASK_WORDS(count));
+			if (sphereHitMask(&cell.xs[0], &cell.zs[0], count, bx, bz, radiusSum, &mask[0]) == 0) continue;
+
+			for (int i = 0; i < count; i++) {
+				if (mask[i >> 5] & (1u << (i & 31))) {
+					hits.push_back(cell.ids[i]);
+					found++;
+				}
+			}
+		}
+	}
+	return found;
+}
+
+int sim::BrickGrid::queryBox(float minX, float minZ, float maxX, float maxZ, std::vector<int>& ids) const
+{
+	int found = 0;
+	int c0 = column(minX), c1 = column(maxX);
+	int r0 = row(minZ), r1 = row(maxZ);
+
+	for (int r = r0; r <= r1; r++) {
+		for (int c = c0; c <= c1; c++) {
+			const Cell& cell = m_cells[r * m_columns + c];
+			ids.insert(ids.end(), cell.ids.begin(), cell.ids.end());
+			found += (int)cell.ids.size();
+		}
+	}
+	return found;
+}
@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simGrid.h
+//
+// Desc: Uniform grid broadphase over the play field. Bricks are bucketed by center; a ball
+//       only tests the bricks of the few cells its radius touches.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simGridH__
+#define __simGridH__
+
+#include "simMath.h"
+#include <vector>
+
+namespace sim
+{
+	class BrickGrid
+	{
+	public:
+		BrickGrid(void);
+
+		// drops all bricks and sizes the grid to cover [minX, maxX] x [minZ, maxZ].
+		// bricks (and queries) outside of the bounds fall into the border cells.
+		void reset(float minX, float minZ, float maxX, float maxZ, float cellSize, int idCount);
+
+		void insert(int id, float x, float z);
+		void remove(int id);             // no-op when the brick is not in the grid
+		void move(int id, float x, float z);
+		bool contains(int id) const { return m_cellOf[id] >= 0; }
+
+		// appends the ids of the bricks closer than radiusSum to (bx, bz) to hits,
+		// in no particular order. returns the number of ids appended.
+		int query(float bx, float bz, float radiusSum, std::vector<int>& hits);
+		// the same with caller owned scratch, safe to call from several threads at once
+		int query(float bx, float bz, float radiusSum, std::vector<int>& hits, std::vector<unsigned int>& mask) const;
+
+		// appends the ids of all bricks whose cell overlaps the box, without any distance
+		// test. returns the number of ids appended.
+		int queryBox(float minX, float minZ, float maxX, float maxZ, std::vector<int>& ids) const;
+
+		int getCellCount(void) const { return (int)m_cells.size(); }
+
+	private:
+		// brick centers of one cell, kept as separate arrays for sphereHitMask
+		struct Cell
+		{
+			std::vector<float> xs;
+			std::vector<float> zs;
+			std::vector<int>   ids;
+		};
+
+		int column(float x) const;
+		int row(float z) const;
+
+		std::vector<Cell> m_cells;
+		std::vector<int>  m_cellOf;      // per brick id: cell index, -1 when not in the grid
+		std::vector<int>  m_slotOf;      // per brick id: index inside its cell
+		std::vector<unsigned int> m_mask;
+
+		float m_minX, m_minZ;
+		float m_cellSize;
+		int   m_columns, m_rows;
+	};
+}
+
+#endif // __simGridH__
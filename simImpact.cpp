@@ -0,0 +1,230 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simImpact.cpp
+//
+// Desc: Event driven mode of a World.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simImpact.h"
+#include "simEvent.h"
+#include <algorithm>
+#include <cmath>
+
+// impact kinds next to World::CONTACT_*
+enum
+{
+	IMPACT_HORIZON = sim::World::CONTACT_CONTROL + 1,   // end of the prediction, predict again
+	IMPACT_OUT,                                          // crosses the out of field line
+};
+
+sim::ImpactSim::ImpactSim(void)
+{
+	m_world = NULL;
+	m_now = 0.0;
+	m_stamp = 0;
+	m_impacts = 0;
+	m_predictions = 0;
+}
+
+void sim::ImpactSim::attach(World& world)
+{
+	m_world = &world;
+	m_now = 0.0;
+	m_impacts = 0;
+	m_predictions = 0;
+	sync();
+}
+
+void sim::ImpactSim::sync(void)
+{
+	// every stamp changes, so nothing queued is of use any more
+	m_queue.clear();
+	int count = ballCount();
+	m_x0.resize(count);
+	m_z0.resize(count);
+	m_t0.resize(count);
+	m_ballStamp.resize(count);
+	for (int b = 0; b < count; b++) predict(b);
+}
+
+void sim::ImpactSim::controlMoved(void)
+{
+	// the control ball only moves along z. a ball that is beside it in x and moving away
+	// (or parallel) can not touch it any more, wherever it is on z.
+	const Vec3 c = m_world->controlball.getCenter();
+	const float reach = m_world->controlball.getRadius() + (float)M_RADIUS;
+	for (int b = 0; b < ballCount(); b++) {
+		if (b == 0 && !m_world->game_start) continue;
+		Sphere& s = ball(b);
+		float x = s.getCenter().x;
+		float vx = (float)s.getVelocity_X();
+		if ((vx <= 0.0f && x < c.x - reach) || (vx >= 0.0f && x > c.x + reach)) continue;
+		predict(b);
+	}
+}
+
+void sim::ImpactSim::predict(int b)
+{
+	World& world = *m_world;
+	Sphere& s = ball(b);
+	const Vec3 p = s.getCenter();
+
+	m_ballStamp[b] = ++m_stamp;
+	m_x0[b] = p.x;
+	m_z0[b] = p.z;
+	m_t0[b] = m_now;
+
+	// not launched: moveball follows the control ball, see place
+	if (b == 0 && !world.game_start) return;
+
+	// the control ball may have been moved onto the ball. this is the discrete test the
+	// continuous mode runs after its sweep.
+	if (world.controlball.hitBy(s)) eventPost(EVENT_COLLISION, world.ticks, -1, p.x, p.z);
+
+	// same rest threshold as ballUpdate
+	if (s.isResting()) {
+		s.setPower(0, 0);
+		return;
+	}
+
+	// the time the ball takes for IMPACT_REACH, or to the out of field line when that is
+	// nearer. time is in timeDelta units, as ballUpdate moves TIME_SCALE * timeDelta * v.
+	const float vx = (float)s.getVelocity_X();
+	const float vz = (float)s.getVelocity_Z();
+	float span = IMPACT_REACH / (TIME_SCALE * sqrtf(vx * vx + vz * vz));
+	int end = IMPACT_HORIZON;
+	if (vx > 0.0f) {
+		float outOfField = world.legoPlane.getCenter().x + world.legoPlane.getWidth() / 2 + 3.5f;
+		float out = (outOfField - p.x) / (TIME_SCALE * vx);
+		if (out <= span) {
+			span = out > 0.0f ? out : 0.0f;
+			end = IMPACT_OUT;
+		}
+	}
+
+	Impact impact;
+	impact.ball = b;
+	impact.stamp = m_stamp;
+	impact.dx = TIME_SCALE * span * vx;
+	impact.dz = TIME_SCALE * span * vz;
+
+	float t;
+	impact.kind = world.firstContact(s, impact.dx, impact.dz, t, impact.index, impact.axis);
+	if (impact.kind == World::CONTACT_NONE) {
+		impact.kind = end;
+		t = 1.0f;
+	}
+	impact.time = m_now + (double)t * span;
+	impact.x = p.x + t * impact.dx;
+	impact.z = p.z + t * impact.dz;
+
+	m_queue.push_back(impact);
+	std::push_heap(m_queue.begin(), m_queue.end(), Later());
+	m_predictions++;
+}
+
+void sim::ImpactSim::fire(const Impact& impact)
+{
+	World& world = *m_world;
+	const int b = impact.ball;
+	Sphere& s = ball(b);
+
+	switch (impact.kind) {
+	case IMPACT_HORIZON:
+		s.setCenter(impact.x, s.getCenter().y, impact.z);
+		predict(b);
+		break;
+
+	case IMPACT_OUT:
+		s.setCenter(impact.x, s.getCenter().y, impact.z);
+		if (b == 0) {
+			world.resetLevel();
+			sync();
+		}
+		else {
+			dropBall(b);
+		}
+		break;
+
+	case World::CONTACT_BRICK:
+		// another ball took the brick since the prediction: the way is free up to here
+		if (!world.liveBricks.contains(impact.index)) {
+			place(b, impact.time);
+			predict(b);
+			break;
+		}
+		// fall through
+
+	default:
+		world.resolveContact(s, impact.kind, impact.index, impact.axis, impact.x, impact.z, impact.dx, impact.dz);
+		m_impacts++;
+		predict(b);
+		break;
+	}
+}
+
+void sim::ImpactSim::place(int b, double time)
+{
+	World& world = *m_world;
+	Sphere& s = ball(b);
+	if (b == 0 && !world.game_start) {
+		const Vec3 c = world.controlball.getCenter();
+		s.setCenter(c.x - 2 * world.controlball.getRadius(), c.y, c.z);
+		return;
+	}
+	float dt = (float)(time - m_t0[b]);
+	s.setCenter(m_x0[b] + TIME_SCALE * dt * (float)s.getVelocity_X(), s.getCenter().y,
+		m_z0[b] + TIME_SCALE * dt * (float)s.getVelocity_Z());
+}
+
+void sim::ImpactSim::dropBall(int b)
+{
+	// the balls after it move down one index. their queued impacts carry the old index,
+	// whose stamp no longer matches, so they are predicted again.
+	m_world->balls.erase(m_world->balls.begin() + (b - 1));
+	m_x0.erase(m_x0.begin() + b);
+	m_z0.erase(m_z0.begin() + b);
+	m_t0.erase(m_t0.begin() + b);
+	m_ballStamp.erase(m_ballStamp.begin() + b);
+	for (int k = b; k < ballCount(); k++) {
+		place(k, m_now);
+		predict(k);
+	}
+}
+
+void sim::ImpactSim::compact(void)
+{
+	size_t kept = 0;
+	for (size_t e = 0; e < m_queue.size(); e++) {
+		const Impact& impact = m_queue[e];
+		if (impact.ball < ballCount() && impact.stamp == m_ballStamp[impact.ball]) m_queue[kept++] = impact;
+	}
+	m_queue.resize(kept);
+	std::make_heap(m_queue.begin(), m_queue.end(), Later());
+}
+
+void sim::ImpactSim::advance(float timeDelta)
+{
+	World& world = *m_world;
+	world.ticks++;
+
+	const double end = m_now + timeDelta;
+	int fired = 0;
+	while (!m_queue.empty() && m_queue.front().time <= end && fired < IMPACT_MAX_EVENTS) {
+		std::pop_heap(m_queue.begin(), m_queue.end(), Later());
+		Impact impact = m_queue.back();
+		m_queue.pop_back();
+		if (impact.ball >= ballCount() || impact.stamp != m_ballStamp[impact.ball]) continue;
+
+		if (impact.time > m_now) m_now = impact.time;
+		fire(impact);
+		fired++;
+	}
+
+	m_now = end;
+	for (int b = 0; b < ballCount(); b++) place(b, end);
+
+	// stale impacts of moved control balls pile up until their time comes
+	if (m_queue.size() > (size_t)(4 * ballCount() + 64)) compact();
+}
@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simImpact.h
+//
+// Desc: Event driven mode of a World. Between bounces a ball moves on a straight line, so
+//       instead of testing it every frame the time of its next impact (wall, brick, control
+//       ball, or leaving the field) is computed once and kept in a priority queue. Work is
+//       only done when an impact comes due or an input changes the world.
+//
+//       The impacts use the tests and responses of the continuous mode (World::firstContact
+//       and World::resolveContact), evaluated at the exact time of each impact instead of
+//       at frame boundaries, so games play out like the continuous mode with an arbitrarily
+//       small timestep. Positions are not bit identical to the frame stepped modes.
+//
+//       A prediction looks at most IMPACT_REACH ahead along the path, which keeps its
+//       grid and wall tree queries local; a ball that reaches the horizon without impact
+//       is predicted again from there. Predictions are invalidated lazily: each ball has a
+//       stamp, and queued impacts of an older stamp, or against a brick that is gone by
+//       then, are dropped when they come up.
+//
+//       Bricks have to be at rest (they are in the game). After any input that changes the
+//       world other than moving the control ball (launch, reset, spawn, snapshot restore)
+//       call sync(); after World::moveControl call controlMoved().
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simImpactH__
+#define __simImpactH__
+
+#include "simCore.h"
+#include <vector>
+
+// distance a prediction covers, about two grid cells
+#define IMPACT_REACH 2.0f
+
+// impacts one advance() resolves at most, against a ball that keeps hitting at no distance
+#define IMPACT_MAX_EVENTS (1 << 20)
+
+namespace sim
+{
+	class ImpactSim
+	{
+	public:
+		ImpactSim(void);
+
+		// drives world from now on (not owned) and predicts all of its balls
+		void attach(World& world);
+
+		// world changed from outside: predicts every ball again from where it is now
+		void sync(void);
+		// World::moveControl was called: predicts the balls that can still reach it
+		void controlMoved(void);
+
+		// moves the clock by timeDelta (the units of World::step) resolving every impact on
+		// the way in time order, then puts the balls where they are at the new time. counts
+		// as one step in World::ticks.
+		void advance(float timeDelta);
+
+		double getTime(void) const { return m_now; }
+		long long getImpacts(void) const { return m_impacts; }           // resolved
+		long long getPredictions(void) const { return m_predictions; }
+		int getQueued(void) const { return (int)m_queue.size(); }         // stale ones included
+
+	private:
+		struct Impact
+		{
+			double       time;
+			int          ball;               // 0 for moveball, k + 1 for balls[k]
+			int          kind;               // World::CONTACT_* or IMPACT_HORIZON / IMPACT_OUT
+			int          index;
+			int          axis;
+			float        x, z;               // ball center at the impact
+			float        dx, dz;             // the move it was found on
+			unsigned int stamp;
+		};
+
+		// earliest time first, ties by ball, then in the order they were predicted
+		struct Later
+		{
+			bool operator()(const Impact& a, const Impact& b) const
+			{
+				if (a.time != b.time) return a.time > b.time;
+				if (a.ball != b.ball) return a.ball > b.ball;
+				return a.stamp > b.stamp;
+			}
+		};
+
+		Sphere& ball(int b) { return b == 0 ? m_world->moveball : m_world->balls[b - 1]; }
+		int ballCount(void) const { return 1 + (int)m_world->balls.size(); }
+
+		void predict(int b);
+		void fire(const Impact& impact);
+		void place(int b, double time);      // ball b to its position at time
+		void dropBall(int b);
+		void compact(void);
+
+		World* m_world;
+		double m_now;
+		std::vector<Impact> m_queue;         // binary heap, Later on top
+		unsigned int m_stamp;                // last stamp handed out
+
+		// per ball: the start of its current straight line, and the stamp of its prediction
+		std::vector<float>  m_x0, m_z0;
+		std::vector<double> m_t0;
+		std::vector<unsigned int> m_ballStamp;
+
+		long long m_impacts;
+		long long m_predictions;
+	};
+}
+
+#endif // __simImpactH__
@@ -0,0 +1,302 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simJobs.cpp
+//
+// Desc: Work stealing job system.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simJobs.h"
+#include <deque>
+
+// failed steal rounds before an idle worker goes to sleep
+#define JOB_SPINS 64
+
+struct sim::Job
+{
+	JobFunc   func;
+	void*     context;
+	RangeTask range;                     // chunks of parallelFor run this instead of func
+	int       part, begin, end;
+
+	Job*             parent;
+	std::atomic<int> unfinished;         // 1 for the job itself + unfinished children
+	std::atomic<int> waiting;            // unfinished dependencies + 1 until submitted
+	int              dependentCount;
+	Job*             dependents[JOB_MAX_DEPENDENTS];
+};
+
+struct sim::JobSystem::Queue
+{
+	std::mutex       lock;
+	std::deque<Job*> jobs;               // owner at the back, thieves at the front
+
+	std::unique_ptr<Job[]> ring;         // jobs created by this thread
+	unsigned int           allocated;
+	unsigned int           seed;         // victim choice
+
+	char pad[64];                        // keeps the locks of two threads off one cache line
+};
+
+namespace
+{
+	// the system and thread index of the running thread
+	struct ThreadSlot
+	{
+		const sim::JobSystem* system;
+		int index;
+	};
+	thread_local ThreadSlot t_slot = { NULL, 0 };
+
+	void noJob(void*) {}
+}
+
+sim::JobSystem::JobSystem(int threads)
+{
+	if (threads < 1) threads = 1;
+	m_queued = 0;
+	m_sleepers = 0;
+	m_quit = false;
+
+	for (int t = 0; t < threads; t++) {
+		m_queues.push_back(std::unique_ptr<Queue>(new Queue));
+		m_queues[t]->ring.reset(new Job[JOB_RING_SIZE]);
+		for (int j = 0; j < JOB_RING_SIZE; j++) m_queues[t]->ring[j].unfinished.store(0);
+		m_queues[t]->allocated = 0;
+		m_queues[t]->seed = 2654435761u * (t + 1);
+	}
+
+	t_slot.system = this;
+	t_slot.index = 0;
+	for (int t = 1; t < threads; t++) {
+		m_workers.push_back(std::thread(&JobSystem::worker, this, t));
+	}
+}
+
+sim::JobSystem::~JobSystem(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleep);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (size_t w = 0; w < m_workers.size(); w++) m_workers[w].join();
+	if (t_slot.system == this) t_slot.system = NULL;
+}
+
+int sim::JobSystem::threadIndex(void) const
+{
+	return t_slot.system == this ? t_slot.index : 0;
+}
+
+sim::Job* sim::JobSystem::allocate(void)
+{
+	// the next slot whose job finished. with the whole ring in flight run one of the
+	// queued jobs and look again.
+	int thread = threadIndex();
+	Queue& q = *m_queues[thread];
+	Job* job = NULL;
+	for (;;) {
+		for (int n = 0; n < JOB_RING_SIZE && job == NULL; n++) {
+			Job* slot = &q.ring[q.allocated++ & (JOB_RING_SIZE - 1)];
+			if (slot->unfinished.load() == 0) job = slot;
+		}
+		if (job != NULL) break;
+		Job* other = next(thread);
+		if (other != NULL) execute(other);
+		else std::this_thread::yield();
+	}
+
+	job->func = noJob;
+	job->context = NULL;
+	job->range = NULL;
+	job->part = job->begin = job->end = 0;
+	job->parent = NULL;
+	job->unfinished.store(1, std::memory_order_relaxed);
+	job->waiting.store(1, std::memory_order_relaxed);
+	job->dependentCount = 0;
+	return job;
+}
+
+sim::Job* sim::JobSystem::create(JobFunc func, void* context, Job* parent)
+{
+	Job* job = allocate();
+	if (func != NULL) job->func = func;
+	job->context = context;
+	job->parent = parent;
+	if (parent != NULL) parent->unfinished.fetch_add(1);
+	return job;
+}
+
+sim::Job* sim::JobSystem::createRange(RangeTask task, void* context, int part, int begin, int end, Job* parent)
+{
+	Job* job = create(NULL, context, parent);
+	job->range = task;
+	job->part = part;
+	job->begin = begin;
+	job->end = end;
+	return job;
+}
+
+bool sim::JobSystem::depend(Job* job, Job* before)
+{
+	if (before->dependentCount == JOB_MAX_DEPENDENTS) return false;
+	before->dependents[before->dependentCount++] = job;
+	job->waiting.fetch_add(1);
+	return true;
+}
+
+void sim::JobSystem::submit(Job* job)
+{
+	if (job->waiting.fetch_sub(1) == 1) push(job);
+}
+
+void sim::JobSystem::push(Job* job)
+{
+	Queue& q = *m_queues[threadIndex()];
+	{
+		std::lock_guard<std::mutex> lock(q.lock);
+		q.jobs.push_back(job);
+	}
+	m_queued.fetch_add(1);
+
+	// the sleeper counts itself under m_sleep before it checks m_queued, so taking the
+	// lock here can not miss it
+	if (m_sleepers.load() > 0) {
+		std::lock_guard<std::mutex> lock(m_sleep);
+		m_wake.notify_one();
+	}
+}
+
+sim::Job* sim::JobSystem::next(int thread)
+{
+	if (m_queued.load(std::memory_order_relaxed) == 0) return NULL;
+
+	// own jobs newest first: they are the ones still in the cache
+	Queue& own = *m_queues[thread];
+	{
+		std::lock_guard<std::mutex> lock(own.lock);
+		if (!own.jobs.empty()) {
+			Job* job = own.jobs.back();
+			own.jobs.pop_back();
+			m_queued.fetch_sub(1);
+			return job;
+		}
+	}
+
+	// steal the oldest job of another thread, starting at a random one
+	int threads = getThreadCount();
+	own.seed = own.seed * 1664525u + 1013904223u;
+	int first = (int)((own.seed >> 16) % (unsigned int)threads);
+	for (int n = 0; n < threads; n++) {
+		int victim = (first + n) % threads;
+		if (victim == thread) continue;
+		Queue& q = *m_queues[victim];
+		std::lock_guard<std::mutex> lock(q.lock);
+		if (!q.jobs.empty()) {
+			Job* job = q.jobs.front();
+			q.jobs.pop_front();
+			m_queued.fetch_sub(1);
+			return job;
+		}
+	}
+	return NULL;
+}
+
+void sim::JobSystem::execute(Job* job)
+{
+	if (job->range != NULL) job->range(job->context, job->part, job->begin, job->end);
+	else job->func(job->context);
+	finish(job);
+}
+
+void sim::JobSystem::finish(Job* job)
+{
+	while (job != NULL) {
+		// the dependents are fixed once the job was submitted. copy them first: after the
+		// decrement a waiting thread may move on and create jobs over this one.
+		Job* parent = job->parent;
+		int dependentCount = job->dependentCount;
+		Job* dependents[JOB_MAX_DEPENDENTS];
+		for (int d = 0; d < dependentCount; d++) dependents[d] = job->dependents[d];
+
+		if (job->unfinished.fetch_sub(1) != 1) return;
+		for (int d = 0; d < dependentCount; d++) submit(dependents[d]);
+		job = parent;
+	}
+}
+
+void sim::JobSystem::wait(Job* job)
+{
+	int thread = threadIndex();
+	while (job->unfinished.load() > 0) {
+		Job* other = next(thread);
+		if (other != NULL) execute(other);
+		else std::this_thread::yield();
+	}
+}
+
+void sim::JobSystem::parallelFor(int count, int grain, RangeTask task, void* context)
+{
+	if (count <= 0) return;
+	if (grain < 1) grain = 1;
+	int chunks = (count + grain - 1) / grain;
+	if (chunks > JOB_MAX_CHUNKS) chunks = JOB_MAX_CHUNKS;
+	if (chunks == 1 || getThreadCount() == 1) {
+		task(context, 0, 0, count);
+		return;
+	}
+
+	Job* root = create(NULL, NULL);
+	for (int c = 0; c < chunks; c++) {
+		int begin = (int)((long long)count * c / chunks);
+		int end = (int)((long long)count * (c + 1) / chunks);
+		submit(createRange(task, context, c, begin, end, root));
+	}
+	submit(root);
+	wait(root);
+}
+
+void sim::JobSystem::parallelRanges(int count, RangeTask task, void* context)
+{
+	int parts = getThreadCount();
+	if (parts == 1 || count < 2) {
+		task(context, 0, 0, count);
+		return;
+	}
+
+	Job* root = create(NULL, NULL);
+	for (int part = 0; part < parts; part++) {
+		int begin = (int)((long long)count * part / parts);
+		int end = (int)((long long)count * (part + 1) / parts);
+		if (begin < end) submit(createRange(task, context, part, begin, end, root));
+	}
+	submit(root);
+	wait(root);
+}
+
+void sim::JobSystem::worker(int thread)
+{
+	t_slot.system = this;
+	t_slot.index = thread;
+
+	int idle = 0;
+	while (!m_quit.load()) {
+		Job* job = next(thread);
+		if (job != NULL) {
+			execute(job);
+			idle = 0;
+			continue;
+		}
+		if (++idle < JOB_SPINS) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleep);
+		m_sleepers.fetch_add(1);
+		m_wake.wait(lock, [this] { return m_quit.load() || m_queued.load() > 0; });
+		m_sleepers.fetch_sub(1);
+		idle = 0;
+	}
+}
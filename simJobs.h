@@ -0,0 +1,93 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simJobs.h
+//
+// Desc: Work stealing job system. Every thread owns a deque of ready jobs: it pushes and pops
+//       at the back, idle threads steal from the front of the others. A job finishes when its
+//       function and all of its children are done; jobs made dependent on it are queued then.
+//
+//       Jobs are created, submitted and waited for from the thread that built the system or
+//       from inside jobs. Each thread takes its jobs from a ring of JOB_RING_SIZE, skipping the
+//       ones not finished yet; with the whole ring in flight it runs queued jobs until a slot
+//       frees up.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simJobsH__
+#define __simJobsH__
+
+#include "simThreads.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JOB_RING_SIZE      4096         // jobs per thread, a power of two
+#define JOB_MAX_DEPENDENTS 8            // jobs waiting for one job
+#define JOB_MAX_CHUNKS     1024         // jobs of one parallelFor
+
+namespace sim
+{
+	typedef void (*JobFunc)(void* context);
+
+	struct Job;
+
+	class JobSystem
+	{
+	public:
+		explicit JobSystem(int threads);     // threads includes the caller, at least 1
+		~JobSystem(void);
+
+		// a job running func(context). with a parent, the parent only finishes after it.
+		// func may be NULL for a job that only groups children or dependencies.
+		Job* create(JobFunc func, void* context, Job* parent = NULL);
+
+		// job starts after before finished. call it before submitting either of them.
+		// returns false when before already has JOB_MAX_DEPENDENTS dependents.
+		bool depend(Job* job, Job* before);
+
+		// queues the job once its dependencies finished. every created job is submitted once.
+		void submit(Job* job);
+
+		// runs other jobs until job finished
+		void wait(Job* job);
+
+		// task over [0, count) in chunks of at least grain items; part is the chunk number.
+		// returns after all chunks are done.
+		void parallelFor(int count, int grain, RangeTask task, void* context);
+
+		// task over [0, count) in one contiguous range per thread, split like
+		// WorkerPool::run, so results that depend on part do not depend on timing
+		void parallelRanges(int count, RangeTask task, void* context);
+
+		int getThreadCount(void) const { return (int)m_queues.size(); }
+
+	private:
+		JobSystem(const JobSystem&);
+		JobSystem& operator=(const JobSystem&);
+
+		struct Queue;
+
+		Job* allocate(void);
+		Job* createRange(RangeTask task, void* context, int part, int begin, int end, Job* parent);
+		void push(Job* job);
+		Job* next(int thread);
+		void execute(Job* job);
+		void finish(Job* job);
+		void worker(int thread);
+		int threadIndex(void) const;
+
+		std::vector<std::unique_ptr<Queue>> m_queues;
+		std::vector<std::thread>            m_workers;
+
+		std::atomic<int>        m_queued;    // jobs in all deques
+		std::atomic<int>        m_sleepers;  // workers waiting for m_wake
+		std::atomic<bool>       m_quit;
+		std::mutex              m_sleep;
+		std::condition_variable m_wake;
+	};
+}
+
+#endif // __simJobsH__
@@ -0,0 +1,303 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simKernel.cpp
+//
+// Desc: Batched kernels of the simulation core.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simKernel.h"
+#include <cstring>
+
+#if defined(__AVX__)
+#define SIM_KERNEL_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIM_KERNEL_SSE2
+#include <emmintrin.h>
+#endif
+
+static int countBits(unsigned int bits)
+{
+	int n = 0;
+	for (; bits; bits &= bits - 1) n++;
+	return n;
+}
+
+int sim::sphereHitMaskScalar(
+	const float* xs, const float* zs, int count,
+	float bx, float bz, float radiusSum,
+	unsigned int* mask)
+{
+	const float r2 = radiusSum * radiusSum;
+	int hits = 0;
+
+	memset(mask, 0, HIT_MASK_WORDS(count) * sizeof(unsigned int));
+	for (int i = 0; i < count; i++) {
+		float dx = xs[i] - bx;
+		float dz = zs[i] - bz;
+		if (dx * dx + dz * dz < r2) {
+			mask[i >> 5] |= 1u << (i & 31);
+			hits++;
+		}
+	}
+	return hits;
+}
+
+// the particles [begin, count), the tail the SIMD loops leave. the expired bits are or-ed
+// into the mask.
+static int particleTail(
+	float* x, float* y, float* z,
+	float* vx, float* vy, float* vz,
+	float* life, int begin, int count,
+	float step, float timeDelta,
+	float gravity, float bounce, float friction,
+	unsigned int* expired)
+{
+	const float fall = gravity * step;
+	int dead = 0;
+	for (int i = begin; i < count; i++) {
+		float v = vy[i] - fall;
+		float h = y[i] + v * step;
+		x[i] += vx[i] * step;
+		z[i] += vz[i] * step;
+		if (h < 0.0f) {
+			h = 0.0f;
+			v = -v * bounce;
+			vx[i] *= friction;
+			vz[i] *= friction;
+		}
+		y[i] = h;
+		vy[i] = v;
+		life[i] -= timeDelta;
+		if (life[i] <= 0.0f) {
+			expired[i >> 5] |= 1u << (i & 31);
+			dead++;
+		}
+	}
+	return dead;
+}
+
+int sim::particleStepScalar(
+	float* x, float* y, float* z,
+	float* vx, float* vy, float* vz,
+	float* life, int count,
+	float step, float timeDelta,
+	float gravity, float bounce, float friction,
+	unsigned int* expired)
+{
+	memset(expired, 0, HIT_MASK_WORDS(count) * sizeof(unsigned int));
+	return particleTail(x, y, z, vx, vy, vz, life, 0, count, step, timeDelta, gravity, bounce, friction, expired);
+}
+
+#if defined(SIM_KERNEL_AVX)
+
+int sim::sphereHitMask(
+	const float* xs, const float* zs, int count,
+	float bx, float bz, float radiusSum,
+	unsigned int* mask)
+{
+	const __m256 vbx = _mm256_set1_ps(bx);
+	const __m256 vbz = _mm256_set1_ps(bz);
+	const __m256 vr2 = _mm256_set1_ps(radiusSum * radiusSum);
+	int hits = 0;
+	int i = 0;
+
+	memset(mask, 0, HIT_MASK_WORDS(count) * sizeof(unsigned int));
+	for (; i + 8 <= count; i += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), vbx);
+		__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(zs + i), vbz);
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+		unsigned int bits = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(d2, vr2, _CMP_LT_OQ));
+		if (bits) {
+			// i is a multiple of 8, so the 8 bits never straddle two words
+			mask[i >> 5] |= bits << (i & 31);
+			hits += countBits(bits);
+		}
+	}
+
+	const float r2 = radiusSum * radiusSum;
+	for (; i < count; i++) {
+		float dx = xs[i] - bx;
+		float dz = zs[i] - bz;
+		if (dx * dx + dz * dz < r2) {
+			mask[i >> 5] |= 1u << (i & 31);
+			hits++;
+		}
+	}
+	return hits;
+}
+
+int sim::particleStep(
+	float* x, float* y, float* z,
+	float* vx, float* vy, float* vz,
+	float* life, int count,
+	float step, float timeDelta,
+	float gravity, float bounce, float friction,
+	unsigned int* expired)
+{
+	const __m256 vstep = _mm256_set1_ps(step);
+	const __m256 vfall = _mm256_set1_ps(gravity * step);
+	const __m256 vbounce = _mm256_set1_ps(bounce);
+	const __m256 vfriction = _mm256_set1_ps(friction);
+	const __m256 vdt = _mm256_set1_ps(timeDelta);
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	int dead = 0;
+	int i = 0;
+
+	memset(expired, 0, HIT_MASK_WORDS(count) * sizeof(unsigned int));
+	for (; i + 8 <= count; i += 8) {
+		__m256 v = _mm256_sub_ps(_mm256_loadu_ps(vy + i), vfall);
+		__m256 h = _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(v, vstep));
+		__m256 hx = _mm256_loadu_ps(vx + i);
+		__m256 hz = _mm256_loadu_ps(vz + i);
+		_mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(hx, vstep)));
+		_mm256_storeu_ps(z + i, _mm256_add_ps(_mm256_loadu_ps(z + i), _mm256_mul_ps(hz, vstep)));
+
+		// the ones below the plane: on it, bounced, slowed down. the factors are 1 for the
+		// others, which is cheaper than blends (vblendvps is 2-3 uops on many cores) and
+		// gives the same bits.
+		__m256 below = _mm256_cmp_ps(h, zero, _CMP_LT_OQ);
+		__m256 turn = _mm256_or_ps(_mm256_and_ps(below, vbounce), _mm256_andnot_ps(below, one));
+		__m256 kept = _mm256_or_ps(_mm256_and_ps(below, vfriction), _mm256_andnot_ps(below, one));
+		h = _mm256_andnot_ps(below, h);
+		v = _mm256_mul_ps(_mm256_xor_ps(v, _mm256_and_ps(below, sign)), turn);
+		hx = _mm256_mul_ps(hx, kept);
+		hz = _mm256_mul_ps(hz, kept);
+		_mm256_storeu_ps(y + i, h);
+		_mm256_storeu_ps(vy + i, v);
+		_mm256_storeu_ps(vx + i, hx);
+		_mm256_storeu_ps(vz + i, hz);
+		__m256 left = _mm256_sub_ps(_mm256_loadu_ps(life + i), vdt);
+		_mm256_storeu_ps(life + i, left);
+		unsigned int bits = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(left, zero, _CMP_LE_OQ));
+		if (bits) {
+			expired[i >> 5] |= bits << (i & 31);
+			dead += countBits(bits);
+		}
+	}
+	return dead + particleTail(x, y, z, vx, vy, vz, life, i, count, step, timeDelta, gravity, bounce, friction, expired);
+}
+
+const char* sim::kernelName(void) { return "avx"; }
+
+#elif defined(SIM_KERNEL_SSE2)
+
+int sim::sphereHitMask(
+	const float* xs, const float* zs, int count,
+	float bx, float bz, float radiusSum,
+	unsigned int* mask)
+{
+	const __m128 vbx = _mm_set1_ps(bx);
+	const __m128 vbz = _mm_set1_ps(bz);
+	const __m128 vr2 = _mm_set1_ps(radiusSum * radiusSum);
+	int hits = 0;
+	int i = 0;
+
+	memset(mask, 0, HIT_MASK_WORDS(count) * sizeof(unsigned int));
+	for (; i + 4 <= count; i += 4) {
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), vbx);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(zs + i), vbz);
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+		unsigned int bits = (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(d2, vr2));
+		if (bits) {
+			// i is a multiple of 4, so the 4 bits never straddle two words
+			mask[i >> 5] |= bits << (i & 31);
+			hits += countBits(bits);
+		}
+	}
+
+	const float r2 = radiusSum * radiusSum;
+	for (; i < count; i++) {
+		float dx = xs[i] - bx;
+		float dz = zs[i] - bz;
+		if (dx * dx + dz * dz < r2) {
+			mask[i >> 5] |= 1u << (i & 31);
+			hits++;
+		}
+	}
+	return hits;
+}
+
+// a where mask is set, b elsewhere
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+int sim::particleStep(
+	float* x, float* y, float* z,
+	float* vx, float* vy, float* vz,
+	float* life, int count,
+	float step, float timeDelta,
+	float gravity, float bounce, float friction,
+	unsigned int* expired)
+{
+	const __m128 vstep = _mm_set1_ps(step);
+	const __m128 vfall = _mm_set1_ps(gravity * step);
+	const __m128 vbounce = _mm_set1_ps(bounce);
+	const __m128 vfriction = _mm_set1_ps(friction);
+	const __m128 vdt = _mm_set1_ps(timeDelta);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	int dead = 0;
+	int i = 0;
+
+	memset(expired, 0, HIT_MASK_WORDS(count) * sizeof(unsigned int));
+	for (; i + 4 <= count; i += 4) {
+		__m128 v = _mm_sub_ps(_mm_loadu_ps(vy + i), vfall);
+		__m128 h = _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(v, vstep));
+		__m128 hx = _mm_loadu_ps(vx + i);
+		__m128 hz = _mm_loadu_ps(vz + i);
+		_mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(hx, vstep)));
+		_mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), _mm_mul_ps(hz, vstep)));
+
+		// the ones below the plane: on it, bounced, slowed down
+		__m128 below = _mm_cmplt_ps(h, zero);
+		h = _mm_andnot_ps(below, h);
+		v = select(below, _mm_mul_ps(_mm_xor_ps(v, sign), vbounce), v);
+		hx = select(below, _mm_mul_ps(hx, vfriction), hx);
+		hz = select(below, _mm_mul_ps(hz, vfriction), hz);
+		_mm_storeu_ps(y + i, h);
+		_mm_storeu_ps(vy + i, v);
+		_mm_storeu_ps(vx + i, hx);
+		_mm_storeu_ps(vz + i, hz);
+		__m128 left = _mm_sub_ps(_mm_loadu_ps(life + i), vdt);
+		_mm_storeu_ps(life + i, left);
+		unsigned int bits = (unsigned int)_mm_movemask_ps(_mm_cmple_ps(left, zero));
+		if (bits) {
+			expired[i >> 5] |= bits << (i & 31);
+			dead += countBits(bits);
+		}
+	}
+	return dead + particleTail(x, y, z, vx, vy, vz, life, i, count, step, timeDelta, gravity, bounce, friction, expired);
+}
+
+const char* sim::kernelName(void) { return "sse2"; }
+
+#else
+
+int sim::sphereHitMask(
+	const float* xs, const float* zs, int count,
+	float bx, float bz, float radiusSum,
+	unsigned int* mask)
+{
+	return sphereHitMaskScalar(xs, zs, count, bx, bz, radiusSum, mask);
+}
+
+int sim::particleStep(
+	float* x, float* y, float* z,
+	float* vx, float* vy, float* vz,
+	float* life, int count,
+	float step, float timeDelta,
+	float gravity, float bounce, float friction,
+	unsigned int* expired)
+{
+	return particleStepScalar(x, y, z, vx, vy, vz, life, count, step, timeDelta, gravity, bounce, friction, expired);
+}
+
+const char* sim::kernelName(void) { return "scalar"; }
+
+#endif
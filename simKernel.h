@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simKernel.h
+//
+// Desc: Batched kernels of the simulation core. The spheres (and particles) are passed as
+//       separate arrays per coordinate so several of them fit in one SSE / AVX register.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simKernelH__
+#define __simKernelH__
+
+#include "simMath.h"
+
+// number of mask words needed for count spheres
+#define HIT_MASK_WORDS(count) (((count) + 31) / 32)
+
+// added to radiusSum when sphereHitMask picks the candidates of a test that decides in
+// double (Sphere::hasIntersected), so the float squares never drop a touch it accepts
+#define HIT_MASK_MARGIN 1e-3f
+
+namespace sim
+{
+	//
+	// Sphere vs sphere
+	//
+
+	// tests the ball at (bx, bz) against count spheres. bit (i % 32) of mask[i / 32] is set
+	// when sphere i is closer than radiusSum on the xz plane. returns the number of hits.
+	// the test is in float: as a prefilter of hitBy, pad radiusSum by HIT_MASK_MARGIN and
+	// let hitBy decide.
+	int sphereHitMask(
+		const float* xs, const float* zs, int count,  // [in] sphere centers
+		float bx, float bz, float radiusSum,          // [in] ball center and both radii
+		unsigned int* mask);                          // [out] HIT_MASK_WORDS(count) words
+
+	// same as sphereHitMask without SIMD, used as reference and on other platforms
+	int sphereHitMaskScalar(
+		const float* xs, const float* zs, int count,
+		float bx, float bz, float radiusSum,
+		unsigned int* mask);
+
+	//
+	// Particles
+	//
+
+	// one step of timeDelta for count particles of the debris effect (simParticles.h). they
+	// move by step * velocity after gravity took its share, bounce off the plane at y = 0,
+	// keeping bounce of their vertical and friction of their horizontal speed, and lose
+	// timeDelta of their life. bit (i % 32) of expired[i / 32] is set when particle i has
+	// no life left. returns the number of expired particles.
+	int particleStep(
+		float* x, float* y, float* z,                 // [in/out] positions
+		float* vx, float* vy, float* vz,              // [in/out] velocities
+		float* life, int count,                       // [in/out] time left
+		float step, float timeDelta,                  // [in] distance per speed, time
+		float gravity, float bounce, float friction,  // [in]
+		unsigned int* expired);                       // [out] HIT_MASK_WORDS(count) words
+
+	// same as particleStep without SIMD, with the same results
+	int particleStepScalar(
+		float* x, float* y, float* z,
+		float* vx, float* vy, float* vz,
+		float* life, int count,
+		float step, float timeDelta,
+		float gravity, float bounce, float friction,
+		unsigned int* expired);
+
+	// name of the instruction set the kernels were compiled with ("avx", "sse2", "scalar")
+	const char* kernelName(void);
+}
+
+#endif // __simKernelH__
@@ -0,0 +1,459 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simLevel.cpp
+//
+// Desc: Level files.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simLevel.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// colors of the built-in level, as d3d::GREEN, d3d::DARKRED and d3d::YELLOW
+#define DEFAULT_PLANE_COLOR 0xff00ff00u
+#define DEFAULT_WALL_COLOR  0xffd70000u
+#define DEFAULT_BRICK_COLOR 0xffffff00u
+
+// longest line of the text format
+#define LEVEL_LINE 256
+
+namespace
+{
+	// state of one file mapping
+	struct Mapping
+	{
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE map;
+#endif
+		void*  base;
+		size_t size;
+	};
+
+	unsigned long long align16(unsigned long long offset)
+	{
+		return (offset + 15) & ~15ull;
+	}
+
+	// finite and within LEVEL_MAX_EXTENT (NaN fails both comparisons)
+	bool inRange(float v)
+	{
+		return v >= -LEVEL_MAX_EXTENT && v <= LEVEL_MAX_EXTENT;
+	}
+
+	bool validBox(const sim::LevelWall& w)
+	{
+		return inRange(w.x) && inRange(w.y) && inRange(w.z) &&
+			inRange(w.width) && inRange(w.height) && inRange(w.depth) && w.width >= 0.0f && w.height >= 0.0f && w.depth >= 0.0f;
+	}
+
+	// offsets of the arrays of a level with the given counts
+	void layout(sim::LevelHeader& h, unsigned int brickCount, unsigned int wallCount)
+	{
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, LEVEL_MAGIC, sizeof(h.magic));
+		h.version = LEVEL_VERSION;
+		h.headerSize = sizeof(sim::LevelHeader);
+		h.brickCount = brickCount;
+		h.wallCount = wallCount;
+
+		unsigned long long n = brickCount;
+		h.wallOffset = align16(sizeof(sim::LevelHeader));
+		h.brickXOffset = align16(h.wallOffset + wallCount * sizeof(sim::LevelWall));
+		h.brickZOffset = align16(h.brickXOffset + n * sizeof(float));
+		h.colorOffset = align16(h.brickZOffset + n * sizeof(float));
+		h.attrOffset = align16(h.colorOffset + n * sizeof(unsigned int));
+		h.fileSize = align16(h.attrOffset + n * sizeof(sim::BrickAttr));
+	}
+
+	// an array of count elements of the given size at offset lies inside the file
+	bool inside(unsigned long long offset, unsigned long long count, size_t element, unsigned long long size)
+	{
+		if (offset % 16 != 0 || offset > size) return false;
+		return count <= (size - offset) / element;
+	}
+
+	sim::LevelWall makeWall(float x, float y, float z, float width, float height, float depth, unsigned int color)
+	{
+		sim::LevelWall w;
+		w.x = x; w.y = y; w.z = z;
+		w.width = width; w.height = height; w.depth = depth;
+		w.color = color;
+		w.reserved = 0;
+		return w;
+	}
+}
+
+// by shape, in BRICK_* order
+static const char* const s_shapeNames[sim::BRICK_SHAPES] = { "sphere", "box", "capsule" };
+
+int sim::brickShape(const char* name)
+{
+	for (int s = 0; s < BRICK_SHAPES; s++) {
+		if (strcmp(name, s_shapeNames[s]) == 0) return s;
+	}
+	return -1;
+}
+
+const char* sim::brickShapeName(int shape)
+{
+	return shape >= 0 && shape < BRICK_SHAPES ? s_shapeNames[shape] : NULL;
+}
+
+sim::Level::Level(void)
+{
+	m_data = NULL;
+	m_size = 0;
+	m_mapping = NULL;
+	m_error = NULL;
+}
+
+sim::Level::~Level(void)
+{
+	close();
+}
+
+void sim::Level::close(void)
+{
+	if (m_mapping != NULL) {
+		Mapping* mapping = (Mapping*)m_mapping;
+#ifdef _WIN32
+		UnmapViewOfFile(mapping->base);
+		CloseHandle(mapping->map);
+		CloseHandle(mapping->file);
+#else
+		munmap(mapping->base, mapping->size);
+#endif
+		delete mapping;
+		m_mapping = NULL;
+	}
+	m_owned.clear();
+	m_data = NULL;
+	m_size = 0;
+}
+
+bool sim::Level::fail(const char* error)
+{
+	close();
+	m_error = error;
+	return false;
+}
+
+bool sim::Level::validate(size_t size)
+{
+	if (size < sizeof(LevelHeader)) return fail("truncated header");
+
+	const LevelHeader& h = header();
+	if (memcmp(h.magic, LEVEL_MAGIC, sizeof(h.magic)) != 0) return fail("not a level file");
+	if (h.version != LEVEL_VERSION) return fail("unsupported level version");
+	if (h.headerSize != sizeof(LevelHeader)) return fail("unexpected header size");
+	if (h.fileSize != size) return fail("file size does not match the header");
+	if (h.brickCount > 0x7fffffffu || h.wallCount > 0x7fffffffu) return fail("bad counts");
+
+	if (!inside(h.wallOffset, h.wallCount, sizeof(LevelWall), size) ||
+		!inside(h.brickXOffset, h.brickCount, sizeof(float), size) ||
+		!inside(h.brickZOffset, h.brickCount, sizeof(float), size) ||
+		!inside(h.colorOffset, h.brickCount, sizeof(unsigned int), size) ||
+		!inside(h.attrOffset, h.brickCount, sizeof(BrickAttr), size)) {
+		return fail("array outside of the file");
+	}
+
+	const BrickAttr* attrs = (const BrickAttr*)(m_data + h.attrOffset);
+	for (unsigned int i = 0; i < h.brickCount; i++) {
+		if (attrs[i].shape >= BRICK_SHAPES) return fail("unknown brick shape");
+	}
+
+	// values: the grid and the walls do integer math on them
+	if (!validBox(h.plane)) return fail("bad plane");
+	const LevelWall* walls = (const LevelWall*)(m_data + h.wallOffset);
+	for (unsigned int j = 0; j < h.wallCount; j++) {
+		if (!validBox(walls[j])) return fail("bad wall");
+	}
+	const float* brickX = (const float*)(m_data + h.brickXOffset);
+	const float* brickZ = (const float*)(m_data + h.brickZOffset);
+	for (unsigned int i = 0; i < h.brickCount; i++) {
+		if (!inRange(brickX[i]) || !inRange(brickZ[i])) return fail("bad brick position");
+	}
+
+	m_error = NULL;
+	return true;
+}
+
+bool sim::Level::load(const char* path)
+{
+	size_t len = strlen(path);
+	if (len >= 4 && strcmp(path + len - 4, ".txt") == 0) return loadText(path);
+	return loadBinary(path);
+}
+
+bool sim::Level::loadBinary(const char* path)
+{
+	close();
+	Mapping* mapping = new Mapping;
+
+#ifdef _WIN32
+	mapping->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mapping->file == INVALID_HANDLE_VALUE) {
+		delete mapping;
+		return fail("can not open the file");
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mapping->file, &size) || size.QuadPart == 0 || (unsigned long long)size.QuadPart > (size_t)-1) {
+		CloseHandle(mapping->file);
+		delete mapping;
+		return fail("can not map the file");
+	}
+	mapping->size = (size_t)size.QuadPart;
+	mapping->map = CreateFileMappingA(mapping->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	mapping->base = mapping->map != NULL ? MapViewOfFile(mapping->map, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (mapping->base == NULL) {
+		if (mapping->map != NULL) CloseHandle(mapping->map);
+		CloseHandle(mapping->file);
+		delete mapping;
+		return fail("can not map the file");
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		delete mapping;
+		return fail("can not open the file");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		delete mapping;
+		return fail("can not map the file");
+	}
+	mapping->size = (size_t)st.st_size;
+	mapping->base = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);                     // the mapping keeps the file open
+	if (mapping->base == MAP_FAILED) {
+		delete mapping;
+		return fail("can not map the file");
+	}
+#endif
+
+	m_mapping = mapping;
+	m_data = (const unsigned char*)mapping->base;
+	m_size = mapping->size;
+	return validate(m_size);
+}
+
+bool sim::Level::loadText(const char* path)
+{
+	close();
+	FILE* fp = fopen(path, "r");
+	if (fp == NULL) return fail("can not open the file");
+
+	LevelWall plane = makeWall(0, 0, 0, 0, 0, 0, DEFAULT_PLANE_COLOR);
+	bool hasPlane = false;
+	std::vector<LevelWall> walls;
+	std::vector<float> xs, zs;
+	std::vector<unsigned int> colors;
+	std::vector<BrickAttr> attrs;
+
+	char line[LEVEL_LINE];
+	char kind[16];
+	char color[16];
+	bool ok = true;
+	while (ok && fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%15s", kind) != 1 || kind[0] == '#') continue;
+
+		if (strcmp(kind, "plane") == 0 || strcmp(kind, "wall") == 0) {
+			LevelWall w;
+			ok = sscanf(line, "%*s %f %f %f %f %f %f %15s", &w.x, &w.y, &w.z, &w.width, &w.height, &w.depth, color) == 7;
+			w.color = (unsigned int)strtoul(color, NULL, 0);
+			w.reserved = 0;
+			if (kind[0] == 'p') {
+				plane = w;
+				hasPlane = true;
+			}
+			else {
+				walls.push_back(w);
+			}
+		}
+		else if (strcmp(kind, "brick") == 0) {
+			float x, z;
+			unsigned int hits = 1;
+			char shape[16] = "sphere";
+			int fields = sscanf(line, "%*s %f %f %15s %u %15s", &x, &z, color, &hits, shape);
+			ok = fields >= 3 && hits >= 1 && hits <= 0xffff && brickShape(shape) >= 0;
+			BrickAttr attr;
+			attr.hits = (unsigned short)hits;
+			attr.shape = (unsigned short)brickShape(shape);
+			xs.push_back(x);
+			zs.push_back(z);
+			colors.push_back((unsigned int)strtoul(color, NULL, 0));
+			attrs.push_back(attr);
+		}
+		else {
+			ok = false;
+		}
+	}
+	fclose(fp);
+
+	if (!ok) return fail("malformed line");
+	if (!hasPlane) return fail("no plane");
+	assign(plane, walls, xs, zs, colors, attrs);
+	return validate(m_size);
+}
+
+void sim::Level::assign(const LevelWall& plane, const std::vector<LevelWall>& walls,
+	const std::vector<float>& brickX, const std::vector<float>& brickZ,
+	const std::vector<unsigned int>& brickColor, const std::vector<BrickAttr>& brickAttr)
+{
+	close();
+
+	LevelHeader h;
+	layout(h, (unsigned int)brickX.size(), (unsigned int)walls.size());
+	h.plane = plane;
+
+	m_owned.assign((size_t)(h.fileSize / sizeof(unsigned long long)), 0);
+	unsigned char* data = (unsigned char*)&m_owned[0];
+	memcpy(data, &h, sizeof(h));
+	size_t n = brickX.size();
+	if (!walls.empty()) memcpy(data + h.wallOffset, &walls[0], walls.size() * sizeof(LevelWall));
+	if (n > 0) {
+		memcpy(data + h.brickXOffset, &brickX[0], n * sizeof(float));
+		memcpy(data + h.brickZOffset, &brickZ[0], n * sizeof(float));
+		memcpy(data + h.colorOffset, &brickColor[0], n * sizeof(unsigned int));
+		memcpy(data + h.attrOffset, &brickAttr[0], n * sizeof(BrickAttr));
+	}
+
+	m_data = data;
+	m_size = (size_t)h.fileSize;
+	m_error = NULL;
+}
+
+void sim::Level::makeDefault(void)
+{
+	// plane and the walls around it. the right side (x = 4.56) is left open.
+	LevelWall plane = makeWall(0.0f, -0.0006f / 5, 0.0f, 9, 0.03f, 6, DEFAULT_PLANE_COLOR);
+	std::vector<LevelWall> walls;
+	walls.push_back(makeWall(0.0f, 0.12f, 3.06f, 9, 0.3f, 0.12f, DEFAULT_WALL_COLOR));
+	walls.push_back(makeWall(0.0f, 0.12f, -3.06f, 9, 0.3f, 0.12f, DEFAULT_WALL_COLOR));
+	walls.push_back(makeWall(-4.56f, 0.12f, 0.0f, 0.12f, 0.3f, 6.24f, DEFAULT_WALL_COLOR));
+
+	// brick layout: 4 layers of 13
+	std::vector<float> xs(DEFAULT_LEVEL_BRICKS), zs(DEFAULT_LEVEL_BRICKS);
+	for (int layer = 0; layer < 4; layer++) {
+		for (int nth = 0; nth < 13; nth++) {
+			xs[layer * 13 + nth] = 0.9f + (-0.9f * layer);
+			zs[layer * 13 + nth] = 0.43f * (nth - 6);
+		}
+	}
+	BrickAttr attr;
+	attr.hits = 1;
+	attr.shape = BRICK_SPHERE;
+
+	assign(plane, walls, xs, zs, std::vector<unsigned int>(DEFAULT_LEVEL_BRICKS, DEFAULT_BRICK_COLOR),
+		std::vector<BrickAttr>(DEFAULT_LEVEL_BRICKS, attr));
+}
+
+void sim::Level::makeStream(int chunkCount)
+{
+	// from the open edge of the built-in plane to a margin past the last chunk
+	const float edge = 4.5f;
+	const float end = chunkStartX(chunkCount) - 0.3f;
+	const float width = edge - end;
+	const float x = (edge + end) / 2;
+	LevelWall plane = makeWall(x, -0.0006f / 5, 0.0f, width, 0.03f, 6, DEFAULT_PLANE_COLOR);
+	std::vector<LevelWall> walls;
+	walls.push_back(makeWall(x, 0.12f, 3.06f, width, 0.3f, 0.12f, DEFAULT_WALL_COLOR));
+	walls.push_back(makeWall(x, 0.12f, -3.06f, width, 0.3f, 0.12f, DEFAULT_WALL_COLOR));
+	walls.push_back(makeWall(end - 0.06f, 0.12f, 0.0f, 0.12f, 0.3f, 6.24f, DEFAULT_WALL_COLOR));
+
+	assign(plane, walls, std::vector<float>(), std::vector<float>(), std::vector<unsigned int>(),
+		std::vector<BrickAttr>());
+}
+
+void sim::Level::makeChunk(unsigned int seed, int index)
+{
+	static const unsigned int colors[4] = { DEFAULT_BRICK_COLOR, 0xff00ffffu, 0xffff8000u, 0xffff00ffu };
+
+	// the 4 columns of the built-in layout that fit, every slot filled or not by a hash of
+	// the seed, the chunk and the slot
+	LevelWall plane = makeWall(-CHUNK_LENGTH / 2, -0.0006f / 5, 0.0f, CHUNK_LENGTH, 0.03f, 6, DEFAULT_PLANE_COLOR);
+	std::vector<float> xs, zs;
+	std::vector<unsigned int> color;
+	std::vector<BrickAttr> attrs;
+	for (int column = 0; column < 4; column++) {
+		for (int nth = 0; nth < 13; nth++) {
+			unsigned long long h = ((unsigned long long)seed << 32) ^ (unsigned long long)(index * 52 + column * 13 + nth);
+			h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;    // splitmix64 finalizer
+			h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+			h ^= h >> 31;
+			if (h % 100 >= 55) continue;
+
+			BrickAttr attr;
+			attr.hits = (h >> 8) % 6 == 0 ? 2 : 1;
+			attr.shape = (h >> 16) % 5 == 0 ? BRICK_BOX : BRICK_SPHERE;
+			xs.push_back(-0.25f - 0.43f * column);
+			zs.push_back(0.43f * (nth - 6));
+			color.push_back(colors[(h >> 24) % 4]);
+			attrs.push_back(attr);
+		}
+	}
+	assign(plane, std::vector<LevelWall>(), xs, zs, color, attrs);
+}
+
+unsigned long long sim::Level::getHash(void) const
+{
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < m_size; i++) {
+		hash = (hash ^ m_data[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+bool sim::Level::saveBinary(const char* path) const
+{
+	if (!isLoaded()) return false;
+
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+	bool ok = fwrite(m_data, 1, m_size, fp) == m_size;
+	return fclose(fp) == 0 && ok;
+}
+
+bool sim::Level::saveText(const char* path) const
+{
+	if (!isLoaded()) return false;
+
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL) return false;
+
+	fprintf(fp, "# plane/wall x y z width height depth color\n");
+	fprintf(fp, "# brick x z color [hits [sphere|box|capsule]]\n");
+	const LevelWall& p = getPlane();
+	fprintf(fp, "plane %.9g %.9g %.9g %.9g %.9g %.9g 0x%08x\n", p.x, p.y, p.z, p.width, p.height, p.depth, p.color);
+	for (int i = 0; i < getWallCount(); i++) {
+		const LevelWall& w = getWalls()[i];
+		fprintf(fp, "wall %.9g %.9g %.9g %.9g %.9g %.9g 0x%08x\n", w.x, w.y, w.z, w.width, w.height, w.depth, w.color);
+	}
+	const float* xs = getBrickX();
+	const float* zs = getBrickZ();
+	for (int i = 0; i < getBrickCount(); i++) {
+		const BrickAttr& attr = getBrickAttr()[i];
+		if (attr.shape == BRICK_SPHERE) {
+			fprintf(fp, "brick %.9g %.9g 0x%08x %u\n", xs[i], zs[i], getBrickColor()[i], (unsigned int)attr.hits);
+		}
+		else {
+			fprintf(fp, "brick %.9g %.9g 0x%08x %u %s\n", xs[i], zs[i], getBrickColor()[i], (unsigned int)attr.hits,
+				brickShapeName(attr.shape));
+		}
+	}
+	return fclose(fp) == 0;
+}
@@ -0,0 +1,155 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simLevel.h
+//
+// Desc: Level files: the plane, the walls and the bricks of a level. The binary format is
+//       memory mapped and read in place, the brick arrays are used straight out of the
+//       mapping. A line based text format (see levelConvert.cpp) converts to and from it.
+//
+//       Binary layout, little endian, every array 16 byte aligned:
+//           LevelHeader
+//           LevelWall   walls[wallCount]
+//           float       brickX[brickCount]
+//           float       brickZ[brickCount]
+//           unsigned    brickColor[brickCount]      0xAARRGGBB
+//           BrickAttr   brickAttr[brickCount]
+//
+//       The balls start at the right (+x) edge of the plane, which has no wall. The first
+//       two walls, when there are two, bound the control ball along z.
+//
+//       Streamed levels (simStream.h) are a long corridor (makeStream) filled with chunks
+//       while the balls move along it. A chunk is a level of its own holding only bricks,
+//       in chunk coordinates: x in [-CHUNK_LENGTH, 0] from the start of the chunk towards
+//       -x, z across the corridor. Chunk files are named by CHUNK_FILE_FORMAT.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simLevelH__
+#define __simLevelH__
+
+#include "simMath.h"
+#include <cstddef>
+#include <vector>
+
+#define LEVEL_MAGIC "SIMLVL\0"          // 8 bytes with the terminator
+#define LEVEL_VERSION 1
+
+// loaded levels: coordinates within +-LEVEL_MAX_EXTENT, sizes in [0, LEVEL_MAX_EXTENT], all
+// finite. the brick grid spans the plane, so this also bounds its cell count.
+#define LEVEL_MAX_EXTENT 1024.0f
+
+// bricks of the built-in level (4 layers of 13)
+#define DEFAULT_LEVEL_BRICKS 52
+
+// chunks of a streamed level: length along x, most bricks, the x where chunk 0 starts (3
+// units before the open edge of the corridor, like the bricks of the built-in level)
+#define CHUNK_LENGTH     2.0f
+#define CHUNK_MAX_BRICKS 64
+#define CHUNK_FIRST_X    1.5f
+#define CHUNK_FILE_FORMAT "%s/chunk%05d.bin"    // directory, chunk index
+
+namespace sim
+{
+	// an axis aligned box: the plane or a wall
+	struct LevelWall
+	{
+		float x, y, z;
+		float width, height, depth;
+		unsigned int color;
+		unsigned int reserved;
+	};
+
+	// brick shapes, see simShapes.h
+	enum { BRICK_SPHERE, BRICK_BOX, BRICK_CAPSULE, BRICK_SHAPES };
+
+	struct BrickAttr
+	{
+		unsigned short hits;             // hits it takes to destroy the brick
+		unsigned short shape;            // BRICK_*, 0 (a sphere) in files of before the shapes
+	};
+
+	// "sphere", "box", "capsule" for the text format; -1 / NULL when unknown
+	int brickShape(const char* name);
+	const char* brickShapeName(int shape);
+
+	// x where chunk index of a streamed level starts; its bricks are at this x plus theirs
+	inline float chunkStartX(int index) { return CHUNK_FIRST_X - index * CHUNK_LENGTH; }
+
+	struct LevelHeader
+	{
+		char         magic[8];
+		unsigned int version;
+		unsigned int headerSize;         // sizeof(LevelHeader) of the writer
+		unsigned int brickCount;
+		unsigned int wallCount;
+		LevelWall    plane;
+
+		// byte offsets from the start of the file
+		unsigned long long wallOffset;
+		unsigned long long brickXOffset;
+		unsigned long long brickZOffset;
+		unsigned long long colorOffset;
+		unsigned long long attrOffset;
+		unsigned long long fileSize;
+	};
+
+	class Level
+	{
+	public:
+		Level(void);
+		~Level(void);
+
+		// *.txt is read as text, anything else mapped as binary. false (see getError)
+		// when the file is missing, truncated, of another version or inconsistent.
+		bool load(const char* path);
+		bool loadBinary(const char* path);
+		bool loadText(const char* path);
+
+		bool saveBinary(const char* path) const;
+		bool saveText(const char* path) const;
+
+		// builds the level in memory, in the same layout as the file
+		void assign(const LevelWall& plane, const std::vector<LevelWall>& walls,
+			const std::vector<float>& brickX, const std::vector<float>& brickZ,
+			const std::vector<unsigned int>& brickColor, const std::vector<BrickAttr>& brickAttr);
+		void makeDefault(void);          // the original 4 x 13 layout
+		// streamed levels: the corridor of chunkCount chunks, walled like the built-in level
+		// and without bricks, and chunk index of the level generated from seed
+		void makeStream(int chunkCount);
+		void makeChunk(unsigned int seed, int index);
+
+		void close(void);
+		bool isLoaded(void) const { return m_data != NULL; }
+		bool isMapped(void) const { return m_mapping != NULL; }
+		const char* getError(void) const { return m_error; }
+		unsigned long long getHash(void) const;      // FNV-1a over the file bytes
+		size_t getSize(void) const { return m_size; }
+
+		int getBrickCount(void) const { return (int)header().brickCount; }
+		int getWallCount(void) const { return (int)header().wallCount; }
+		const LevelWall& getPlane(void) const { return header().plane; }
+		const LevelWall* getWalls(void) const { return (const LevelWall*)(m_data + header().wallOffset); }
+
+		// zero copy: these point into the mapping (or the in-memory level)
+		const float* getBrickX(void) const { return (const float*)(m_data + header().brickXOffset); }
+		const float* getBrickZ(void) const { return (const float*)(m_data + header().brickZOffset); }
+		const unsigned int* getBrickColor(void) const { return (const unsigned int*)(m_data + header().colorOffset); }
+		const BrickAttr* getBrickAttr(void) const { return (const BrickAttr*)(m_data + header().attrOffset); }
+
+	private:
+		Level(const Level&);
+		Level& operator=(const Level&);
+
+		const LevelHeader& header(void) const { return *(const LevelHeader*)m_data; }
+		bool validate(size_t size);      // structure and values of a loaded level
+		bool fail(const char* error);
+
+		const unsigned char* m_data;
+		size_t               m_size;
+		void*                m_mapping;  // platform mapping state, NULL for an in-memory level
+		std::vector<unsigned long long> m_owned;    // in-memory level, 8 byte aligned
+		const char*          m_error;
+	};
+}
+
+#endif // __simLevelH__
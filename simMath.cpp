@@ -0,0 +1,56 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simMath.cpp
+//
+// Desc: Math mode of the simulation core.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simMath.h"
+#include <cmath>
+
+sim::MathMode sim::mathMode(void)
+{
+#if defined(SIM_DETERMINISTIC)
+	return MATH_DETERMINISTIC;
+#else
+	return MATH_DEFAULT;
+#endif
+}
+
+const char* sim::mathModeName(int mode)
+{
+	switch (mode) {
+	case MATH_DEFAULT:       return "default";
+	case MATH_DETERMINISTIC: return "deterministic";
+	}
+	return "unknown";
+}
+
+float sim::detSin(float x)
+{
+	const float twoPi = 6.28318531f;
+	const float pi = 3.14159265f;
+	const float halfPi = 1.57079633f;
+
+	// into [-pi, pi], then folded into [-pi/2, pi/2] where the series converges fast
+	float k = floorf(x / twoPi + 0.5f);
+	x = x - k * twoPi;
+	if (x > halfPi) x = pi - x;
+	else if (x < -halfPi) x = -pi - x;
+
+	// Taylor series up to x^11
+	float x2 = x * x;
+	float p = -1.0f / 39916800.0f;
+	p = p * x2 + 1.0f / 362880.0f;
+	p = p * x2 - 1.0f / 5040.0f;
+	p = p * x2 + 1.0f / 120.0f;
+	p = p * x2 - 1.0f / 6.0f;
+	p = p * x2 + 1.0f;
+	return p * x;
+}
+
+float sim::detCos(float x)
+{
+	return detSin(x + 1.57079633f);
+}
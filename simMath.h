@@ -0,0 +1,57 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simMath.h
+//
+// Desc: Math mode of the simulation core.
+//
+//       With SIM_DETERMINISTIC defined (for every file of the core) the physics is float only:
+//       no double intermediates, distances compared squared, and only +, -, *, / and sqrt,
+//       which IEEE 754 rounds exactly, plus the sine / cosine below built from them. Builds
+//       that could round differently do not compile: x87 excess precision (FLT_EVAL_METHOD)
+//       and -ffast-math. Contracting a * b + c into a fused multiply-add (-mfma, /arch:AVX2)
+//       has to stay off: this header turns it off with a pragma for MSVC, clang and GCC;
+//       MSVC also needs /fp:precise (the default).
+//
+//       The two modes give different results; replays record the mode they were made in.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simMathH__
+#define __simMathH__
+
+#include <cfloat>
+
+#if defined(SIM_DETERMINISTIC)
+#if defined(__FAST_MATH__)
+#error "SIM_DETERMINISTIC can not be built with -ffast-math"
+#endif
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+#error "SIM_DETERMINISTIC needs float math in float precision (SSE2, not x87)"
+#endif
+#if defined(_MSC_VER)
+#pragma fp_contract(off)
+#elif defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+#endif
+
+namespace sim
+{
+	enum MathMode
+	{
+		MATH_DEFAULT,                    // float storage, some double intermediates
+		MATH_DETERMINISTIC,              // SIM_DETERMINISTIC
+	};
+
+	MathMode mathMode(void);             // the mode simMath.cpp was built with
+	const char* mathModeName(int mode);  // "default", "deterministic"
+
+	// sine and cosine with the same result on every build: range reduction and a fixed
+	// polynomial, evaluated in float in a fixed order. error below 1e-6 on [-pi, pi].
+	float detSin(float x);
+	float detCos(float x);
+}
+
+#endif // __simMathH__
@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simParticles.cpp
+//
+// Desc: Debris of the bricks.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simParticles.h"
+#include "simKernel.h"
+#include <cmath>
+
+sim::ParticlePool::ParticlePool(int capacity)
+{
+	// the only allocation of the pool: 7 arrays of a whole number of cache lines each, the
+	// first one at the first cache line of the block
+	const int line = 64 / sizeof(float);
+	const int stride = (capacity + line - 1) / line * line;
+	m_block.resize(7 * stride + line);
+	float* base = m_block.data();
+	while ((size_t)base % 64 != 0) base++;
+	m_x = base;
+	m_y = base + stride;
+	m_z = base + 2 * stride;
+	m_vx = base + 3 * stride;
+	m_vy = base + 4 * stride;
+	m_vz = base + 5 * stride;
+	m_life = base + 6 * stride;
+	m_color.resize(capacity);
+	m_expired.resize(HIT_MASK_WORDS(capacity));
+	m_capacity = capacity;
+	m_count = 0;
+	m_peak = 0;
+	m_spawned = 0;
+	m_dropped = 0;
+	m_random = 0x9e3779b9u;
+}
+
+float sim::ParticlePool::random(void)
+{
+	m_random ^= m_random << 13;
+	m_random ^= m_random >> 17;
+	m_random ^= m_random << 5;
+	return (m_random >> 8) * (1.0f / 16777216.0f);
+}
+
+int sim::ParticlePool::spawn(float x, float y, float z, unsigned int color, int count)
+{
+	int room = getCapacity() - m_count;
+	int spawned = count < room ? count : room;
+	for (int k = 0; k < spawned; k++) {
+		int i = m_count++;
+		float angle = 6.2831853f * random();
+		float speed = PARTICLE_SPEED * (0.2f + 0.8f * random());
+		m_x[i] = x;
+		m_y[i] = y;
+		m_z[i] = z;
+		m_vx[i] = speed * cosf(angle);
+		m_vy[i] = PARTICLE_LIFT * (0.3f + 0.7f * random());
+		m_vz[i] = speed * sinf(angle);
+		m_life[i] = PARTICLE_LIFE * (0.5f + 0.5f * random());
+		m_color[i] = color;
+	}
+	if (m_count > m_peak) m_peak = m_count;
+	m_spawned += spawned;
+	m_dropped += count - spawned;
+	return spawned;
+}
+
+void sim::ParticlePool::brickHit(void* context, int brick, float x, float z, unsigned int color, bool destroyed)
+{
+	ParticlePool* pool = (ParticlePool*)context;
+	pool->spawn(x, (float)M_RADIUS, z, color, destroyed ? PARTICLES_PER_BRICK : PARTICLES_PER_HIT);
+}
+
+void sim::ParticlePool::update(float timeDelta, bool scalar)
+{
+	if (m_count == 0) return;
+
+	int expired;
+	if (scalar) {
+		expired = particleStepScalar(m_x, m_y, m_z, m_vx, m_vy, m_vz, m_life, m_count, TIME_SCALE * timeDelta, timeDelta,
+			PARTICLE_GRAVITY, PARTICLE_BOUNCE, PARTICLE_FRICTION, m_expired.data());
+	}
+	else {
+		expired = particleStep(m_x, m_y, m_z, m_vx, m_vy, m_vz, m_life, m_count, TIME_SCALE * timeDelta, timeDelta,
+			PARTICLE_GRAVITY, PARTICLE_BOUNCE, PARTICLE_FRICTION, m_expired.data());
+	}
+	if (expired == 0) return;
+
+	// cull: the last live particle takes the place of an expired one. the expired ones go from
+	// the highest index down, so all of them above were gone already and the last one is live
+	// (or the expired one itself).
+	for (int w = HIT_MASK_WORDS(m_count) - 1; w >= 0; w--) {
+		unsigned int bits = m_expired[w];
+		while (bits != 0) {
+			int top = 31;
+			while (!(bits & (1u << top))) top--;
+			bits &= ~(1u << top);
+
+			int i = (w << 5) + top;
+			int last = --m_count;
+			if (i == last) continue;
+			m_x[i] = m_x[last];
+			m_y[i] = m_y[last];
+			m_z[i] = m_z[last];
+			m_vx[i] = m_vx[last];
+			m_vy[i] = m_vy[last];
+			m_vz[i] = m_vz[last];
+			m_life[i] = m_life[last];
+			m_color[i] = m_color[last];
+		}
+	}
+}
+
+void sim::ParticlePool::clear(void)
+{
+	m_count = 0;
+}
@@ -0,0 +1,100 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simParticles.h
+//
+// Desc: Debris of the bricks: every hit throws a few particles, a destroyed brick a burst of
+//       them, which fly off, bounce on the plane and fade out. The particles are a fixed
+//       pool of arrays allocated once; spawning and updating never allocate. When the pool
+//       is full new particles are dropped (and counted) rather than growing it. The float
+//       arrays are cut from one block, each starting on a cache line, so the 32 byte loads
+//       of the AVX kernel never straddle two lines.
+//
+//       update() runs the particleStep kernel of simKernel.h over the live particles, which
+//       also marks the expired ones in a bit mask, and then culls just those by moving the
+//       last live particle into their place, so the live ones always are [0, getCount()).
+//
+//       The particles are an effect only: the world does not see them, and they are not in
+//       snapshots, recordings or the world hash.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simParticlesH__
+#define __simParticlesH__
+
+#include "simCore.h"
+#include <vector>
+
+// default pool size, the particles of a multi-ball clear of a large level
+#define PARTICLE_CAPACITY  65536
+
+// particles thrown by a hit that leaves the brick standing, and by one that destroys it
+#define PARTICLES_PER_HIT   6
+#define PARTICLES_PER_BRICK 24
+
+// life of a particle in timeDelta units (1.5 s at 60Hz), the shortest ones live half of it
+#define PARTICLE_LIFE 1.0f
+
+// motion, the speeds in the units of Sphere velocities (TIME_SCALE per timeDelta)
+#define PARTICLE_SPEED    1.5f         // fastest sideways speed
+#define PARTICLE_LIFT     2.0f         // fastest upwards speed
+#define PARTICLE_GRAVITY  2.0f
+#define PARTICLE_BOUNCE   0.4f         // vertical speed kept by a bounce on the plane
+#define PARTICLE_FRICTION 0.6f         // sideways speed kept by a bounce
+
+namespace sim
+{
+	class ParticlePool
+	{
+	public:
+		explicit ParticlePool(int capacity = PARTICLE_CAPACITY);
+
+		// count particles of color at (x, y, z) flying off in random directions. returns the
+		// number spawned, less than count when the pool is full.
+		int spawn(float x, float y, float z, unsigned int color, int count);
+		// a World::onBrickHit for a pool given as the context
+		static void brickHit(void* context, int brick, float x, float z, unsigned int color, bool destroyed);
+
+		// moves the particles by timeDelta and culls the expired ones. scalar runs the
+		// reference kernel instead of the SIMD one.
+		void update(float timeDelta, bool scalar = false);
+		void clear(void);
+
+		int getCount(void) const { return m_count; }
+		int getCapacity(void) const { return m_capacity; }
+		int getPeak(void) const { return m_peak; }
+		long long getSpawned(void) const { return m_spawned; }
+		long long getDropped(void) const { return m_dropped; }
+
+		// the live particles, getCount() of each
+		const float* getX(void) const { return m_x; }
+		const float* getY(void) const { return m_y; }
+		const float* getZ(void) const { return m_z; }
+		const float* getLife(void) const { return m_life; }            // time left
+		const unsigned int* getColor(void) const { return m_color.data(); }
+
+	private:
+		ParticlePool(const ParticlePool&);
+		ParticlePool& operator=(const ParticlePool&);
+
+		float random(void);              // in [0, 1)
+
+		std::vector<float> m_block;      // the float arrays below
+		float* m_x;
+		float* m_y;
+		float* m_z;
+		float* m_vx;
+		float* m_vy;
+		float* m_vz;
+		float* m_life;
+		std::vector<unsigned int> m_color;
+		std::vector<unsigned int> m_expired;   // scratch of update(), one bit per particle
+		int          m_capacity;
+		int          m_count;
+		int          m_peak;
+		long long    m_spawned;
+		long long    m_dropped;
+		unsigned int m_random;           // xorshift32 state
+	};
+}
+
+#endif // __simParticlesH__
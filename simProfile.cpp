@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simProfile.cpp
+//
+// Desc: Per-stage frame timing.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simProfile.h"
+#include <chrono>
+#include <cstring>
+
+static const char* g_stageNames[sim::STAGE_COUNT] = {
+	"update",
+	"sweep",
+	"wall_collision",
+	"brick_collision",
+	"control_collision",
+	"reset",
+	"balls",
+	"stream",
+	"particles",
+	"raster",
+	"step",
+	"draw",
+	"frame",
+};
+
+static sim::Histogram g_stages[sim::STAGE_COUNT];
+
+const char* sim::stageName(int stage)
+{
+	return (stage >= 0 && stage < STAGE_COUNT) ? g_stageNames[stage] : "unknown";
+}
+
+// -----------------------------------------------------------------------------
+// Histogram
+// -----------------------------------------------------------------------------
+
+void sim::Histogram::reset(void)
+{
+	memset(m_buckets, 0, sizeof(m_buckets));
+	m_count = 0;
+	m_total = 0;
+	m_max = 0;
+}
+
+int sim::Histogram::bucketOf(long long ns)
+{
+	if (ns < SUB_BUCKETS) return ns < 0 ? 0 : (int)ns;
+
+	int msb = 0;
+	for (unsigned long long v = (unsigned long long)ns; v > 1; v >>= 1) msb++;
+	int shift = msb - SUB_BITS;
+	int sub = (int)(ns >> shift) - SUB_BUCKETS;
+	return (shift + 1) * SUB_BUCKETS + sub;
+}
+
+long long sim::Histogram::bucketTop(int bucket)
+{
+	if (bucket < SUB_BUCKETS) return bucket;
+
+	int shift = bucket / SUB_BUCKETS - 1;
+	int sub = bucket % SUB_BUCKETS;
+	long long low = (long long)(SUB_BUCKETS + sub) << shift;
+	return low + (1LL << shift) - 1;
+}
+
+void sim::Histogram::record(long long ns)
+{
+	m_buckets[bucketOf(ns)]++;
+	m_count++;
+	m_total += ns;
+	if (ns > m_max) m_max = ns;
+}
+
+long long sim::Histogram::percentile(double p) const
+{
+	if (m_count == 0) return 0;
+
+	long long rank = (long long)(p / 100.0 * (double)m_count + 0.5);
+	if (rank < 1) rank = 1;
+
+	long long seen = 0;
+	for (int b = 0; b < BUCKETS; b++) {
+		seen += m_buckets[b];
+		if (seen >= rank) {
+			long long top = bucketTop(b);
+			return top < m_max ? top : m_max;
+		}
+	}
+	return m_max;
+}
+
+// -----------------------------------------------------------------------------
+// Profile
+// -----------------------------------------------------------------------------
+
+long long sim::profileNow(void)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void sim::profileRecord(int stage, long long ns)
+{
+	g_stages[stage].record(ns);
+}
+
+const sim::Histogram& sim::profileHistogram(int stage)
+{
+	return g_stages[stage];
+}
+
+void sim::profileReset(void)
+{
+	for (int s = 0; s < STAGE_COUNT; s++) g_stages[s].reset();
+}
+
+bool sim::profileEnabled(void)
+{
+#ifdef SIM_PROFILE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void sim::profilePrint(FILE* fp)
+{
+	fprintf(fp, "%-18s %10s %10s %10s %10s %10s\n", "stage", "count", "mean ns", "p50 ns", "p99 ns", "max ns");
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		const Histogram& h = g_stages[s];
+		if (h.getCount() == 0) continue;
+		fprintf(fp, "%-18s %10lld %10.0f %10lld %10lld %10lld\n", stageName(s),
+			h.getCount(), h.getMean(), h.percentile(50), h.percentile(99), h.getMax());
+	}
+}
+
+bool sim::profileWriteCSV(const char* path)
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL) return false;
+
+	fprintf(fp, "stage,count,mean_ns,p50_ns,p99_ns,max_ns\n");
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		const Histogram& h = g_stages[s];
+		fprintf(fp, "%s,%lld,%.1f,%lld,%lld,%lld\n", stageName(s),
+			h.getCount(), h.getMean(), h.percentile(50), h.percentile(99), h.getMax());
+	}
+	return fclose(fp) == 0;
+}
+
+bool sim::profileWriteJSON(const char* path)
+{
+	FILE* fp = fopen(path, "w");
+	if (fp == NULL) return false;
+
+	fprintf(fp, "{\n  \"stages\": [\n");
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		const Histogram& h = g_stages[s];
+		fprintf(fp, "    { \"stage\": \"%s\", \"count\": %lld, \"mean_ns\": %.1f, \"p50_ns\": %lld, \"p99_ns\": %lld, \"max_ns\": %lld }%s\n",
+			stageName(s), h.getCount(), h.getMean(), h.percentile(50), h.percentile(99), h.getMax(),
+			s + 1 < STAGE_COUNT ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+	return fclose(fp) == 0;
+}
+
+bool sim::profileWrite(const char* path)
+{
+	size_t len = strlen(path);
+	if (len >= 5 && strcmp(path + len - 5, ".json") == 0) return profileWriteJSON(path);
+	return profileWriteCSV(path);
+}
@@ -0,0 +1,103 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simProfile.h
+//
+// Desc: Per-stage frame timing. SIM_PROFILE_SCOPE(stage) times the rest of the enclosing
+//       block with a monotonic clock and adds it to the latency histogram of the stage.
+//       The timers compile to nothing unless SIM_PROFILE is defined.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simProfileH__
+#define __simProfileH__
+
+#include <cstdio>
+
+#ifdef SIM_PROFILE
+#define SIM_PROFILE_JOIN2(a, b) a##b
+#define SIM_PROFILE_JOIN(a, b) SIM_PROFILE_JOIN2(a, b)
+#define SIM_PROFILE_SCOPE(stage) sim::ScopedTimer SIM_PROFILE_JOIN(scopedTimer, __LINE__)(stage)
+#else
+#define SIM_PROFILE_SCOPE(stage) ((void)0)
+#endif
+
+namespace sim
+{
+	enum ProfileStage
+	{
+		STAGE_UPDATE,                    // ballUpdate of all balls
+		STAGE_SWEEP,                     // continuous collision of the moving ball
+		STAGE_WALL_COLLISION,            // walls vs moving ball
+		STAGE_BRICK_COLLISION,           // bricks vs moving ball
+		STAGE_CONTROL_COLLISION,         // walls vs control ball, control ball vs moving ball
+		STAGE_RESET,                     // ball out of field
+		STAGE_BALLS,                     // multi-ball: the balls other than the moving ball
+		STAGE_STREAM,                    // streamed level: chunks in and out of the world
+		STAGE_PARTICLES,                 // debris of the bricks (simParticles.h)
+		STAGE_RASTER,                    // a frame of the CPU rasterizer (simRaster.h)
+		STAGE_STEP,                      // all of World::step
+		STAGE_DRAW,                      // drawing (game only)
+		STAGE_FRAME,                     // whole frame (game only)
+		STAGE_COUNT
+	};
+
+	const char* stageName(int stage);
+
+	//
+	// Histogram: log-linear latency buckets. 16 buckets per power of two, so any
+	// percentile is within ~6% of the recorded value.
+	//
+
+	class Histogram
+	{
+	public:
+		Histogram(void) { reset(); }
+
+		void reset(void);
+		void record(long long ns);
+
+		long long getCount(void) const { return m_count; }
+		long long getMax(void) const { return m_max; }
+		double getMean(void) const { return m_count ? (double)m_total / m_count : 0.0; }
+		long long percentile(double p) const;    // p in [0, 100], upper bound of the bucket
+
+	private:
+		enum { SUB_BITS = 4, SUB_BUCKETS = 1 << SUB_BITS, BUCKETS = 64 * SUB_BUCKETS };
+
+		static int bucketOf(long long ns);
+		static long long bucketTop(int bucket);
+
+		long long m_buckets[BUCKETS];
+		long long m_count;
+		long long m_total;
+		long long m_max;
+	};
+
+	//
+	// Profile: one histogram per stage
+	//
+
+	long long profileNow(void);                  // monotonic clock, nanoseconds
+	void profileRecord(int stage, long long ns);
+	const Histogram& profileHistogram(int stage);
+	void profileReset(void);
+	bool profileEnabled(void);                   // SIM_PROFILE was defined for simProfile.cpp
+
+	void profilePrint(FILE* fp);
+	bool profileWriteCSV(const char* path);
+	bool profileWriteJSON(const char* path);
+	bool profileWrite(const char* path);         // JSON for *.json, CSV otherwise
+
+	class ScopedTimer
+	{
+	public:
+		explicit ScopedTimer(int stage) : m_stage(stage), m_start(profileNow()) {}
+		~ScopedTimer(void) { profileRecord(m_stage, profileNow() - m_start); }
+
+	private:
+		int       m_stage;
+		long long m_start;
+	};
+}
+
+#endif // __simProfileH__
@@ -0,0 +1,625 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simRaster.cpp
+//
+// Desc: CPU rasterizer.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simRaster.h"
+#include "simJobs.h"
+#include "simProfile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define RASTER_PI 3.14159265f
+
+namespace
+{
+	// 28.4 fixed point
+	inline int snap(float v)
+	{
+		return (int)floorf(v * RASTER_SUBPIXEL + 0.5f);
+	}
+
+	// the first and the last pixel with its center in [lo, hi] (fixed point)
+	inline int firstPixel(int lo) { return (int)ceilf((lo - RASTER_SUBPIXEL / 2) / (float)RASTER_SUBPIXEL); }
+	inline int lastPixel(int hi) { return (int)floorf((hi - RASTER_SUBPIXEL / 2) / (float)RASTER_SUBPIXEL); }
+
+	inline unsigned int toByte(float c)
+	{
+		c = c < 0.0f ? 0.0f : c > 1.0f ? 1.0f : c;
+		return (unsigned int)(c * 255.0f + 0.5f);
+	}
+
+	inline unsigned int pack(float r, float g, float b)
+	{
+		return 0xff000000u | (toByte(r) << 16) | (toByte(g) << 8) | toByte(b);
+	}
+
+	// x ^ power, with the usual integer powers of the materials as plain products
+	inline float specularPower(float x, float power)
+	{
+		int n = (int)power;
+		if ((float)n != power || n < 0 || n > 16) return powf(x, power);
+		float r = 1.0f;
+		for (int i = 0; i < n; i++) r *= x;
+		return r;
+	}
+
+	// edge a -> b of a triangle clockwise on the screen (y down): the pixels on a top edge
+	// (horizontal, the triangle below it) or a left edge (going up) are inside
+	inline bool topLeft(int ax, int ay, int bx, int by)
+	{
+		return (ay == by && bx > ax) || by < ay;
+	}
+
+	// one mesh vertex and its normal, the triangles added by addTriangle
+	struct MeshBuilder
+	{
+		std::vector<float>* position;
+		std::vector<float>* normal;
+		std::vector<int>*   index;
+
+		int add(float x, float y, float z, float nx, float ny, float nz)
+		{
+			position->push_back(x);
+			position->push_back(y);
+			position->push_back(z);
+			normal->push_back(nx);
+			normal->push_back(ny);
+			normal->push_back(nz);
+			return (int)position->size() / 3 - 1;
+		}
+
+		// turned clockwise seen from outside, where the vertex normals point. triangles
+		// without area (at the poles of a sphere) are left out.
+		void addTriangle(int a, int b, int c)
+		{
+			const float* p = position->data();
+			const float* n = normal->data();
+			float ux = p[3 * b] - p[3 * a], uy = p[3 * b + 1] - p[3 * a + 1], uz = p[3 * b + 2] - p[3 * a + 2];
+			float vx = p[3 * c] - p[3 * a], vy = p[3 * c + 1] - p[3 * a + 1], vz = p[3 * c + 2] - p[3 * a + 2];
+			float fx = uy * vz - uz * vy, fy = uz * vx - ux * vz, fz = ux * vy - uy * vx;
+			if (fx == 0.0f && fy == 0.0f && fz == 0.0f) return;
+			float ox = n[3 * a] + n[3 * b] + n[3 * c];
+			float oy = n[3 * a + 1] + n[3 * b + 1] + n[3 * c + 1];
+			float oz = n[3 * a + 2] + n[3 * b + 2] + n[3 * c + 2];
+			if (fx * ox + fy * oy + fz * oz < 0.0f) std::swap(b, c);
+			index->push_back(a);
+			index->push_back(b);
+			index->push_back(c);
+		}
+
+		// a grid of (rows + 1) x (cols + 1) vertices from first, as quads
+		void addGrid(int first, int rows, int cols)
+		{
+			for (int i = 0; i < rows; i++) {
+				for (int j = 0; j < cols; j++) {
+					int v00 = first + i * (cols + 1) + j;
+					int v10 = v00 + cols + 1;
+					addTriangle(v00, v10, v10 + 1);
+					addTriangle(v00, v10 + 1, v00 + 1);
+				}
+			}
+		}
+	};
+}
+
+sim::Rasterizer::Rasterizer(void)
+{
+	m_frame = NULL;
+	m_width = 0;
+	m_height = 0;
+	m_tilesX = 0;
+	m_tilesY = 0;
+	m_viewProjection = matIdentity();
+	m_triangles = 0;
+}
+
+void sim::Rasterizer::tessellate(const RenderFrame& frame)
+{
+	m_meshes.resize(frame.meshes.size());
+	m_meshKeys.resize(frame.meshes.size());
+	for (size_t i = 0; i < frame.meshes.size(); i++) {
+		const RenderMesh& desc = frame.meshes[i];
+		Mesh& mesh = m_meshes[i];
+		if (!mesh.index.empty() && memcmp(&m_meshKeys[i], &desc, sizeof(desc)) == 0) continue;
+		m_meshKeys[i] = desc;
+		mesh.position.clear();
+		mesh.normal.clear();
+		mesh.index.clear();
+		MeshBuilder b = { &mesh.position, &mesh.normal, &mesh.index };
+
+		if (desc.kind == MESH_BOX) {
+			// a face per axis and side, the corners around it
+			const float half[3] = { desc.size[0] / 2, desc.size[1] / 2, desc.size[2] / 2 };
+			for (int axis = 0; axis < 3; axis++) {
+				for (int side = -1; side <= 1; side += 2) {
+					int u = (axis + 1) % 3, v = (axis + 2) % 3;
+					int first = -1;
+					for (int k = 0; k < 4; k++) {
+						float p[3], n[3] = { 0.0f, 0.0f, 0.0f };
+						p[axis] = side * half[axis];
+						p[u] = (k == 1 || k == 2) ? half[u] : -half[u];
+						p[v] = (k >= 2) ? half[v] : -half[v];
+						n[axis] = (float)side;
+						int index = b.add(p[0], p[1], p[2], n[0], n[1], n[2]);
+						if (first < 0) first = index;
+					}
+					b.addTriangle(first, first + 1, first + 2);
+					b.addTriangle(first, first + 2, first + 3);
+				}
+			}
+		}
+		else if (desc.kind == MESH_SPHERE) {
+			// around z, from the +z pole to the -z one
+			const float radius = desc.size[0];
+			int first = (int)mesh.position.size() / 3;
+			for (int i = 0; i <= desc.stacks; i++) {
+				float phi = RASTER_PI * i / desc.stacks;
+				for (int j = 0; j <= desc.slices; j++) {
+					float theta = 2 * RASTER_PI * j / desc.slices;
+					float nx = sinf(phi) * cosf(theta), ny = sinf(phi) * sinf(theta), nz = cosf(phi);
+					b.add(radius * nx, radius * ny, radius * nz, nx, ny, nz);
+				}
+			}
+			b.addGrid(first, desc.stacks, desc.slices);
+		}
+		else {
+			// the side, then a cap at each end
+			const float radius = desc.size[0], half = desc.size[1] / 2;
+			int first = (int)mesh.position.size() / 3;
+			for (int i = 0; i <= desc.stacks; i++) {
+				float z = -half + desc.size[1] * i / desc.stacks;
+				for (int j = 0; j <= desc.slices; j++) {
+					float theta = 2 * RASTER_PI * j / desc.slices;
+					b.add(radius * cosf(theta), radius * sinf(theta), z, cosf(theta), sinf(theta), 0.0f);
+				}
+			}
+			b.addGrid(first, desc.stacks, desc.slices);
+			for (int side = -1; side <= 1; side += 2) {
+				int center = b.add(0.0f, 0.0f, side * half, 0.0f, 0.0f, (float)side);
+				for (int j = 0; j <= desc.slices; j++) {
+					float theta = 2 * RASTER_PI * j / desc.slices;
+					b.add(radius * cosf(theta), radius * sinf(theta), side * half, 0.0f, 0.0f, (float)side);
+				}
+				for (int j = 0; j < desc.slices; j++) b.addTriangle(center, center + 1 + j, center + 2 + j);
+			}
+		}
+	}
+}
+
+void sim::Rasterizer::render(const RenderFrame& frame, JobSystem* jobs)
+{
+	SIM_PROFILE_SCOPE(STAGE_RASTER);
+	m_frame = &frame;
+	if (frame.width != m_width || frame.height != m_height) {
+		m_width = frame.width;
+		m_height = frame.height;
+		m_color.assign((size_t)m_width * m_height, 0);
+		m_depth.assign((size_t)m_width * m_height, 1.0f);
+		m_tilesX = (m_width + RASTER_TILE - 1) / RASTER_TILE;
+		m_tilesY = (m_height + RASTER_TILE - 1) / RASTER_TILE;
+	}
+	const int tiles = m_tilesX * m_tilesY;
+	m_viewProjection = matMultiply(frame.view, frame.projection);
+	tessellate(frame);
+
+	// one run per chunk of JobSystem::parallelFor, which takes a single chunk when the
+	// system has one thread
+	const int items = (int)frame.items.size();
+	int runs = (items + RASTER_ITEM_GRAIN - 1) / RASTER_ITEM_GRAIN;
+	runs = std::max(std::min(runs, JOB_MAX_CHUNKS), 1);
+	if ((int)m_runs.size() < runs) m_runs.resize(runs);
+	for (size_t r = 0; r < m_runs.size(); r++) {
+		Run& run = m_runs[r];
+		run.vertices.clear();
+		run.triangles.clear();
+		run.bins.resize(tiles);
+		for (int t = 0; t < tiles; t++) run.bins[t].clear();
+	}
+	if (jobs != NULL) jobs->parallelFor(items, RASTER_ITEM_GRAIN, geometryTask, this);
+	else geometry(0, 0, items);
+
+	m_triangles = 0;
+	for (size_t r = 0; r < m_runs.size(); r++) m_triangles += (int)m_runs[r].triangles.size() / 3;
+
+	// the points are few next to the triangles, they are binned here
+	m_points.clear();
+	m_pointBins.resize(tiles);
+	for (int t = 0; t < tiles; t++) m_pointBins[t].clear();
+	const float half = frame.pointSize / 2;
+	const Mat4& m = m_viewProjection;
+	for (size_t i = 0; i < frame.points.size(); i++) {
+		const RenderPoint& p = frame.points[i];
+		float x = p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0];
+		float y = p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1];
+		float z = p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2];
+		float w = p.x * m.m[0][3] + p.y * m.m[1][3] + p.z * m.m[2][3] + m.m[3][3];
+		if (z < 0.0f || z > w) continue;
+
+		Vertex v;
+		v.iw = 1.0f / w;
+		v.x = (x * v.iw * 0.5f + 0.5f) * m_width;
+		v.y = (0.5f - y * v.iw * 0.5f) * m_height;
+		v.z = z * v.iw;
+		Color4 c = colorOf(p.color);
+		v.r = c.r;
+		v.g = c.g;
+		v.b = c.b;
+
+		// pixels with the center in [x - half, x + half)
+		int px0 = std::max((int)ceilf(v.x - half - 0.5f), 0), px1 = std::min((int)ceilf(v.x + half - 0.5f) - 1, m_width - 1);
+		int py0 = std::max((int)ceilf(v.y - half - 0.5f), 0), py1 = std::min((int)ceilf(v.y + half - 0.5f) - 1, m_height - 1);
+		if (px0 > px1 || py0 > py1) continue;
+		int index = (int)m_points.size();
+		m_points.push_back(v);
+		for (int ty = py0 / RASTER_TILE; ty <= py1 / RASTER_TILE; ty++) {
+			for (int tx = px0 / RASTER_TILE; tx <= px1 / RASTER_TILE; tx++) m_pointBins[ty * m_tilesX + tx].push_back(index);
+		}
+	}
+
+	if (jobs != NULL) jobs->parallelFor(tiles, 1, tileTask, this);
+	else tileTask(this, 0, 0, tiles);
+	m_frame = NULL;
+}
+
+void sim::Rasterizer::geometryTask(void* context, int part, int begin, int end)
+{
+	((Rasterizer*)context)->geometry(part, begin, end);
+}
+
+void sim::Rasterizer::tileTask(void* context, int part, int begin, int end)
+{
+	Rasterizer* r = (Rasterizer*)context;
+	for (int t = begin; t < end; t++) r->drawTile(t);
+}
+
+void sim::Rasterizer::geometry(int part, int begin, int end)
+{
+	const RenderFrame& frame = *m_frame;
+	const RenderLight& light = frame.light;
+	Run& run = m_runs[part];
+
+	for (int n = begin; n < end; n++) {
+		const RenderItem& item = frame.items[n];
+		const Mesh& mesh = m_meshes[item.mesh];
+		const Mat4& w = item.world;
+		const Mat4 m = matMultiply(item.world, m_viewProjection);
+		const Color4 material = colorOf(item.color);
+		const int count = (int)mesh.position.size() / 3;
+
+		// transform and light the vertices, as D3D does it for a point light with the
+		// material of the item: ambient, diffuse and specular, all attenuated
+		run.clip.resize(count);
+		const int base = (int)run.vertices.size();
+		run.vertices.resize(base + count);
+		for (int k = 0; k < count; k++) {
+			const float* p = &mesh.position[3 * k];
+			const float* nm = &mesh.normal[3 * k];
+			ClipVertex& c = run.clip[k];
+			c.x = p[0] * m.m[0][0] + p[1] * m.m[1][0] + p[2] * m.m[2][0] + m.m[3][0];
+			c.y = p[0] * m.m[0][1] + p[1] * m.m[1][1] + p[2] * m.m[2][1] + m.m[3][1];
+			c.z = p[0] * m.m[0][2] + p[1] * m.m[1][2] + p[2] * m.m[2][2] + m.m[3][2];
+			c.w = p[0] * m.m[0][3] + p[1] * m.m[1][3] + p[2] * m.m[2][3] + m.m[3][3];
+
+			float px = p[0] * w.m[0][0] + p[1] * w.m[1][0] + p[2] * w.m[2][0] + w.m[3][0];
+			float py = p[0] * w.m[0][1] + p[1] * w.m[1][1] + p[2] * w.m[2][1] + w.m[3][1];
+			float pz = p[0] * w.m[0][2] + p[1] * w.m[1][2] + p[2] * w.m[2][2] + w.m[3][2];
+			float nx = nm[0] * w.m[0][0] + nm[1] * w.m[1][0] + nm[2] * w.m[2][0];
+			float ny = nm[0] * w.m[0][1] + nm[1] * w.m[1][1] + nm[2] * w.m[2][1];
+			float nz = nm[0] * w.m[0][2] + nm[1] * w.m[1][2] + nm[2] * w.m[2][2];
+			float nl = sqrtf(nx * nx + ny * ny + nz * nz);
+			nx /= nl;
+			ny /= nl;
+			nz /= nl;
+
+			float lx = light.position.x - px, ly = light.position.y - py, lz = light.position.z - pz;
+			float distance = sqrtf(lx * lx + ly * ly + lz * lz);
+			c.r = c.g = c.b = 0.0f;
+			if (distance <= light.range) {
+				float attenuation = 1.0f / (light.attenuation0 + light.attenuation1 * distance +
+					light.attenuation2 * distance * distance);
+				lx /= distance;
+				ly /= distance;
+				lz /= distance;
+				float diffuse = std::max(nx * lx + ny * ly + nz * lz, 0.0f) * attenuation;
+				c.r = std::min(material.r * (light.ambient.r * attenuation + light.diffuse.r * diffuse), 1.0f);
+				c.g = std::min(material.g * (light.ambient.g * attenuation + light.diffuse.g * diffuse), 1.0f);
+				c.b = std::min(material.b * (light.ambient.b * attenuation + light.diffuse.b * diffuse), 1.0f);
+				if (diffuse > 0.0f) {
+					// half way between the light and the eye
+					float ex = frame.eye.x - px, ey = frame.eye.y - py, ez = frame.eye.z - pz;
+					float el = sqrtf(ex * ex + ey * ey + ez * ez);
+					float hx = ex / el + lx, hy = ey / el + ly, hz = ez / el + lz;
+					float hl = sqrtf(hx * hx + hy * hy + hz * hz);
+					float nh = std::max((nx * hx + ny * hy + nz * hz) / hl, 0.0f);
+					float specular = specularPower(nh, item.power) * attenuation;
+					c.r = std::min(c.r + material.r * light.specular.r * specular, 1.0f);
+					c.g = std::min(c.g + material.g * light.specular.g * specular, 1.0f);
+					c.b = std::min(c.b + material.b * light.specular.b * specular, 1.0f);
+				}
+			}
+
+			if (c.z >= 0.0f) {
+				Vertex& v = run.vertices[base + k];
+				v.iw = 1.0f / c.w;
+				v.x = (c.x * v.iw * 0.5f + 0.5f) * m_width;
+				v.y = (0.5f - c.y * v.iw * 0.5f) * m_height;
+				v.z = c.z * v.iw;
+				v.r = c.r * v.iw;
+				v.g = c.g * v.iw;
+				v.b = c.b * v.iw;
+			}
+		}
+
+		for (size_t t = 0; t < mesh.index.size(); t += 3) {
+			const int i0 = mesh.index[t], i1 = mesh.index[t + 1], i2 = mesh.index[t + 2];
+			const ClipVertex& a = run.clip[i0];
+			const ClipVertex& b = run.clip[i1];
+			const ClipVertex& c = run.clip[i2];
+			if (a.z > a.w && b.z > b.w && c.z > c.w) continue;      // beyond the far plane
+			int front = (a.z >= 0.0f) + (b.z >= 0.0f) + (c.z >= 0.0f);
+			if (front == 3) bin(run, base + i0, base + i1, base + i2);
+			else if (front > 0) emit(run, &a, &b, &c);
+		}
+	}
+}
+
+// a triangle partly behind the near plane: the part in front of it, as a fan
+void sim::Rasterizer::emit(Run& run, const ClipVertex* a, const ClipVertex* b, const ClipVertex* c)
+{
+	const ClipVertex* in[3] = { a, b, c };
+	ClipVertex out[4];
+	int count = 0;
+	for (int k = 0; k < 3; k++) {
+		const ClipVertex& p = *in[k];
+		const ClipVertex& q = *in[(k + 1) % 3];
+		if (p.z >= 0.0f) out[count++] = p;
+		if ((p.z >= 0.0f) != (q.z >= 0.0f)) {
+			float t = p.z / (p.z - q.z);
+			ClipVertex& o = out[count++];
+			o.x = p.x + (q.x - p.x) * t;
+			o.y = p.y + (q.y - p.y) * t;
+			o.z = 0.0f;
+			o.w = p.w + (q.w - p.w) * t;
+			o.r = p.r + (q.r - p.r) * t;
+			o.g = p.g + (q.g - p.g) * t;
+			o.b = p.b + (q.b - p.b) * t;
+		}
+	}
+
+	const int base = (int)run.vertices.size();
+	for (int k = 0; k < count; k++) {
+		const ClipVertex& c = out[k];
+		Vertex v;
+		v.iw = 1.0f / c.w;
+		v.x = (c.x * v.iw * 0.5f + 0.5f) * m_width;
+		v.y = (0.5f - c.y * v.iw * 0.5f) * m_height;
+		v.z = c.z * v.iw;
+		v.r = c.r * v.iw;
+		v.g = c.g * v.iw;
+		v.b = c.b * v.iw;
+		run.vertices.push_back(v);
+	}
+	for (int k = 1; k + 1 < count; k++) bin(run, base, base + k, base + k + 1);
+}
+
+// the triangle, if it faces the camera and covers a pixel center, on the tiles of its
+// bounding box
+void sim::Rasterizer::bin(Run& run, int i0, int i1, int i2)
+{
+	const Vertex& v0 = run.vertices[i0];
+	const Vertex& v1 = run.vertices[i1];
+	const Vertex& v2 = run.vertices[i2];
+	const int x0 = snap(v0.x), y0 = snap(v0.y);
+	const int x1 = snap(v1.x), y1 = snap(v1.y);
+	const int x2 = snap(v2.x), y2 = snap(v2.y);
+	long long area = (long long)(x1 - x0) * (y2 - y0) - (long long)(y1 - y0) * (x2 - x0);
+	if (area <= 0) return;
+
+	int px0 = std::max(firstPixel(std::min(std::min(x0, x1), x2)), 0);
+	int px1 = std::min(lastPixel(std::max(std::max(x0, x1), x2)), m_width - 1);
+	int py0 = std::max(firstPixel(std::min(std::min(y0, y1), y2)), 0);
+	int py1 = std::min(lastPixel(std::max(std::max(y0, y1), y2)), m_height - 1);
+	if (px0 > px1 || py0 > py1) return;
+
+	const int index = (int)run.triangles.size() / 3;
+	run.triangles.push_back(i0);
+	run.triangles.push_back(i1);
+	run.triangles.push_back(i2);
+	for (int ty = py0 / RASTER_TILE; ty <= py1 / RASTER_TILE; ty++) {
+		for (int tx = px0 / RASTER_TILE; tx <= px1 / RASTER_TILE; tx++) run.bins[ty * m_tilesX + tx].push_back(index);
+	}
+}
+
+void sim::Rasterizer::drawTile(int tile)
+{
+	const int tileX0 = (tile % m_tilesX) * RASTER_TILE, tileY0 = (tile / m_tilesX) * RASTER_TILE;
+	const int tileX1 = std::min(tileX0 + RASTER_TILE, m_width) - 1, tileY1 = std::min(tileY0 + RASTER_TILE, m_height) - 1;
+	const unsigned int clear = 0xff000000u | m_frame->clearColor;
+
+	for (int y = tileY0; y <= tileY1; y++) {
+		unsigned int* color = &m_color[(size_t)y * m_width];
+		float* depth = &m_depth[(size_t)y * m_width];
+		for (int x = tileX0; x <= tileX1; x++) {
+			color[x] = clear;
+			depth[x] = 1.0f;
+		}
+	}
+
+	for (size_t r = 0; r < m_runs.size(); r++) {
+		const Run& run = m_runs[r];
+		const std::vector<int>& bin = run.bins[tile];
+		for (size_t n = 0; n < bin.size(); n++) {
+			const int* tri = &run.triangles[3 * bin[n]];
+			const Vertex& v0 = run.vertices[tri[0]];
+			const Vertex& v1 = run.vertices[tri[1]];
+			const Vertex& v2 = run.vertices[tri[2]];
+			const int x0 = snap(v0.x), y0 = snap(v0.y);
+			const int x1 = snap(v1.x), y1 = snap(v1.y);
+			const int x2 = snap(v2.x), y2 = snap(v2.y);
+			const long long area = (long long)(x1 - x0) * (y2 - y0) - (long long)(y1 - y0) * (x2 - x0);
+
+			const int px0 = std::max(firstPixel(std::min(std::min(x0, x1), x2)), tileX0);
+			const int px1 = std::min(lastPixel(std::max(std::max(x0, x1), x2)), tileX1);
+			const int py0 = std::max(firstPixel(std::min(std::min(y0, y1), y2)), tileY0);
+			const int py1 = std::min(lastPixel(std::max(std::max(y0, y1), y2)), tileY1);
+			if (px0 > px1 || py0 > py1) continue;
+
+			// edge functions at the center of the first pixel, e_k is the edge opposite to
+			// vertex k, and their steps per pixel. pixels on an edge that is not top or
+			// left are moved out by the bias.
+			const long long cx = (long long)px0 * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2;
+			const long long cy = (long long)py0 * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2;
+			long long e0 = (long long)(x2 - x1) * (cy - y1) - (long long)(y2 - y1) * (cx - x1) - (topLeft(x1, y1, x2, y2) ? 0 : 1);
+			long long e1 = (long long)(x0 - x2) * (cy - y2) - (long long)(y0 - y2) * (cx - x2) - (topLeft(x2, y2, x0, y0) ? 0 : 1);
+			long long e2 = (long long)(x1 - x0) * (cy - y0) - (long long)(y1 - y0) * (cx - x0) - (topLeft(x0, y0, x1, y1) ? 0 : 1);
+			const long long dx0 = -(long long)(y2 - y1) * RASTER_SUBPIXEL, dy0 = (long long)(x2 - x1) * RASTER_SUBPIXEL;
+			const long long dx1 = -(long long)(y0 - y2) * RASTER_SUBPIXEL, dy1 = (long long)(x0 - x2) * RASTER_SUBPIXEL;
+			const long long dx2 = -(long long)(y1 - y0) * RASTER_SUBPIXEL, dy2 = (long long)(x1 - x0) * RASTER_SUBPIXEL;
+
+			const float invArea = 1.0f / (float)area;
+			const float dz1 = v1.z - v0.z, dz2 = v2.z - v0.z;
+			const float dw1 = v1.iw - v0.iw, dw2 = v2.iw - v0.iw;
+			const float dr1 = v1.r - v0.r, dr2 = v2.r - v0.r;
+			const float dg1 = v1.g - v0.g, dg2 = v2.g - v0.g;
+			const float db1 = v1.b - v0.b, db2 = v2.b - v0.b;
+
+			for (int y = py0; y <= py1; y++) {
+				unsigned int* color = &m_color[(size_t)y * m_width];
+				float* depth = &m_depth[(size_t)y * m_width];
+				long long w0 = e0, w1 = e1, w2 = e2;
+				for (int x = px0; x <= px1; x++) {
+					if ((w0 | w1 | w2) >= 0) {
+						const float f1 = (float)w1 * invArea, f2 = (float)w2 * invArea;
+						const float z = v0.z + f1 * dz1 + f2 * dz2;
+						if (z <= depth[x] && z <= 1.0f) {
+							const float iw = 1.0f / (v0.iw + f1 * dw1 + f2 * dw2);
+							depth[x] = z;
+							color[x] = pack((v0.r + f1 * dr1 + f2 * dr2) * iw, (v0.g + f1 * dg1 + f2 * dg2) * iw,
+								(v0.b + f1 * db1 + f2 * db2) * iw);
+						}
+					}
+					w0 += dx0;
+					w1 += dx1;
+					w2 += dx2;
+				}
+				e0 += dy0;
+				e1 += dy1;
+				e2 += dy2;
+			}
+		}
+	}
+
+	// the points after all triangles, as D3D gets them after the items
+	const float half = m_frame->pointSize / 2;
+	const std::vector<int>& points = m_pointBins[tile];
+	for (size_t n = 0; n < points.size(); n++) {
+		const Vertex& v = m_points[points[n]];
+		const unsigned int c = pack(v.r, v.g, v.b);
+		const int px0 = std::max((int)ceilf(v.x - half - 0.5f), tileX0), px1 = std::min((int)ceilf(v.x + half - 0.5f) - 1, tileX1);
+		const int py0 = std::max((int)ceilf(v.y - half - 0.5f), tileY0), py1 = std::min((int)ceilf(v.y + half - 0.5f) - 1, tileY1);
+		for (int y = py0; y <= py1; y++) {
+			unsigned int* color = &m_color[(size_t)y * m_width];
+			float* depth = &m_depth[(size_t)y * m_width];
+			for (int x = px0; x <= px1; x++) {
+				if (v.z <= depth[x]) {
+					depth[x] = v.z;
+					color[x] = c;
+				}
+			}
+		}
+	}
+}
+
+bool sim::Rasterizer::writeImage(const char* path) const
+{
+	return sim::writeImage(path, m_color.data(), m_width, m_height);
+}
+
+bool sim::writeImage(const char* path, const unsigned int* pixels, int width, int height)
+{
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) return false;
+	fprintf(f, "P6\n%d %d\n255\n", width, height);
+	std::vector<unsigned char> row(3 * width);
+	bool ok = true;
+	for (int y = 0; y < height && ok; y++) {
+		for (int x = 0; x < width; x++) {
+			unsigned int p = pixels[(size_t)y * width + x];
+			row[3 * x] = (unsigned char)(p >> 16);
+			row[3 * x + 1] = (unsigned char)(p >> 8);
+			row[3 * x + 2] = (unsigned char)p;
+		}
+		ok = fwrite(row.data(), 1, row.size(), f) == row.size();
+	}
+	return fclose(f) == 0 && ok;
+}
+
+// the next number of a PPM header, after white space and comments
+static bool readNumber(FILE* f, int& value)
+{
+	int c = fgetc(f);
+	for (;;) {
+		if (c == '#') {
+			while (c != '\n' && c != EOF) c = fgetc(f);
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			c = fgetc(f);
+		}
+		else {
+			break;
+		}
+	}
+	if (c < '0' || c > '9') return false;
+	value = 0;
+	while (c >= '0' && c <= '9') {
+		if (value > 100000) return false;
+		value = value * 10 + (c - '0');
+		c = fgetc(f);
+	}
+	// one white space character ends the number, the pixels start after the last one
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool sim::readImage(const char* path, std::vector<unsigned int>& pixels, int& width, int& height)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) return false;
+	int maxValue = 0;
+	bool ok = fgetc(f) == 'P' && fgetc(f) == '6' && readNumber(f, width) && readNumber(f, height) &&
+		readNumber(f, maxValue) && maxValue == 255 && width > 0 && height > 0;
+	if (ok) {
+		std::vector<unsigned char> row(3 * width);
+		pixels.resize((size_t)width * height);
+		for (int y = 0; y < height && ok; y++) {
+			ok = fread(row.data(), 1, row.size(), f) == row.size();
+			for (int x = 0; x < width && ok; x++) {
+				pixels[(size_t)y * width + x] = 0xff000000u | (row[3 * x] << 16) | (row[3 * x + 1] << 8) | row[3 * x + 2];
+			}
+		}
+	}
+	fclose(f);
+	return ok;
+}
+
+int sim::compareImages(const unsigned int* a, const unsigned int* b, int count, int tolerance, int* maxDelta)
+{
+	int differ = 0, largest = 0;
+	for (int i = 0; i < count; i++) {
+		int delta = 0;
+		for (int shift = 0; shift < 24; shift += 8) {
+			int d = abs((int)((a[i] >> shift) & 0xff) - (int)((b[i] >> shift) & 0xff));
+			delta = std::max(delta, d);
+		}
+		largest = std::max(largest, delta);
+		if (delta > tolerance) differ++;
+	}
+	if (maxDelta != NULL) *maxDelta = largest;
+	return differ;
+}
@@ -0,0 +1,133 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simRaster.h
+//
+// Desc: CPU rasterizer for RenderFrames (simRender.h): renders frames into images without
+//       a GPU, for golden image tests and for rendering recorded games offline
+//       (simRunner -render / -golden). It draws what the fixed function pipeline of the
+//       game draws: the single point light evaluated per vertex (ambient, diffuse and
+//       specular as D3DLIGHT_POINT and D3DMATERIAL9 define them), Gouraud shading with
+//       perspective correct colors, a depth buffer, back faces culled and the
+//       particles as square points.
+//
+//       Two passes, both split over the threads of a JobSystem:
+//       - geometry: the items in runs of RASTER_ITEM_GRAIN. Vertices are transformed and
+//         lit, triangles clipped at the near plane, culled, and binned to the tiles of
+//         RASTER_TILE x RASTER_TILE pixels they cover. Every run has its own bins.
+//       - tiles: every tile clears its pixels and draws its triangles, the ones of run 0
+//         first, then run 1 and so on, so in item order, then its points.
+//       A tile is only written by one thread, and what it draws does not depend on how the
+//       work was split: the image is the same bits for any number of threads.
+//
+//       Edges are evaluated in 28.4 fixed point with the top-left rule of Direct3D, so
+//       triangles that share an edge neither leave gaps nor draw its pixels twice.
+//
+//       Images are binary PPM files (P6, 8 bits per channel).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simRasterH__
+#define __simRasterH__
+
+#include "simRender.h"
+#include <vector>
+
+#define RASTER_TILE       64             // tile size in pixels
+#define RASTER_ITEM_GRAIN 2              // items per geometry job
+#define RASTER_SUBPIXEL   16             // fixed point steps per pixel
+
+// frame files of simRunner -render / -golden, by World::ticks
+#define RASTER_FILE_FORMAT "%s/frame%08u.ppm"
+
+namespace sim
+{
+	class JobSystem;
+
+	class Rasterizer
+	{
+	public:
+		Rasterizer(void);
+
+		// draws frame into the image of frame.width x frame.height, on the threads of
+		// jobs (NULL: on the calling thread)
+		void render(const RenderFrame& frame, JobSystem* jobs = NULL);
+
+		int getWidth(void) const { return m_width; }
+		int getHeight(void) const { return m_height; }
+		// rows from the top, 0xffRRGGBB
+		const unsigned int* getPixels(void) const { return m_color.data(); }
+		// triangles of the last frame that reached the tiles (not culled or clipped away)
+		int getTriangleCount(void) const { return m_triangles; }
+
+		bool writeImage(const char* path) const;
+
+	private:
+		Rasterizer(const Rasterizer&);
+		Rasterizer& operator=(const Rasterizer&);
+
+		// a RenderMesh tessellated: vertices with normals, triangles clockwise seen from
+		// outside (the front faces of Direct3D)
+		struct Mesh
+		{
+			std::vector<float> position;     // x, y, z
+			std::vector<float> normal;
+			std::vector<int>   index;        // 3 per triangle
+		};
+
+		// a vertex in front of the near plane: pixels, depth, 1 / w and the color over w
+		struct Vertex
+		{
+			float x, y, z, iw;
+			float r, g, b;
+		};
+
+		struct ClipVertex
+		{
+			float x, y, z, w;                // clip space
+			float r, g, b;
+		};
+
+		// the output of a geometry job
+		struct Run
+		{
+			std::vector<Vertex>     vertices;
+			std::vector<int>        triangles;   // 3 vertex indices each
+			std::vector<std::vector<int> > bins; // per tile: the triangles on it
+			std::vector<ClipVertex> clip;        // scratch: the vertices of one item
+		};
+
+		static void geometryTask(void* context, int part, int begin, int end);
+		static void tileTask(void* context, int part, int begin, int end);
+
+		void tessellate(const RenderFrame& frame);
+		void geometry(int part, int begin, int end);
+		void emit(Run& run, const ClipVertex* a, const ClipVertex* b, const ClipVertex* c);
+		void bin(Run& run, int i0, int i1, int i2);
+		void drawTile(int tile);
+
+		const RenderFrame* m_frame;
+		int m_width, m_height;
+		int m_tilesX, m_tilesY;
+		Mat4 m_viewProjection;
+
+		std::vector<RenderMesh> m_meshKeys;  // the frame meshes m_meshes were made of
+		std::vector<Mesh>       m_meshes;
+		std::vector<Run>        m_runs;
+		std::vector<Vertex>     m_points;    // the frame points in front of the near plane
+		std::vector<std::vector<int> > m_pointBins;
+		int m_triangles;
+
+		std::vector<unsigned int> m_color;
+		std::vector<float>        m_depth;
+	};
+
+	// binary PPM files. readImage gives 0xffRRGGBB pixels.
+	bool writeImage(const char* path, const unsigned int* pixels, int width, int height);
+	bool readImage(const char* path, std::vector<unsigned int>& pixels, int& width, int& height);
+
+	// the pixels of a and b with a channel that differs by more than tolerance. maxDelta
+	// gets the largest channel difference.
+	int compareImages(const unsigned int* a, const unsigned int* b, int count, int tolerance, int* maxDelta);
+}
+
+#endif // __simRasterH__
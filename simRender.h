@@ -0,0 +1,151 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simRender.h
+//
+// Desc: What a frame shows, independent of the backend that draws it. A RenderFrame is the
+//       camera, the point light, a table of meshes and the items drawn with them (a mesh,
+//       a world transform and a material color), plus the particles as points. The game
+//       draws it with Direct3D (virtualLego.cpp), the CPU rasterizer of simRaster.h draws
+//       the same frame into an image, without a GPU.
+//
+//       Meshes are given by their shape and size the way D3DXCreateBox / Sphere / Cylinder
+//       take them; every backend tessellates them itself. Materials are the ones of the
+//       game: ambient, diffuse and specular all of the item color, no emission.
+//
+//       Matrices are Direct3D ones: row vectors (v * M), left handed, clip z in [0, w].
+//
+//       renderSetup() fills in the parts that do not move (camera, light, plane and walls),
+//       renderUpdate() the bricks, balls and particles of every frame, both from a World.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simRenderH__
+#define __simRenderH__
+
+#include "simCore.h"
+#include "simLevel.h"
+#include <vector>
+
+// the view of the game (Setup in virtualLego.cpp)
+#define RENDER_EYE_X      9.0f
+#define RENDER_EYE_Y      9.0f
+#define RENDER_EYE_Z      0.0f
+#define RENDER_FOV        (3.14159265f / 4)
+#define RENDER_NEAR       1.0f
+#define RENDER_FAR        100.0f
+#define RENDER_CLEAR      0x00afafafu
+
+// tessellation of the meshes, as the game creates them
+#define RENDER_BALL_SLICES    50         // balls and sphere bricks
+#define RENDER_CAPSULE_SLICES 20
+#define RENDER_CAPSULE_STACKS 4
+#define RENDER_LIGHT_RADIUS   0.1f       // the sphere drawn where the light is
+#define RENDER_LIGHT_SLICES   10
+
+// material power of the objects and of the light sphere (d3d::WHITE_MTRL)
+#define RENDER_POWER       5.0f
+#define RENDER_LIGHT_POWER 2.0f
+
+// bricks per job when renderUpdate builds the items in parallel
+#define RENDER_ITEM_GRAIN 64
+
+namespace sim
+{
+	class JobSystem;
+	class ParticlePool;
+
+	struct Mat4
+	{
+		float m[4][4];
+	};
+
+	Mat4 matIdentity(void);
+	Mat4 matTranslation(float x, float y, float z);
+	Mat4 matMultiply(const Mat4& a, const Mat4& b);     // a then b
+	Mat4 matLookAtLH(const Vec3& eye, const Vec3& at, const Vec3& up);
+	Mat4 matPerspectiveFovLH(float fovY, float aspect, float zNear, float zFar);
+
+	struct Color4
+	{
+		float r, g, b, a;
+	};
+
+	Color4 colorOf(unsigned int argb);   // a D3DCOLOR, like D3DXCOLOR(argb)
+
+	enum RenderMeshKind
+	{
+		MESH_BOX,                        // size: width (x), height (y), depth (z)
+		MESH_SPHERE,                     // size[0]: radius; around the z axis
+		MESH_CYLINDER,                   // size[0]: radius, size[1]: length along z
+	};
+
+	struct RenderMesh
+	{
+		int   kind;                      // RenderMeshKind
+		float size[3];
+		int   slices, stacks;            // sphere and cylinder
+	};
+
+	struct RenderItem
+	{
+		int          mesh;               // index into RenderFrame::meshes
+		unsigned int color;              // D3DCOLOR of the material
+		float        power;              // specular power
+		Mat4         world;
+	};
+
+	// a point of the particles, laid out as a D3DFVF_XYZ | D3DFVF_DIFFUSE vertex
+	struct RenderPoint
+	{
+		float        x, y, z;
+		unsigned int color;
+	};
+
+	// a point light like D3DLIGHT_POINT, ambient, diffuse and specular of one color each
+	struct RenderLight
+	{
+		Vec3   position;
+		Color4 diffuse;
+		Color4 specular;
+		Color4 ambient;
+		float  range;
+		float  attenuation0, attenuation1, attenuation2;
+	};
+
+	struct RenderFrame
+	{
+		int          width, height;      // of the target
+		Mat4         view;
+		Mat4         projection;
+		Vec3         eye;                // camera position, for the specular highlights
+		RenderLight  light;
+		unsigned int clearColor;         // D3DCOLOR
+
+		std::vector<RenderMesh>  meshes;
+		std::vector<RenderItem>  items;  // drawn in order
+		std::vector<RenderPoint> points; // unlit, drawn after the items
+		float pointSize;                 // in pixels
+
+		// set by renderSetup for renderUpdate
+		int fixedItems;                  // the plane and the walls, items [0, fixedItems)
+		int brickMesh[BRICK_SHAPES];
+		int ballMesh;
+		int lightMesh;
+
+		// the index of mesh in meshes, added when it is not there yet
+		int addMesh(const RenderMesh& mesh);
+	};
+
+	// camera, light and meshes of the game for a width x height target, and the plane and
+	// walls of world in the colors of level (grey where level has no such wall)
+	void renderSetup(RenderFrame& frame, const World& world, const Level& level, int width, int height);
+
+	// the bricks in play, the balls and the light sphere after the fixed items, and the
+	// particles of particles (NULL for none). the control ball and the moving ball are
+	// drawn at the given positions, which may be interpolated. with jobs the brick items
+	// are built in parallel.
+	void renderUpdate(RenderFrame& frame, const World& world, const Vec3& controlball, const Vec3& moveball,
+		const ParticlePool* particles, JobSystem* jobs);
+}
+
+#endif // __simRenderH__
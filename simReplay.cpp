@@ -0,0 +1,237 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simReplay.cpp
+//
+// Desc: Input recording and replay.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simReplay.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	// FNV-1a, 64 bit
+	struct Hasher
+	{
+		Hasher(void) : hash(14695981039346656037ull) {}
+
+		void bytes(const void* data, size_t size)
+		{
+			const unsigned char* p = (const unsigned char*)data;
+			for (size_t i = 0; i < size; i++) hash = (hash ^ p[i]) * 1099511628211ull;
+		}
+		void add(unsigned int v) { bytes(&v, sizeof(v)); }
+		void add(float v) { bytes(&v, sizeof(v)); }
+		void add(const sim::Sphere& s)
+		{
+			sim::Vec3 c = s.getCenter();
+			add(c.x); add(c.y); add(c.z);
+			add((float)s.getVelocity_X()); add((float)s.getVelocity_Z());
+		}
+
+		unsigned long long hash;
+	};
+
+	void putVarint(std::vector<unsigned char>& out, unsigned int v)
+	{
+		while (v >= 0x80) {
+			out.push_back((unsigned char)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((unsigned char)v);
+	}
+
+	bool getVarint(const std::vector<unsigned char>& in, size_t& pos, unsigned int& v)
+	{
+		v = 0;
+		for (int shift = 0; shift < 35; shift += 7) {
+			if (pos >= in.size()) return false;
+			unsigned char b = in[pos++];
+			v |= (unsigned int)(b & 0x7f) << shift;
+			if (!(b & 0x80)) return true;
+		}
+		return false;
+	}
+
+	// reads the next of the left inputs into next. pending is false once all are read;
+	// returns false at a corrupt stream.
+	bool readInput(const std::vector<unsigned char>& in, size_t& pos, unsigned int& left, sim::Input& next, bool& pending)
+	{
+		pending = left > 0;
+		if (!pending) return true;
+		left--;
+
+		unsigned int delta;
+		if (!getVarint(in, pos, delta) || pos >= in.size()) return false;
+		next.tick += delta;
+		next.type = in[pos++];
+		next.value = 0.0f;
+		if (next.type == sim::INPUT_MOVE || next.type == sim::INPUT_SPAWN) {
+			if (pos + sizeof(float) > in.size()) return false;
+			memcpy(&next.value, &in[pos], sizeof(float));
+			pos += sizeof(float);
+			if (!std::isfinite(next.value)) return false;
+			// the count goes through an int conversion and a loop of that many balls
+			if (next.type == sim::INPUT_SPAWN && (next.value < 0.0f || next.value > REPLAY_MAX_SPAWN)) return false;
+		}
+		return next.type < sim::INPUT_TYPE_COUNT;
+	}
+}
+
+void sim::applyInput(World& world, const Input& input)
+{
+	switch (input.type) {
+	case INPUT_MOVE:
+		world.moveControl(input.value);
+		break;
+	case INPUT_LAUNCH:
+		world.launch();
+		break;
+	case INPUT_RESET:
+		world.resetLevel();
+		break;
+	case INPUT_SPAWN:
+		world.spawnBalls((int)input.value);
+		break;
+	}
+}
+
+unsigned long long sim::worldHash(const World& world)
+{
+	Hasher h;
+	h.add(world.ticks);
+	h.add((unsigned int)world.restarts);
+	h.add((unsigned int)world.game_start);
+	h.add(world.controlball);
+	h.add(world.moveball);
+	h.add((unsigned int)world.brickCount);
+	for (int i = 0; i < world.brickCount; i++) {
+		// membership only: the order of the live set depends on the order of removals
+		h.add((unsigned int)world.liveBricks.contains(i));
+		h.add(world.sphere[i]);
+		// only bricks with hits to spare, so levels of one hit bricks hash as they did
+		if (world.sphere.hits[i] != 1) h.add((unsigned int)world.sphere.hits[i]);
+	}
+	// only in multi-ball, so single ball hashes stay as they were
+	if (!world.balls.empty()) {
+		h.add((unsigned int)world.balls.size());
+		for (size_t k = 0; k < world.balls.size(); k++) h.add(world.balls[k]);
+	}
+	return h.hash;
+}
+
+// -----------------------------------------------------------------------------
+// InputRecorder
+// -----------------------------------------------------------------------------
+
+void sim::InputRecorder::start(const World& world, unsigned long long levelHash, float stepTime)
+{
+	memset(&m_header, 0, sizeof(m_header));
+	memcpy(m_header.magic, REPLAY_MAGIC, sizeof(m_header.magic));
+	m_header.version = REPLAY_VERSION;
+	m_header.continuous = world.continuous ? 1 : 0;
+	m_header.stepTime = stepTime;
+	m_header.launchSpeed = world.launchSpeed;
+	m_header.math = mathMode();
+	m_header.levelHash = levelHash;
+
+	m_stream.clear();
+	m_lastTick = world.ticks;
+	m_recording = true;
+}
+
+void sim::InputRecorder::record(const Input& input)
+{
+	if (!m_recording) return;
+
+	putVarint(m_stream, input.tick - m_lastTick);
+	m_stream.push_back((unsigned char)input.type);
+	if (input.type == INPUT_MOVE || input.type == INPUT_SPAWN) {
+		unsigned char bytes[sizeof(float)];
+		memcpy(bytes, &input.value, sizeof(float));
+		m_stream.insert(m_stream.end(), bytes, bytes + sizeof(float));
+	}
+	m_lastTick = input.tick;
+	m_header.inputCount++;
+}
+
+bool sim::InputRecorder::stop(const World& world, const char* path)
+{
+	if (!m_recording) return false;
+	m_recording = false;
+
+	m_header.finalTick = world.ticks;
+	m_header.finalHash = worldHash(world);
+	m_header.streamBytes = m_stream.size();
+
+	FILE* fp = fopen(path, "wb");
+	if (fp == NULL) return false;
+	bool ok = fwrite(&m_header, sizeof(m_header), 1, fp) == 1;
+	if (!m_stream.empty()) ok = fwrite(&m_stream[0], 1, m_stream.size(), fp) == m_stream.size() && ok;
+	return fclose(fp) == 0 && ok;
+}
+
+// -----------------------------------------------------------------------------
+// Replay
+// -----------------------------------------------------------------------------
+
+bool sim::Replay::load(const char* path)
+{
+	m_stream.clear();
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL) {
+		m_error = "can not open the file";
+		return false;
+	}
+
+	m_error = NULL;
+	if (fread(&m_header, sizeof(m_header), 1, fp) != 1) m_error = "truncated header";
+	else if (memcmp(m_header.magic, REPLAY_MAGIC, sizeof(m_header.magic)) != 0) m_error = "not a recording";
+	else if (m_header.version != REPLAY_VERSION) m_error = "unsupported recording version";
+	else if (m_header.stepTime <= 0.0f) m_error = "bad step time";
+	else if (m_header.math != (unsigned int)mathMode()) m_error = "recorded in another math mode";
+	else {
+		// the stream size is checked against the file before anything is allocated for it
+		long start = ftell(fp);
+		long end = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1;
+		if (start < 0 || end < start || fseek(fp, start, SEEK_SET) != 0) m_error = "can not read the file";
+		else if (m_header.streamBytes > (unsigned long long)(end - start)) m_error = "truncated input stream";
+		else {
+			m_stream.resize((size_t)m_header.streamBytes);
+			if (!m_stream.empty() && fread(&m_stream[0], 1, m_stream.size(), fp) != m_stream.size()) m_error = "truncated input stream";
+		}
+	}
+	fclose(fp);
+	return m_error == NULL;
+}
+
+bool sim::Replay::run(World& world, ReplayStepFunc onStep, void* context) const
+{
+	world.continuous = m_header.continuous != 0;
+	world.launchSpeed = m_header.launchSpeed;
+
+	size_t pos = 0;
+	unsigned int left = m_header.inputCount;
+	bool pending;
+	Input next;
+	next.tick = world.ticks;
+	if (!readInput(m_stream, pos, left, next, pending)) return false;
+
+	for (;;) {
+		// inputs that arrived before the next step, including the ones after the last
+		// step: those were applied before the recording stopped
+		while (pending && next.tick == world.ticks) {
+			applyInput(world, next);
+			if (!readInput(m_stream, pos, left, next, pending)) return false;
+		}
+		// an input stamped with a tick already passed means a corrupt stream
+		if (pending && next.tick < world.ticks) return false;
+		if (world.ticks >= m_header.finalTick) break;
+		world.step(m_header.stepTime);
+		if (onStep != NULL) onStep(context, world);
+	}
+	return !pending;
+}
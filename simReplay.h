@@ -0,0 +1,111 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simReplay.h
+//
+// Desc: Input recording and replay. Every input goes through applyInput stamped with the
+//       World::ticks it arrived at, so it lands between the same two steps on replay. A
+//       recording starts from a freshly set up world and ends with a hash of the final
+//       state; Replay steps a world through the same inputs at full speed and the hashes
+//       have to match. Only a core built in the same math mode (simMath.h) can replay it.
+//
+//       File: ReplayHeader, then header.streamBytes of inputs. each input is the tick delta
+//       to the previous one (LEB128 varint), the type byte and, for INPUT_MOVE and
+//       INPUT_SPAWN, the float. A value that is not finite, or an INPUT_SPAWN count outside
+//       [0, REPLAY_MAX_SPAWN], makes the stream corrupt.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simReplayH__
+#define __simReplayH__
+
+#include "simCore.h"
+#include <vector>
+
+#define REPLAY_MAGIC "SIMREC1"          // 8 bytes with the terminator
+#define REPLAY_VERSION 2            // 2: math mode
+#define REPLAY_MAX_SPAWN 1024       // most balls one INPUT_SPAWN may add
+
+namespace sim
+{
+	enum InputType
+	{
+		INPUT_MOVE,                      // World::moveControl(value)
+		INPUT_LAUNCH,                    // World::launch()
+		INPUT_RESET,                     // World::resetLevel()
+		INPUT_SPAWN,                     // World::spawnBalls(value)
+		INPUT_TYPE_COUNT
+	};
+
+	struct Input
+	{
+		unsigned int tick;               // World::ticks when it arrived, applied before the next step
+		int   type;                      // InputType
+		float value;
+	};
+
+	void applyInput(World& world, const Input& input);
+
+	// FNV-1a over the simulation state: balls, bricks, live set, ticks and game flags
+	unsigned long long worldHash(const World& world);
+
+	struct ReplayHeader
+	{
+		char         magic[8];
+		unsigned int version;
+		unsigned int continuous;         // World::continuous
+		float        stepTime;           // timeDelta of every step
+		float        launchSpeed;        // World::launchSpeed
+		unsigned int math;               // MathMode of the core that recorded
+		unsigned int reserved;
+		unsigned long long levelHash;    // Level::getHash of the level played
+		unsigned int inputCount;
+		unsigned int finalTick;          // World::ticks at the end
+		unsigned long long finalHash;    // worldHash at the end
+		unsigned long long streamBytes;
+	};
+
+	class InputRecorder
+	{
+	public:
+		InputRecorder(void) : m_recording(false), m_lastTick(0) {}
+
+		// world has to be freshly set up (ticks 0) and only stepped by stepTime from here on
+		void start(const World& world, unsigned long long levelHash, float stepTime);
+		void record(const Input& input);
+		bool stop(const World& world, const char* path);   // writes the file
+
+		bool isRecording(void) const { return m_recording; }
+		int getInputCount(void) const { return (int)m_header.inputCount; }
+
+	private:
+		bool          m_recording;
+		ReplayHeader  m_header;
+		unsigned int  m_lastTick;
+		std::vector<unsigned char> m_stream;
+	};
+
+	typedef void (*ReplayStepFunc)(void* context, const World& world);
+
+	class Replay
+	{
+	public:
+		Replay(void) : m_error(NULL) {}
+
+		bool load(const char* path);
+		const char* getError(void) const { return m_error; }
+		const ReplayHeader& getHeader(void) const { return m_header; }
+
+		// steps a world, set up with the recorded level, to the final tick with the recorded
+		// mode and launch speed. false when the stream is corrupt; compare worldHash(world)
+		// against the header afterwards. onStep, when given, sees the world after every
+		// step (to render the recording, simRunner -replay -render).
+		bool run(World& world, ReplayStepFunc onStep = NULL, void* context = NULL) const;
+
+	private:
+		ReplayHeader m_header;
+		std::vector<unsigned char> m_stream;
+		const char*  m_error;
+	};
+}
+
+#endif // __simReplayH__
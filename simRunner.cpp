@@ -0,0 +1,495 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simRunner.cpp
+//
+// Desc: Headless batch runner for the simulation core. Steps the world N frames with a fixed
+//       timestep, with an autopilot on the control ball, and reports frames per second.
+//
+//       Build (Linux):  g++ -std=c++14 -O2 -pthread -o simRunner simCore.cpp simKernel.cpp simGrid.cpp
+//                           simSweep.cpp simProfile.cpp simEvent.cpp simLevel.cpp simReplay.cpp simThreads.cpp
+//                           simJobs.cpp simMath.cpp simWallTree.cpp simImpact.cpp
+//                           simShapes.cpp simStream.cpp simParticles.cpp simRender.cpp simRaster.cpp
+//                           simRunner.cpp
+//                       (add -DSIM_PROFILE for the per-stage timings of -profile,
+//                        -DSIM_DETERMINISTIC for the float only math of simMath.h)
+//       Usage:          simRunner [-frames N] [-dt timestep] [-speed S] [-ccd | -toi] [-profile out.csv|out.json]
+//                                 [-events out.txt|out.bin] [-eventmask mask] [-level file]
+//                                 [-record out.rec | -replay in.rec] [-balls N] [-threads T]
+//                                 [-stream N [-seed S | -chunks dir] [-lockstep]] [-particles]
+//                                 [-render dir] [-golden dir [-tolerance T]] [-every N] [-size WxH]
+//
+//       -record saves the autopilot input, -replay runs a recording (also one of the game,
+//       F4) as fast as possible and checks the final state against the recorded hash.
+//       -balls keeps N extra balls in play (spawned again whenever all are gone, at most
+//       REPLAY_MAX_SPAWN), their collision work split over T threads. -toi runs the event
+//       driven mode of simImpact.h (not with -record / -replay, which are frame stepped).
+//       -stream plays a streamed level of N chunks (simStream.h), generated from seed S
+//       (1 by default) or read from the chunk files of dir, and reports the chunk loads.
+//       Not with -level, -record or -replay; not repeatable without -lockstep.
+//       -particles runs the debris effect of simParticles.h along and reports its cost.
+//       -render draws every Nth step (-every, 60 by default) with the CPU rasterizer of
+//       simRaster.h on T threads and writes the images to dir (RASTER_FILE_FORMAT, by tick),
+//       -golden compares them against the images of dir instead and fails when a pixel is
+//       off by more than T (-tolerance, 2 by default) or an image is missing. Both work
+//       with -replay, which renders a recorded game.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simCore.h"
+#include "simEvent.h"
+#include "simImpact.h"
+#include "simJobs.h"
+#include "simKernel.h"
+#include "simParticles.h"
+#include "simProfile.h"
+#include "simRaster.h"
+#include "simReplay.h"
+#include "simStream.h"
+#include "simThreads.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// timeDelta of a 60Hz frame as d3d::EnterMsgLoop computes it (milliseconds * 0.0007)
+#define DEFAULT_TIMESTEP (16.0f * 0.0007f)
+#define DEFAULT_FRAMES 1000000
+
+// -render / -golden: every RENDER_EVERY steps (one a second at 60Hz), at the size of the game
+#define RENDER_EVERY     60
+#define RENDER_WIDTH     1024
+#define RENDER_HEIGHT    768
+#define RENDER_TOLERANCE 2
+
+// keyboard speed of the control ball (VK_LEFT / VK_RIGHT)
+#define CONTROL_STEP 0.1f
+// the autopilot hits the ball off center so it does not bounce on a single line
+#define AIM_OFFSET 0.15f
+
+static void usage(const char* prog)
+{
+	fprintf(stderr, "usage: %s [-frames N] [-dt timestep] [-speed S] [-ccd | -toi] [-profile out.csv|out.json]\n"
+		"       [-events out.txt|out.bin] [-eventmask mask] [-level file]\n"
+		"       [-record out.rec | -replay in.rec] [-balls N] [-threads T]\n"
+		"       [-stream N [-seed S | -chunks dir] [-lockstep]] [-particles]\n"
+		"       [-render dir] [-golden dir [-tolerance T]] [-every N] [-size WxH]\n", prog);
+}
+
+// the event driven mode (-toi), NULL when the world is frame stepped
+static sim::ImpactSim* g_impact = NULL;
+
+// applies an input the way the game does, recording it when recording
+static void input(sim::World& world, sim::InputRecorder& recorder, int type, float value)
+{
+	sim::Input in;
+	in.tick = world.ticks;
+	in.type = type;
+	in.value = value;
+	float controlZ = world.controlball.getCenter().z;
+	sim::applyInput(world, in);
+	recorder.record(in);
+
+	if (g_impact != NULL) {
+		if (type != sim::INPUT_MOVE) g_impact->sync();
+		else if (world.controlball.getCenter().z != controlZ) g_impact->controlMoved();
+	}
+}
+
+// keeps the game running: launches the ball and moves the control ball under it
+static void autopilot(sim::World& world, sim::InputRecorder& recorder, int ballCount)
+{
+	if (ballCount > 0 && world.balls.empty()) input(world, recorder, sim::INPUT_SPAWN, (float)ballCount);
+
+	if (!world.game_start) {
+		input(world, recorder, sim::INPUT_LAUNCH, 0.0f);
+		return;
+	}
+
+	float dz = world.moveball.getCenter().z + AIM_OFFSET - world.controlball.getCenter().z;
+	if (dz > CONTROL_STEP) dz = CONTROL_STEP;
+	if (dz < -CONTROL_STEP) dz = -CONTROL_STEP;
+	input(world, recorder, sim::INPUT_MOVE, dz);
+}
+
+// -render / -golden state, renderStep is called after every step
+struct RenderRun
+{
+	sim::Rasterizer      raster;
+	sim::RenderFrame     frame;
+	sim::JobSystem*      jobs;
+	const sim::ParticlePool* particles;  // NULL without -particles
+	const char* renderPath;
+	const char* goldenPath;
+	int         every;
+	int         tolerance;
+
+	long        frames;                  // rendered
+	long long   triangles;
+	sim::Histogram time;
+	long        compared;
+	long        differ;                  // golden frames that differ or are missing
+	int         maxDelta;
+	bool        writeFailed;
+};
+
+static void renderStep(void* context, const sim::World& world)
+{
+	RenderRun& r = *(RenderRun*)context;
+	if (world.ticks % r.every != 0) return;
+
+	sim::renderUpdate(r.frame, world, world.controlball.getCenter(), world.moveball.getCenter(), r.particles, r.jobs);
+	long long t0 = sim::profileNow();
+	r.raster.render(r.frame, r.jobs);
+	r.time.record(sim::profileNow() - t0);
+	r.frames++;
+	r.triangles += r.raster.getTriangleCount();
+
+	char path[1024];
+	if (r.renderPath != NULL) {
+		snprintf(path, sizeof(path), RASTER_FILE_FORMAT, r.renderPath, world.ticks);
+		if (!r.raster.writeImage(path)) r.writeFailed = true;
+	}
+	if (r.goldenPath != NULL) {
+		std::vector<unsigned int> golden;
+		int width = 0, height = 0, delta = 0;
+		snprintf(path, sizeof(path), RASTER_FILE_FORMAT, r.goldenPath, world.ticks);
+		r.compared++;
+		if (!sim::readImage(path, golden, width, height) || width != r.raster.getWidth() ||
+			height != r.raster.getHeight()) {
+			fprintf(stderr, "-golden: %s: missing or not %dx%d\n", path, r.raster.getWidth(), r.raster.getHeight());
+			r.differ++;
+			return;
+		}
+		int pixels = sim::compareImages(golden.data(), r.raster.getPixels(), width * height, r.tolerance, &delta);
+		if (delta > r.maxDelta) r.maxDelta = delta;
+		if (pixels > 0) {
+			fprintf(stderr, "-golden: %s: %d pixels differ, by up to %d\n", path, pixels, delta);
+			r.differ++;
+		}
+	}
+}
+
+// a ball outside of the walls went through one of them
+static bool escaped(const sim::World& world)
+{
+	if (world.wallCount < 3) return false;
+	sim::Vec3 ball = world.moveball.getCenter();
+	return ball.z > world.legowall[0].getCenter().z || ball.z < world.legowall[1].getCenter().z ||
+		ball.x < world.legowall[2].getCenter().x;
+}
+
+int main(int argc, char* argv[])
+{
+	long frames = DEFAULT_FRAMES;
+	float timeDelta = DEFAULT_TIMESTEP;
+	float speed = 0.0f;
+	bool continuous = false;
+	bool impacts = false;
+	const char* profilePath = NULL;
+	const char* eventPath = NULL;
+	unsigned int eventMask = EVENT_MASK_ALL;
+	const char* levelPath = NULL;
+	const char* recordPath = NULL;
+	const char* replayPath = NULL;
+	int ballCount = 0;
+	int threads = 1;
+	int streamChunks = 0;
+	unsigned int streamSeed = 1;
+	const char* chunkPath = NULL;
+	bool lockstep = false;
+	bool particles = false;
+	const char* renderPath = NULL;
+	const char* goldenPath = NULL;
+	int renderEvery = RENDER_EVERY;
+	int renderWidth = RENDER_WIDTH, renderHeight = RENDER_HEIGHT;
+	int tolerance = RENDER_TOLERANCE;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+			frames = strtol(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-dt") == 0 && i + 1 < argc) {
+			timeDelta = (float)strtod(argv[++i], NULL);
+		}
+		else if (strcmp(argv[i], "-speed") == 0 && i + 1 < argc) {
+			speed = (float)strtod(argv[++i], NULL);
+		}
+		else if (strcmp(argv[i], "-ccd") == 0) {
+			continuous = true;
+		}
+		else if (strcmp(argv[i], "-toi") == 0) {
+			impacts = true;
+		}
+		else if (strcmp(argv[i], "-profile") == 0 && i + 1 < argc) {
+			profilePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-events") == 0 && i + 1 < argc) {
+			eventPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-eventmask") == 0 && i + 1 < argc) {
+			eventMask = (unsigned int)strtoul(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "-level") == 0 && i + 1 < argc) {
+			levelPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc) {
+			recordPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-replay") == 0 && i + 1 < argc) {
+			replayPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-balls") == 0 && i + 1 < argc) {
+			ballCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-stream") == 0 && i + 1 < argc) {
+			streamChunks = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+			streamSeed = (unsigned int)strtoul(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "-chunks") == 0 && i + 1 < argc) {
+			chunkPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-lockstep") == 0) {
+			lockstep = true;
+		}
+		else if (strcmp(argv[i], "-particles") == 0) {
+			particles = true;
+		}
+		else if (strcmp(argv[i], "-render") == 0 && i + 1 < argc) {
+			renderPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-golden") == 0 && i + 1 < argc) {
+			goldenPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc) {
+			tolerance = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-every") == 0 && i + 1 < argc) {
+			renderEvery = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &renderWidth, &renderHeight) != 2) renderWidth = 0;
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (frames <= 0 || timeDelta <= 0.0f || (recordPath != NULL && replayPath != NULL) || ballCount < 0 || threads < 1 ||
+		ballCount > REPLAY_MAX_SPAWN || (impacts && (continuous || recordPath != NULL || replayPath != NULL)) || streamChunks < 0 ||
+		(streamChunks > 0 && (levelPath != NULL || recordPath != NULL || replayPath != NULL)) || renderEvery < 1 ||
+		renderWidth < 1 || renderHeight < 1 || renderWidth > 16384 || renderHeight > 16384 || tolerance < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	sim::Replay replay;
+	if (replayPath != NULL && !replay.load(replayPath)) {
+		fprintf(stderr, "-replay: %s: %s\n", replayPath, replay.getError());
+		return 1;
+	}
+
+	sim::Level level;
+	double loadSeconds = 0.0;
+	if (levelPath != NULL) {
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		bool loaded = level.load(levelPath);
+		loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		if (!loaded) {
+			fprintf(stderr, "-level: %s: %s\n", levelPath, level.getError());
+			return 1;
+		}
+	}
+	else {
+		level.makeDefault();
+	}
+
+	if (replayPath != NULL && replay.getHeader().levelHash != level.getHash()) {
+		fprintf(stderr, "-replay: %s was recorded on another level\n", replayPath);
+		return 1;
+	}
+
+	sim::WorkerPool pool(threads);
+	sim::World world;
+	sim::ChunkStreamer streamer;
+	if (streamChunks > 0) {
+		if (chunkPath != NULL) streamer.setDirectory(chunkPath);
+		else streamer.setSeed(streamSeed);
+		streamer.lockstep = lockstep;
+		if (!streamer.start(world, streamChunks)) {
+			fprintf(stderr, "-stream: between 1 and %d chunks\n", STREAM_MAX_CHUNKS);
+			return 1;
+		}
+	}
+	else {
+		world.setup(level);
+	}
+	world.continuous = continuous;
+	if (speed > 0.0f) world.launchSpeed = speed;
+	if (threads > 1) world.workers = &pool;
+
+	sim::ParticlePool particlePool;
+	sim::Histogram particleTime;
+	if (particles) {
+		world.onBrickHit = sim::ParticlePool::brickHit;
+		world.onBrickHitContext = &particlePool;
+	}
+
+	sim::ImpactSim impactSim;
+	if (impacts) {
+		impactSim.attach(world);
+		g_impact = &impactSim;
+	}
+
+	// the rasterizer runs on threads of its own, the workers of the balls wait while it draws
+	const bool rendering = renderPath != NULL || goldenPath != NULL;
+	sim::JobSystem* renderJobs = NULL;
+	RenderRun render;
+	render.jobs = NULL;
+	render.particles = particles ? &particlePool : NULL;
+	render.renderPath = renderPath;
+	render.goldenPath = goldenPath;
+	render.every = renderEvery;
+	render.tolerance = tolerance;
+	render.frames = 0;
+	render.triangles = 0;
+	render.compared = 0;
+	render.differ = 0;
+	render.maxDelta = 0;
+	render.writeFailed = false;
+	if (rendering) {
+		if (threads > 1) render.jobs = renderJobs = new sim::JobSystem(threads);
+		// the walls of a streamed level are the ones of its corridor
+		sim::Level corridor;
+		if (streamChunks > 0) corridor.makeStream(streamChunks);
+		sim::renderSetup(render.frame, world, streamChunks > 0 ? corridor : level, renderWidth, renderHeight);
+	}
+
+	sim::InputRecorder recorder;
+	if (recordPath != NULL) recorder.start(world, level.getHash(), timeDelta);
+
+	if (eventPath != NULL) {
+		sim::eventSetFilter(eventMask);
+		if (!sim::eventStart(eventPath, sim::eventFormatOf(eventPath))) {
+			fprintf(stderr, "-events: can not write %s\n", eventPath);
+			return 1;
+		}
+	}
+
+	long escapes = 0;
+	bool replayed = true;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	if (replayPath != NULL) {
+		// escapes are in the recording as resets
+		replayed = replay.run(world, rendering ? renderStep : NULL, &render);
+		frames = (long)world.ticks;
+		timeDelta = replay.getHeader().stepTime;
+		continuous = world.continuous;
+	}
+	else {
+		for (long frame = 0; frame < frames; frame++) {
+			if (streamChunks > 0 && streamer.update(world) && impacts) impactSim.sync();
+			autopilot(world, recorder, ballCount);
+			if (impacts) impactSim.advance(timeDelta);
+			else world.step(timeDelta);
+			if (rendering) renderStep(&render, world);
+			if (particles) {
+				SIM_PROFILE_SCOPE(sim::STAGE_PARTICLES);
+				long long t0 = sim::profileNow();
+				particlePool.update(timeDelta);
+				particleTime.record(sim::profileNow() - t0);
+			}
+			if (escaped(world)) {
+				// put the ball back in play so one escape is not counted every frame
+				escapes++;
+				input(world, recorder, sim::INPUT_RESET, 0.0f);
+			}
+		}
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	sim::eventStop();
+	delete renderJobs;
+
+	if (recordPath != NULL && !recorder.stop(world, recordPath)) {
+		fprintf(stderr, "-record: can not write %s\n", recordPath);
+		return 1;
+	}
+
+	double seconds = std::chrono::duration<double>(end - begin).count();
+	sim::Vec3 ball = world.moveball.getCenter();
+
+	printf("frames:      %ld\n", frames);
+	printf("timestep:    %f\n", timeDelta);
+	printf("mode:        %s\n", impacts ? "event driven" : continuous ? "continuous" : "discrete");
+	printf("math:        %s\n", sim::mathModeName(sim::mathMode()));
+	if (ballCount > 0) printf("balls:       %d + 1, %d threads\n", ballCount, threads);
+	if (levelPath != NULL) printf("level load:  %.3f ms\n", loadSeconds * 1e3);
+	printf("elapsed:     %.6f s\n", seconds);
+	printf("frames/sec:  %.0f\n", seconds > 0.0 ? frames / seconds : 0.0);
+	printf("restarts:    %ld\n", (long)world.restarts - escapes);
+	printf("escapes:     %ld\n", escapes);
+	printf("live bricks: %d / %d\n", world.liveBricks.size(), world.brickCount);
+	printf("moveball:    %f %f %f\n", ball.x, ball.y, ball.z);
+	if (impacts) printf("impacts:     %lld (%lld predictions)\n", impactSim.getImpacts(), impactSim.getPredictions());
+	if (eventPath != NULL) printf("events lost: %lld\n", sim::eventDropped());
+	if (particles) {
+		printf("particles:   %d live (peak %d of %d), %lld spawned, %lld dropped\n", particlePool.getCount(),
+			particlePool.getPeak(), particlePool.getCapacity(), particlePool.getSpawned(), particlePool.getDropped());
+		printf("particle update: mean %.0f ns, p99 %lld ns per frame (%s)\n", particleTime.getMean(),
+			particleTime.percentile(99), sim::kernelName());
+	}
+	if (streamChunks > 0) {
+		const sim::StreamStats& st = streamer.getStats();
+		printf("chunks:      %lld loaded, %lld failed, %lld dropped, %lld evicted of %d\n", st.loaded, st.failed,
+			st.dropped, st.evicted, streamer.getChunkCount());
+		printf("chunk load:  mean %.0f us, p99 %.0f us, max %.0f us (in play: mean %.0f us, max %.0f us)\n",
+			st.loadLatency.getMean() / 1e3, st.loadLatency.percentile(99) / 1e3, st.loadLatency.getMax() / 1e3,
+			st.readyLatency.getMean() / 1e3, st.readyLatency.getMax() / 1e3);
+		printf("resident:    %d chunks, %zu bytes (peak %d chunks, %zu bytes)\n", st.resident, st.residentBytes,
+			st.residentPeak, st.residentBytesPeak);
+		printf("misses:      %lld frames\n", st.misses);
+		if (streamer.getError() != NULL) printf("chunk error: %s\n", streamer.getError());
+	}
+	if (rendering) {
+		double ms = render.time.getMean() / 1e6;
+		printf("render:      %ld frames %dx%d, mean %.2f ms, p99 %.2f ms, %.1f frames/sec (%d threads)\n",
+			render.frames, renderWidth, renderHeight, ms, render.time.percentile(99) / 1e6, ms > 0.0 ? 1e3 / ms : 0.0,
+			threads);
+		printf("triangles:   %.0f per frame\n", render.frames > 0 ? (double)render.triangles / render.frames : 0.0);
+	}
+	if (goldenPath != NULL) {
+		printf("golden:      %ld frames, %ld differ (largest difference %d, tolerance %d)\n", render.compared,
+			render.differ, render.maxDelta, tolerance);
+	}
+	printf("state hash:  %016llx\n", sim::worldHash(world));
+	if (recordPath != NULL) printf("recorded:    %d inputs\n", recorder.getInputCount());
+	if (replayPath != NULL) {
+		bool match = replayed && sim::worldHash(world) == replay.getHeader().finalHash;
+		printf("replay:      %s (recorded %016llx)\n", !replayed ? "CORRUPT" : match ? "match" : "MISMATCH",
+			replay.getHeader().finalHash);
+		if (!match) return 1;
+	}
+
+	if (render.writeFailed) {
+		fprintf(stderr, "-render: can not write the images to %s\n", renderPath);
+		return 1;
+	}
+	if (render.differ > 0) return 1;
+
+	if (profilePath != NULL) {
+		if (!sim::profileEnabled()) {
+			fprintf(stderr, "-profile: built without SIM_PROFILE, no stage timings\n");
+			return 1;
+		}
+		sim::profilePrint(stdout);
+		if (!sim::profileWrite(profilePath)) {
+			fprintf(stderr, "-profile: can not write %s\n", profilePath);
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simShapes.cpp
+//
+// Desc: Narrowphase of a ball against the brick shapes.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simShapes.h"
+
+typedef int (*OverlapsFn)(const float*, const float*, const int*, int, float, float, float, int*);
+typedef bool (*SweepFn)(const float*, const float*, const int*, int, float, float, float, float, float, float&, int&, int&);
+
+// by shape, in BRICK_* order
+static const OverlapsFn s_overlaps[sim::BRICK_SHAPES] = {
+	sim::shapeOverlaps<sim::BRICK_SPHERE>,
+	sim::shapeOverlaps<sim::BRICK_BOX>,
+	sim::shapeOverlaps<sim::BRICK_CAPSULE>,
+};
+
+static const SweepFn s_sweep[sim::BRICK_SHAPES] = {
+	sim::shapeSweep<sim::BRICK_SPHERE>,
+	sim::shapeSweep<sim::BRICK_BOX>,
+	sim::shapeSweep<sim::BRICK_CAPSULE>,
+};
+
+static const float s_bound[sim::BRICK_SHAPES] = {
+	sim::ShapeKernel<sim::BRICK_SPHERE>::bound(),
+	sim::ShapeKernel<sim::BRICK_BOX>::bound(),
+	sim::ShapeKernel<sim::BRICK_CAPSULE>::bound(),
+};
+
+int sim::bucketOverlaps(int shape, const float* xs, const float* zs, const int* ids, int count,
+	float bx, float bz, float radius, int* out)
+{
+	return s_overlaps[shape](xs, zs, ids, count, bx, bz, radius, out);
+}
+
+bool sim::bucketSweep(int shape, const float* xs, const float* zs, const int* ids, int count,
+	float px, float pz, float dx, float dz, float radius, float& first, int& index, int& axis)
+{
+	return s_sweep[shape](xs, zs, ids, count, px, pz, dx, dz, radius, first, index, axis);
+}
+
+float sim::shapeBound(int mask)
+{
+	float bound = 0.0f;
+	for (int s = 0; s < BRICK_SHAPES; s++) {
+		if ((mask & (1 << s)) && s_bound[s] > bound) bound = s_bound[s];
+	}
+	return bound;
+}
+
+// the face of a box brick the ball is on: the axis it is further out along
+static int boxAxis(float cx, float cz, const sim::Vec3& b)
+{
+	return fabsf(b.x - cx) >= fabsf(b.z - cz) ? 0 : 1;
+}
+
+void sim::shapeBounce(int shape, float cx, float cz, Sphere& ball, int axis)
+{
+	const Vec3 b = ball.getCenter();
+	switch (shape) {
+	case BRICK_BOX: {
+		// like a wall face: the velocity along the face normal turns away from the box
+		if (axis < 0) axis = boxAxis(cx, cz, b);
+		float vx = (float)ball.getVelocity_X();
+		float vz = (float)ball.getVelocity_Z();
+		if (axis == 0) vx = (b.x >= cx) ? fabsf(vx) : -fabsf(vx);
+		else vz = (b.z >= cz) ? fabsf(vz) : -fabsf(vz);
+		ball.setPower(vx, vz);
+		break;
+	}
+	case BRICK_CAPSULE:
+		deflect(ball, cx, ShapeKernel<BRICK_CAPSULE>::closestZ(cz, b.z));
+		break;
+	default:
+		deflect(ball, cx, cz);
+		break;
+	}
+}
+
+bool sim::shapeLeaving(int shape, float cx, float cz, const Sphere& ball)
+{
+	const Vec3 b = ball.getCenter();
+	float nx = b.x - cx;
+	float nz = b.z - cz;
+	if (shape == BRICK_BOX) {
+		if (boxAxis(cx, cz, b) == 0) nz = 0.0f;
+		else nx = 0.0f;
+	}
+	else if (shape == BRICK_CAPSULE) {
+		nz = b.z - ShapeKernel<BRICK_CAPSULE>::closestZ(cz, b.z);
+	}
+	return (float)ball.getVelocity_X() * nx + (float)ball.getVelocity_Z() * nz > 0.0f;
+}
@@ -0,0 +1,172 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simShapes.h
+//
+// Desc: Narrowphase of a ball against the brick shapes (BRICK_* in simLevel.h). Every shape
+//       has its tests in a ShapeKernel specialization. The World buckets the bricks a
+//       query finds by shape and runs each bucket through the loops below, instantiated
+//       per shape, so a bucket is a tight loop over bricks of one shape with the test
+//       inlined and no dispatch per brick. The dispatch is one table lookup per bucket.
+//
+//       All tests are on the xz plane, against a ball of the given radius.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simShapesH__
+#define __simShapesH__
+
+#include "simCore.h"
+#include "simSweep.h"
+#include <algorithm>
+#include <cmath>
+
+// box bricks: squares of this half size, the box around a sphere brick
+#define BRICK_BOX_HALF ((float)M_RADIUS)
+
+// capsule bricks: a segment along z of this half length, grown by this radius
+#define BRICK_CAPSULE_HALF   (1.5f * (float)M_RADIUS)
+#define BRICK_CAPSULE_RADIUS (0.6f * (float)M_RADIUS)
+
+namespace sim
+{
+	template <int SHAPE> struct ShapeKernel;
+
+	template <> struct ShapeKernel<BRICK_SPHERE>
+	{
+		// distance from the center within which a ball center may touch, less the ball radius
+		static float bound(void) { return (float)M_RADIUS; }
+
+		// the test of Sphere::hasIntersected
+		static bool overlaps(float cx, float cz, float bx, float bz, float radius)
+		{
+#if defined(SIM_DETERMINISTIC)
+			float dx = cx - bx;
+			float dz = cz - bz;
+			float radii = (float)M_RADIUS + radius;
+			return dx * dx + dz * dz < radii * radii;
+#else
+			double xDistance = fabs((cx - bx) * (cx - bx));
+			double zDistance = fabs((cz - bz) * (cz - bz));
+			return sqrt(xDistance + zDistance) < ((float)M_RADIUS + radius);
+#endif
+		}
+
+		static bool sweep(float px, float pz, float dx, float dz, float cx, float cz, float radius, float& t, int& axis)
+		{
+			axis = 0;
+			return sweepSphere(px, pz, dx, dz, cx, cz, (float)M_RADIUS + radius, t);
+		}
+	};
+
+	template <> struct ShapeKernel<BRICK_BOX>
+	{
+		static float bound(void) { return 1.4142136f * BRICK_BOX_HALF; }
+
+		// the box grown by the ball radius, like Wall::hasIntersected
+		static bool overlaps(float cx, float cz, float bx, float bz, float radius)
+		{
+			float reach = BRICK_BOX_HALF + radius;
+			return (fabsf(bx - cx) <= reach) & (fabsf(bz - cz) <= reach);
+		}
+
+		static bool sweep(float px, float pz, float dx, float dz, float cx, float cz, float radius, float& t, int& axis)
+		{
+			return sweepBox(px, pz, dx, dz, cx, cz, BRICK_BOX_HALF, BRICK_BOX_HALF, radius, t, axis);
+		}
+	};
+
+	template <> struct ShapeKernel<BRICK_CAPSULE>
+	{
+		static float bound(void) { return BRICK_CAPSULE_HALF + BRICK_CAPSULE_RADIUS; }
+
+		// z of the point of the segment closest to (bx, bz)
+		static float closestZ(float cz, float bz)
+		{
+			return std::min(std::max(bz, cz - BRICK_CAPSULE_HALF), cz + BRICK_CAPSULE_HALF);
+		}
+
+		static bool overlaps(float cx, float cz, float bx, float bz, float radius)
+		{
+			float dx = bx - cx;
+			float dz = bz - closestZ(cz, bz);
+			float reach = BRICK_CAPSULE_RADIUS + radius;
+			return dx * dx + dz * dz < reach * reach;
+		}
+
+		// the grown capsule is the two end circles and the box between them. the box test
+		// also reports its z faces and corners, which belong to the circles.
+		static bool sweep(float px, float pz, float dx, float dz, float cx, float cz, float radius, float& t, int& axis)
+		{
+			const float reach = BRICK_CAPSULE_RADIUS + radius;
+			bool hit = false;
+			float s;
+			int a;
+			if (sweepBox(px, pz, dx, dz, cx, cz, BRICK_CAPSULE_RADIUS, BRICK_CAPSULE_HALF, radius, s, a) && a == 0 &&
+				fabsf(pz + s * dz - cz) <= BRICK_CAPSULE_HALF) {
+				t = s;
+				hit = true;
+			}
+			if (sweepSphere(px, pz, dx, dz, cx, cz - BRICK_CAPSULE_HALF, reach, s) && (!hit || s < t)) {
+				t = s;
+				hit = true;
+			}
+			if (sweepSphere(px, pz, dx, dz, cx, cz + BRICK_CAPSULE_HALF, reach, s) && (!hit || s < t)) {
+				t = s;
+				hit = true;
+			}
+			axis = 0;
+			return hit;
+		}
+	};
+
+	// writes the ids of ids[0 .. count) whose brick overlaps a ball of radius at (bx, bz) to
+	// out, in the same order. returns the number written. xs, zs: brick centers by id.
+	template <int SHAPE>
+	inline int shapeOverlaps(const float* xs, const float* zs, const int* ids, int count,
+		float bx, float bz, float radius, int* out)
+	{
+		int found = 0;
+		for (int k = 0; k < count; k++) {
+			int i = ids[k];
+			out[found] = i;
+			found += ShapeKernel<SHAPE>::overlaps(xs[i], zs[i], bx, bz, radius) ? 1 : 0;
+		}
+		return found;
+	}
+
+	// the earliest contact of a ball moving from (px, pz) by (dx, dz) with the bricks of
+	// ids[0 .. count), ids ascending: the lowest id wins a tie. false when there is none.
+	template <int SHAPE>
+	inline bool shapeSweep(const float* xs, const float* zs, const int* ids, int count,
+		float px, float pz, float dx, float dz, float radius, float& first, int& index, int& axis)
+	{
+		bool hit = false;
+		float t;
+		int a;
+		for (int k = 0; k < count; k++) {
+			int i = ids[k];
+			if (ShapeKernel<SHAPE>::sweep(px, pz, dx, dz, xs[i], zs[i], radius, t, a) && (!hit || t < first)) {
+				first = t; index = i; axis = a;
+				hit = true;
+			}
+		}
+		return hit;
+	}
+
+	// the instantiations above, picked by shape once per bucket
+	int bucketOverlaps(int shape, const float* xs, const float* zs, const int* ids, int count,
+		float bx, float bz, float radius, int* out);
+	bool bucketSweep(int shape, const float* xs, const float* zs, const int* ids, int count,
+		float px, float pz, float dx, float dz, float radius, float& first, int& index, int& axis);
+
+	// largest ShapeKernel::bound of the shapes in mask (bit s for shape s)
+	float shapeBound(int mask);
+
+	// hit response: ball bounces off a brick of shape centered at (cx, cz). axis is the face
+	// a sweep found (for boxes), -1 after a discrete test.
+	void shapeBounce(int shape, float cx, float cz, Sphere& ball, int axis);
+	// true when ball already moves away from the brick it touches
+	bool shapeLeaving(int shape, float cx, float cz, const Sphere& ball);
+}
+
+#endif // __simShapesH__
@@ -0,0 +1,144 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simSnapshot.cpp
+//
+// Desc: Snapshots of the full state of a World, for rewind.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simSnapshot.h"
+#include <cstring>
+
+// hot arrays of the BrickStore, in record order: x, y, z, vx, vz
+#define BRICK_ARRAYS 5
+
+// a record is followed by, in this order:
+//   float brickX[brickCount], brickY[..], brickZ[..], brickVX[..], brickVZ[..],
+//   int brickHits[brickCount], Sphere balls[maxBalls],
+//   int liveIds[brickCount], int liveSlots[brickCount],
+//   int awakeIds[brickCount], int awakeSlots[brickCount]
+struct sim::SnapshotArena::Record
+{
+	unsigned int ticks;
+	int    restarts;
+	int    gameStart;
+	int    liveCount;
+	int    awakeCount;
+	int    ballCount;
+	Sphere controlball;
+	Sphere moveball;
+};
+
+sim::SnapshotArena::SnapshotArena(void)
+{
+	m_recordBytes = 0;
+	m_capacity = 0;
+	m_brickCount = 0;
+	m_maxBalls = 0;
+	m_next = 0;
+	m_oldest = 0;
+}
+
+void sim::SnapshotArena::reset(const World& world, int capacity, int maxBalls)
+{
+	m_capacity = capacity > 0 ? capacity : 1;
+	m_brickCount = world.brickCount;
+	m_maxBalls = maxBalls > 0 ? maxBalls : 0;
+
+	size_t bytes = sizeof(Record) + BRICK_ARRAYS * m_brickCount * sizeof(float) + m_brickCount * sizeof(int) + m_maxBalls * sizeof(Sphere) + 4 * m_brickCount * sizeof(int);
+	m_recordBytes = (bytes + 63) & ~(size_t)63;      // records start on a cache line
+	m_buffer.assign(m_recordBytes * m_capacity, 0);
+	m_next = 0;
+	m_oldest = 0;
+}
+
+int sim::SnapshotArena::save(const World& world)
+{
+	if (m_capacity == 0 || world.brickCount != m_brickCount || (int)world.balls.size() > m_maxBalls) return -1;
+
+	int id = m_next++;
+	if (m_next - m_oldest > m_capacity) m_oldest = m_next - m_capacity;
+
+	unsigned char* p = record(id);
+	Record* r = (Record*)p;
+	r->ticks = world.ticks;
+	r->restarts = world.restarts;
+	r->gameStart = world.game_start ? 1 : 0;
+	r->liveCount = world.liveBricks.size();
+	r->awakeCount = world.awakeBricks.size();
+	r->ballCount = (int)world.balls.size();
+	r->controlball = world.controlball;
+	r->moveball = world.moveball;
+	p += sizeof(Record);
+
+	const size_t n = m_brickCount;
+	const std::vector<float>* hot[BRICK_ARRAYS] = { &world.sphere.x, &world.sphere.y, &world.sphere.z, &world.sphere.vx, &world.sphere.vz };
+	for (int a = 0; a < BRICK_ARRAYS; a++) {
+		memcpy(p, hot[a]->data(), n * sizeof(float));
+		p += n * sizeof(float);
+	}
+	memcpy(p, world.sphere.hits.data(), n * sizeof(int));
+	p += n * sizeof(int);
+	if (r->ballCount > 0) memcpy(p, world.balls.data(), r->ballCount * sizeof(Sphere));
+	p += m_maxBalls * sizeof(Sphere);
+	memcpy(p, world.liveBricks.getIds(), r->liveCount * sizeof(int));
+	memcpy(p + n * sizeof(int), world.liveBricks.getSlots(), n * sizeof(int));
+	p += 2 * n * sizeof(int);
+	memcpy(p, world.awakeBricks.getIds(), r->awakeCount * sizeof(int));
+	memcpy(p + n * sizeof(int), world.awakeBricks.getSlots(), n * sizeof(int));
+	return id;
+}
+
+bool sim::SnapshotArena::restore(World& world, int id) const
+{
+	if (id < m_oldest || id >= m_next || world.brickCount != m_brickCount) return false;
+
+	const unsigned char* p = record(id);
+	const Record* r = (const Record*)p;
+	p += sizeof(Record);
+	const size_t n = m_brickCount;
+	const float* bricks = (const float*)p;                // BRICK_ARRAYS arrays of n
+	const float* brickX = bricks;
+	const float* brickZ = bricks + 2 * n;
+	const int* brickHits = (const int*)(bricks + BRICK_ARRAYS * n);
+	const Sphere* balls = (const Sphere*)(brickHits + n);
+	const int* liveIds = (const int*)(balls + m_maxBalls);
+	const int* liveSlots = liveIds + n;
+	const int* awakeIds = liveSlots + n;
+	const int* awakeSlots = awakeIds + n;
+
+	// the grid follows the live bricks where they are. the order of the ids inside a cell
+	// may differ afterwards, which no query depends on.
+	for (int i = 0; i < m_brickCount; i++) {
+		if (liveSlots[i] < 0) {
+			world.brickGrid.remove(i);
+			continue;
+		}
+		if (!world.brickGrid.contains(i)) {
+			world.brickGrid.insert(i, brickX[i], brickZ[i]);
+		}
+		else if (world.sphere.x[i] != brickX[i] || world.sphere.z[i] != brickZ[i]) {
+			world.brickGrid.move(i, brickX[i], brickZ[i]);
+		}
+	}
+
+	world.ticks = r->ticks;
+	world.restarts = r->restarts;
+	world.game_start = r->gameStart != 0;
+	world.controlball = r->controlball;
+	world.moveball = r->moveball;
+	std::vector<float>* hot[BRICK_ARRAYS] = { &world.sphere.x, &world.sphere.y, &world.sphere.z, &world.sphere.vx, &world.sphere.vz };
+	for (int a = 0; a < BRICK_ARRAYS; a++) memcpy(hot[a]->data(), bricks + a * n, n * sizeof(float));
+	memcpy(world.sphere.hits.data(), brickHits, n * sizeof(int));
+	world.balls.assign(balls, balls + r->ballCount);
+	world.liveBricks.assign(liveIds, r->liveCount, liveSlots);
+	world.awakeBricks.assign(awakeIds, r->awakeCount, awakeSlots);
+	return true;
+}
+
+bool sim::SnapshotArena::rewind(World& world)
+{
+	if (getCount() == 0 || !restore(world, m_next - 1)) return false;
+	m_next--;
+	return true;
+}
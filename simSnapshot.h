@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simSnapshot.h
+//
+// Desc: Snapshots of the full state of a World, for rewind. An arena holds a ring of equally
+//       sized records in one buffer; a record is the balls, control ball, bricks, live and
+//       awake sets, game_start, restarts and ticks, stored as flat arrays.
+//
+//       Saving is a few flat copies. Restoring copies the arrays back and brings the grid up
+//       to date with one pass over the bricks: only the bricks whose membership or position
+//       differs are moved in the grid. The level and the settings (continuous, launchSpeed,
+//       workers) are not part of a snapshot.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simSnapshotH__
+#define __simSnapshotH__
+
+#include "simCore.h"
+#include <vector>
+
+namespace sim
+{
+	class SnapshotArena
+	{
+	public:
+		SnapshotArena(void);
+
+		// room for capacity snapshots of worlds with the level of world, each with up to
+		// maxBalls multi-ball balls. drops all snapshots.
+		void reset(const World& world, int capacity, int maxBalls);
+
+		// returns the id of the new snapshot, -1 when the world has more balls than fit.
+		// a full arena overwrites its oldest snapshot.
+		int save(const World& world);
+
+		// false when id is not (or no longer) in the arena
+		bool restore(World& world, int id) const;
+
+		// restores the newest snapshot and drops it, so the next call goes further back.
+		// false when the arena is empty.
+		bool rewind(World& world);
+
+		void clear(void) { m_oldest = m_next; }
+		int getCount(void) const { return m_next - m_oldest; }
+		int getNewest(void) const { return m_next - 1; }     // id, -1 before the first save
+		int getOldest(void) const { return m_oldest; }
+		size_t getSnapshotBytes(void) const { return m_recordBytes; }
+		size_t getBytes(void) const { return m_buffer.size(); }
+
+	private:
+		struct Record;
+
+		unsigned char* record(int id) { return &m_buffer[(size_t)(id % m_capacity) * m_recordBytes]; }
+		const unsigned char* record(int id) const { return &m_buffer[(size_t)(id % m_capacity) * m_recordBytes]; }
+
+		std::vector<unsigned char> m_buffer;
+		size_t m_recordBytes;
+		int    m_capacity;
+		int    m_brickCount;
+		int    m_maxBalls;
+		int    m_next;                   // id of the next save
+		int    m_oldest;                 // id of the oldest snapshot still held
+	};
+}
+
+#endif // __simSnapshotH__
@@ -0,0 +1,359 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simStream.cpp
+//
+// Desc: Streamed levels.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simStream.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+sim::ChunkStreamer::ChunkStreamer(void)
+{
+	lockstep = false;
+	m_chunkCount = 0;
+	m_directory = NULL;
+	m_seed = 1;
+	m_spareBase = 0;
+	m_restarts = 0;
+	m_outstanding = 0;
+	m_quit = false;
+	m_doneCount = 0;
+	m_first = -1;
+	m_last = -1;
+	m_gridFirst = 0;
+	m_gridLast = -1;
+	m_stats = StreamStats();
+	m_error = NULL;
+}
+
+sim::ChunkStreamer::~ChunkStreamer(void)
+{
+	stop();
+}
+
+void sim::ChunkStreamer::setDirectory(const char* directory)
+{
+	m_directory = directory;
+}
+
+void sim::ChunkStreamer::setSeed(unsigned int seed)
+{
+	m_directory = NULL;
+	m_seed = seed;
+}
+
+bool sim::ChunkStreamer::start(World& world, int chunkCount)
+{
+	if (chunkCount < 1 || chunkCount > STREAM_MAX_CHUNKS) return false;
+	stop();
+
+	Level corridor;
+	corridor.makeStream(chunkCount);
+	world.setup(corridor, STREAM_SLOTS * CHUNK_MAX_BRICKS);
+
+	m_chunkCount = chunkCount;
+	m_spareBase = corridor.getBrickCount();
+	m_restarts = world.restarts;
+	Slot free = { -1, NULL };
+	m_slots.assign(STREAM_SLOTS, free);
+	m_pending.clear();
+	m_damage.clear();
+	m_stats = StreamStats();
+	m_error = NULL;
+
+	m_quit = false;
+	m_outstanding = 0;
+	m_doneCount = 0;
+	m_first = -1;
+	m_last = -1;
+	m_gridFirst = 0;
+	m_gridLast = -1;
+	m_thread = std::thread(&ChunkStreamer::loader, this);
+
+	// the game starts with the first chunks in play, like a level that was loaded
+	bool wasLockstep = lockstep;
+	lockstep = true;
+	update(world);
+	lockstep = wasLockstep;
+	return true;
+}
+
+void sim::ChunkStreamer::stop(void)
+{
+	if (m_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_wake.notify_all();
+		m_thread.join();
+	}
+
+	for (size_t r = 0; r < m_requests.size(); r++) delete m_requests[r].level;
+	for (size_t d = 0; d < m_done.size(); d++) delete m_done[d].level;
+	for (size_t s = 0; s < m_slots.size(); s++) delete m_slots[s].level;
+	m_requests.clear();
+	m_done.clear();
+	m_slots.clear();
+	m_pending.clear();
+	m_outstanding = 0;
+	m_doneCount = 0;
+}
+
+int sim::ChunkStreamer::chunkAt(float x) const
+{
+	int chunk = (int)floorf((CHUNK_FIRST_X - x) / CHUNK_LENGTH);
+	return std::min(std::max(chunk, 0), m_chunkCount - 1);
+}
+
+int sim::ChunkStreamer::findSlot(int chunk) const
+{
+	for (size_t s = 0; s < m_slots.size(); s++) {
+		if (m_slots[s].chunk == chunk) return (int)s;
+	}
+	return -1;
+}
+
+bool sim::ChunkStreamer::pending(int chunk) const
+{
+	return std::find(m_pending.begin(), m_pending.end(), chunk) != m_pending.end();
+}
+
+bool sim::ChunkStreamer::update(World& world)
+{
+	SIM_PROFILE_SCOPE(STAGE_STREAM);
+	bool changed = false;
+
+	// the level was reset: its spare bricks are out of play again, with all of their hits
+	if (world.restarts != m_restarts) {
+		m_restarts = world.restarts;
+		m_damage.clear();
+		for (size_t s = 0; s < m_slots.size(); s++) {
+			if (m_slots[s].chunk >= 0) place(world, m_slots[s], (int)s);
+		}
+		changed = true;
+	}
+
+	// the chunks from the shallowest ball to the deepest one, and the chunks wanted around
+	// them. when the balls are spread too far the ones ahead of the deepest ball win.
+	float minX = world.moveball.getCenter().x;
+	float maxX = minX;
+	bool missed = minX <= CHUNK_FIRST_X && findSlot(chunkAt(minX)) < 0;
+	for (size_t b = 0; b < world.balls.size(); b++) {
+		float x = world.balls[b].getCenter().x;
+		minX = std::min(minX, x);
+		maxX = std::max(maxX, x);
+		if (x <= CHUNK_FIRST_X && findSlot(chunkAt(x)) < 0) missed = true;
+	}
+	if (missed) m_stats.misses++;
+	const int deep = chunkAt(minX);
+	const int last = std::min(deep + STREAM_AHEAD, m_chunkCount - 1);
+	const int first = std::max(std::max(chunkAt(maxX) - STREAM_BEHIND, last - (STREAM_WANTED - 1)), 0);
+
+	// chunks left behind go out first, which frees their slots for the ones coming
+	for (size_t s = 0; s < m_slots.size(); s++) {
+		int chunk = m_slots[s].chunk;
+		if (chunk >= 0 && (chunk < first - 1 || chunk > last + 1)) {
+			evict(world, (int)s);
+			changed = true;
+		}
+	}
+
+	if (first != m_first || last != m_last || m_doneCount.load() > 0) {
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_first = first;
+		m_last = last;
+
+		// requests not started yet that are not wanted any more
+		for (size_t r = 0; r < m_requests.size();) {
+			int chunk = m_requests[r].chunk;
+			if (chunk >= first && chunk <= last) {
+				r++;
+				continue;
+			}
+			m_pending.erase(std::find(m_pending.begin(), m_pending.end(), chunk));
+			m_requests.erase(m_requests.begin() + r);
+			m_outstanding--;
+		}
+
+		// the chunk of the deepest ball, the ones ahead of it, then the ones behind
+		bool requested = false;
+		for (int n = 0; n <= last - first; n++) {
+			int chunk = deep + n <= last ? deep + n : deep - (n - (last - deep));
+			if (findSlot(chunk) >= 0 || pending(chunk)) continue;
+			Load load;
+			load.chunk = chunk;
+			load.requested = profileNow();
+			load.done = 0;
+			load.level = NULL;
+			load.error = NULL;
+			m_requests.push_back(load);
+			m_pending.push_back(chunk);
+			m_outstanding++;
+			m_stats.requested++;
+			requested = true;
+		}
+		if (requested) m_wake.notify_one();
+
+		if (lockstep) {
+			while (m_outstanding > 0) m_ready.wait(lock);
+		}
+		m_arrived.swap(m_done);
+		m_doneCount = 0;
+	}
+
+	for (size_t a = 0; a < m_arrived.size(); a++) {
+		Load& load = m_arrived[a];
+		m_pending.erase(std::find(m_pending.begin(), m_pending.end(), load.chunk));
+		m_stats.loaded++;
+		m_stats.loadLatency.record(load.done - load.requested);
+		if (load.chunk < first - 1 || load.chunk > last + 1) {
+			m_stats.dropped++;
+			delete load.level;
+			continue;
+		}
+		install(world, load);
+		changed = true;
+	}
+	m_arrived.clear();
+
+	if (changed) {
+		// the grid covers the chunks in play, bricks do not move out of their chunk
+		int nearest = m_chunkCount, farthest = -1;
+		m_stats.resident = 0;
+		m_stats.residentBytes = 0;
+		for (size_t s = 0; s < m_slots.size(); s++) {
+			const Slot& slot = m_slots[s];
+			if (slot.chunk < 0) continue;
+			nearest = std::min(nearest, slot.chunk);
+			farthest = std::max(farthest, slot.chunk);
+			m_stats.resident++;
+			if (slot.level != NULL) m_stats.residentBytes += slot.level->getSize();
+		}
+		m_stats.residentPeak = std::max(m_stats.residentPeak, m_stats.resident);
+		m_stats.residentBytesPeak = std::max(m_stats.residentBytesPeak, m_stats.residentBytes);
+		if (farthest >= 0 && (nearest < m_gridFirst || farthest > m_gridLast)) {
+			m_gridFirst = std::max((nearest + farthest) / 2 - STREAM_SLOTS, 0);
+			m_gridLast = m_gridFirst + 2 * STREAM_SLOTS - 1;
+			world.setGridWindow(chunkStartX(m_gridLast) - CHUNK_LENGTH, chunkStartX(m_gridFirst));
+		}
+	}
+	return changed;
+}
+
+void sim::ChunkStreamer::install(World& world, Load& load)
+{
+	if (load.level == NULL) {
+		// played as an empty chunk, so it is not asked for again and again
+		m_error = load.error;
+		m_stats.failed++;
+	}
+
+	int s = findSlot(-1);
+	m_slots[s].chunk = load.chunk;
+	m_slots[s].level = load.level;
+	load.level = NULL;
+	place(world, m_slots[s], s);
+	m_stats.readyLatency.record(profileNow() - load.requested);
+}
+
+void sim::ChunkStreamer::place(World& world, const Slot& slot, int slotIndex)
+{
+	if (slot.level == NULL) return;
+	const Level& level = *slot.level;
+	const int base = m_spareBase + slotIndex * CHUNK_MAX_BRICKS;
+	const float x0 = chunkStartX(slot.chunk);
+	std::unordered_map<int, std::vector<unsigned short> >::const_iterator damage = m_damage.find(slot.chunk);
+
+	for (int k = 0; k < level.getBrickCount(); k++) {
+		int left = damage != m_damage.end() ? damage->second[k] : -1;
+		if (left == 0) continue;
+		world.placeBrick(base + k, x0 + level.getBrickX()[k], level.getBrickZ()[k], level.getBrickColor()[k],
+			level.getBrickAttr()[k]);
+		if (left > 0) world.sphere.hits[base + k] = left;
+	}
+}
+
+void sim::ChunkStreamer::evict(World& world, int slotIndex)
+{
+	Slot& slot = m_slots[slotIndex];
+	if (slot.level != NULL) {
+		const Level& level = *slot.level;
+		const int base = m_spareBase + slotIndex * CHUNK_MAX_BRICKS;
+		const int count = level.getBrickCount();
+
+		// remember what the balls did to the chunk
+		std::vector<unsigned short> left(count);
+		bool damaged = false;
+		for (int k = 0; k < count; k++) {
+			int id = base + k;
+			int full = level.getBrickAttr()[k].hits > 0 ? level.getBrickAttr()[k].hits : 1;
+			left[k] = (unsigned short)(world.liveBricks.contains(id) ? world.sphere.hits[id] : 0);
+			if (left[k] != full) damaged = true;
+			if (world.liveBricks.contains(id)) world.removeBrick(id);
+		}
+		if (damaged) m_damage[slot.chunk].swap(left);
+		delete slot.level;
+	}
+	slot.chunk = -1;
+	slot.level = NULL;
+	m_stats.evicted++;
+}
+
+void sim::ChunkStreamer::loader(void)
+{
+	for (;;) {
+		Load load;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_quit && m_requests.empty()) m_wake.wait(lock);
+			if (m_quit) return;
+			load = m_requests.front();
+			m_requests.pop_front();
+		}
+
+		// the file read or the generation runs without the lock
+		this->load(load);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_done.push_back(load);
+			m_doneCount = (int)m_done.size();
+			m_outstanding--;
+		}
+		m_ready.notify_all();
+	}
+}
+
+void sim::ChunkStreamer::load(Load& load) const
+{
+	Level* level = new Level;
+	const char* error = NULL;
+	if (m_directory != NULL) {
+		char path[1024];
+		snprintf(path, sizeof(path), CHUNK_FILE_FORMAT, m_directory, load.chunk);
+		if (!level->load(path)) error = level->getError();
+	}
+	else {
+		level->makeChunk(m_seed, load.chunk);
+	}
+
+	// a chunk only holds bricks inside of it, and not more than its slot
+	if (error == NULL && level->getBrickCount() > CHUNK_MAX_BRICKS) error = "chunk with too many bricks";
+	for (int k = 0; error == NULL && k < level->getBrickCount(); k++) {
+		float x = level->getBrickX()[k], z = level->getBrickZ()[k];
+		if (!(x >= -CHUNK_LENGTH && x <= 0.0f && fabsf(z) <= 3.0f)) error = "brick outside of its chunk";
+	}
+
+	if (error != NULL) {
+		delete level;
+		level = NULL;
+	}
+	load.level = level;
+	load.error = error;
+	load.done = profileNow();
+}
@@ -0,0 +1,168 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simStream.h
+//
+// Desc: Streamed levels. The field is a corridor of chunkCount chunks along -x (see
+//       Level::makeStream) of which only the few around the balls are in the World: the
+//       STREAM_AHEAD chunks past the deepest ball and STREAM_BEHIND before the shallowest.
+//       Chunks are read from files (CHUNK_FILE_FORMAT, levelConvert -chunks writes them) or
+//       generated from a seed (Level::makeChunk) on a loader thread, and put into the World
+//       by update() once they are ready. Chunks left behind are taken out again, so memory
+//       stays at STREAM_SLOTS chunks however long the level is.
+//
+//       The simulation thread never waits for a load: update() only takes the chunks that
+//       are done. A ball that gets into a chunk before its bricks came plays on without them
+//       (counted as a miss). The grid of the World follows the chunks in it, a window of
+//       2 * STREAM_SLOTS chunks that moves when they get out of it.
+//
+//       Every chunk in play has a slot of CHUNK_MAX_BRICKS brick ids in the World, set up
+//       as spare bricks. Bricks a ball destroyed or damaged stay that way when their chunk
+//       comes again, until the level is reset (World::resetLevel), which brings back all
+//       of them.
+//
+//       When chunks arrive depends on the loader thread, so streamed games are not
+//       repeatable run to run. With lockstep set update() waits for every chunk it asked
+//       for, which makes them repeatable (for tests) at the cost of stalls. Snapshots
+//       (simSnapshot.h) of a streamed World do not hold the state of its streamer.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simStreamH__
+#define __simStreamH__
+
+#include "simCore.h"
+#include "simProfile.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// chunks kept ahead of the deepest ball and behind the shallowest one
+#define STREAM_AHEAD  3
+#define STREAM_BEHIND 1
+
+// chunks in play at most: the wanted ones and one more on each side, so a ball going back
+// and forth over a chunk border does not take chunks out and in every time
+#define STREAM_WANTED (STREAM_AHEAD + STREAM_BEHIND + 1)
+#define STREAM_SLOTS  (STREAM_WANTED + 2)
+
+// longest level: the corridor ends at about -2 * STREAM_MAX_CHUNKS, beyond that float
+// positions get too coarse for the collision tests
+#define STREAM_MAX_CHUNKS 4096
+
+namespace sim
+{
+	struct StreamStats
+	{
+		long long requested;             // loads asked for
+		long long loaded;                // loads done (a failed one included)
+		long long failed;                // chunks that could not be read, played empty
+		long long dropped;               // loads done after their chunk was not wanted any more
+		long long evicted;               // chunks taken out of the world
+		long long misses;                // updates with a ball in a chunk that was not in play
+		int       resident;              // chunks in play
+		int       residentPeak;
+		size_t    residentBytes;         // their level data
+		size_t    residentBytesPeak;
+		Histogram loadLatency;           // ns from the request to the data (loader thread)
+		Histogram readyLatency;          // ns from the request to the chunk in play
+	};
+
+	class ChunkStreamer
+	{
+	public:
+		ChunkStreamer(void);
+		~ChunkStreamer(void);            // stops the loader
+
+		// where chunks come from: the files CHUNK_FILE_FORMAT of directory, or generated
+		// from seed. set before start().
+		void setDirectory(const char* directory);
+		void setSeed(unsigned int seed);
+
+		// sets world up on the corridor of chunkCount chunks and starts the loader thread.
+		// false when chunkCount is out of [1, STREAM_MAX_CHUNKS].
+		bool start(World& world, int chunkCount);
+		void stop(void);
+
+		// once per frame on the simulation thread, between steps: asks for the chunks
+		// around the balls, puts the loaded ones into world and takes the ones left behind
+		// out. true when bricks came or went (an ImpactSim has to sync).
+		bool update(World& world);
+
+		bool lockstep;                   // update() waits for the chunks it asked for
+
+		const StreamStats& getStats(void) const { return m_stats; }
+		int getChunkCount(void) const { return m_chunkCount; }
+		// the chunk x is in, clamped to the corridor
+		int chunkAt(float x) const;
+		// last load error, NULL when all chunks could be read
+		const char* getError(void) const { return m_error; }
+
+	private:
+		ChunkStreamer(const ChunkStreamer&);
+		ChunkStreamer& operator=(const ChunkStreamer&);
+
+		// a load, queued by update() and answered by the loader
+		struct Load
+		{
+			int        chunk;
+			long long  requested;        // profileNow()
+			long long  done;
+			Level*     level;            // owned by the Load until the chunk is in play
+			const char* error;
+		};
+
+		// a chunk in play: brick ids [slot * CHUNK_MAX_BRICKS, + level brick count)
+		struct Slot
+		{
+			int        chunk;            // -1 when free
+			Level*     level;
+		};
+
+		void loader(void);
+		void load(Load& load) const;
+		void install(World& world, Load& load);
+		void place(World& world, const Slot& slot, int slotIndex);
+		void evict(World& world, int slotIndex);
+		int findSlot(int chunk) const;
+		bool pending(int chunk) const;   // requested and not installed yet
+
+		int          m_chunkCount;
+		const char*  m_directory;        // NULL: generated from m_seed
+		unsigned int m_seed;
+		int          m_spareBase;        // first brick id of slot 0
+		int          m_restarts;         // World::restarts when the slots were placed last
+
+		std::vector<Slot> m_slots;
+		std::vector<int>  m_pending;     // chunks asked for and not in play yet
+
+		// per chunk that was taken out damaged: hits left of its bricks, 0 for destroyed
+		std::unordered_map<int, std::vector<unsigned short> > m_damage;
+
+		std::thread             m_thread;
+		std::mutex              m_mutex;     // guards m_requests .. m_quit
+		std::condition_variable m_wake;      // loader: a request came or quit
+		std::condition_variable m_ready;     // lockstep update: a load is done
+		std::deque<Load>        m_requests;
+		std::vector<Load>       m_done;
+		int                     m_outstanding;   // requests queued or loading
+		bool                    m_quit;
+		std::atomic<int>        m_doneCount;     // m_done.size(), read without the lock
+
+		// the wanted chunks of the last update(). the lock is only taken when they change or
+		// loads are done, most frames do not touch it.
+		int m_first, m_last;
+		// the chunks the grid of the World covers, twice as many as can be in play, so it
+		// is only built again after the balls went on by about STREAM_SLOTS chunks
+		int m_gridFirst, m_gridLast;
+
+		std::vector<Load> m_arrived;     // scratch of update()
+		StreamStats m_stats;
+		const char* m_error;
+	};
+}
+
+#endif // __simStreamH__
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simSweep.cpp
+//
+// Desc: Time of impact tests for a ball moving in a straight line during one step.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simSweep.h"
+#include <cmath>
+
+bool sim::sweepSphere(
+	float px, float pz, float dx, float dz,
+	float cx, float cz, float radiusSum,
+	float& t)
+{
+	// |p + t*d - c|^2 = r^2  ->  a*t^2 + 2*b*t + c = 0
+	float mx = px - cx;
+	float mz = pz - cz;
+	float a = dx * dx + dz * dz;
+	float b = mx * dx + mz * dz;
+	float c = mx * mx + mz * mz - radiusSum * radiusSum;
+
+	if (c < 0.0f) return false;      // already overlapping, left to the discrete test
+	if (b >= 0.0f) return false;     // moving away
+	if (a <= 0.0f) return false;
+
+	float disc = b * b - a * c;
+	if (disc < 0.0f) return false;
+
+	float hit = (-b - sqrtf(disc)) / a;
+	if (hit < 0.0f || hit > 1.0f) return false;
+	t = hit;
+	return true;
+}
+
+bool sim::sweepBox(
+	float px, float pz, float dx, float dz,
+	float cx, float cz, float halfWidth, float halfDepth, float radius,
+	float& t, int& axis)
+{
+	float minX = cx - halfWidth - radius, maxX = cx + halfWidth + radius;
+	float minZ = cz - halfDepth - radius, maxZ = cz + halfDepth + radius;
+
+	if (minX <= px && px <= maxX && minZ <= pz && pz <= maxZ) return false;
+
+	// slab test: latest entry over both axes, earliest exit
+	float enter = 0.0f, leave = 1.0f;
+	int enterAxis = -1;
+
+	if (dx == 0.0f) {
+		if (px < minX || px > maxX) return false;
+	}
+	else {
+		float t0 = (minX - px) / dx, t1 = (maxX - px) / dx;
+		if (t0 > t1) { float tmp = t0; t0 = t1; t1 = tmp; }
+		if (t0 > enter) { enter = t0; enterAxis = 0; }
+		if (t1 < leave) leave = t1;
+	}
+
+	if (dz == 0.0f) {
+		if (pz < minZ || pz > maxZ) return false;
+	}
+	else {
+		float t0 = (minZ - pz) / dz, t1 = (maxZ - pz) / dz;
+		if (t0 > t1) { float tmp = t0; t0 = t1; t1 = tmp; }
+		if (t0 > enter) { enter = t0; enterAxis = 1; }
+		if (t1 < leave) leave = t1;
+	}
+
+	if (enterAxis < 0 || enter > leave) return false;
+	t = enter;
+	axis = enterAxis;
+	return true;
+}
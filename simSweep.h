@@ -0,0 +1,34 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simSweep.h
+//
+// Desc: Time of impact tests for a ball moving in a straight line during one step. Used by
+//       the continuous collision mode of sim::World so fast balls can not skip through
+//       bricks and walls.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simSweepH__
+#define __simSweepH__
+
+#include "simMath.h"
+
+namespace sim
+{
+	// the ball moves from (px, pz) to (px + dx, pz + dz). returns true when it touches the
+	// sphere at (cx, cz) on the way, with t in [0, 1] the fraction of the move done at
+	// contact. a ball that already overlaps or moves away is not reported.
+	bool sweepSphere(
+		float px, float pz, float dx, float dz,
+		float cx, float cz, float radiusSum,
+		float& t);
+
+	// same for a box of the given center and half extents, grown by the ball radius like
+	// Wall::hasIntersected does. axis is 0 when the ball hits an x face, 1 for a z face.
+	bool sweepBox(
+		float px, float pz, float dx, float dz,
+		float cx, float cz, float halfWidth, float halfDepth, float radius,
+		float& t, int& axis);
+}
+
+#endif // __simSweepH__
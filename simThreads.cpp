@@ -0,0 +1,113 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simThreads.cpp
+//
+// Desc: Fixed pool of worker threads for data parallel loops.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simThreads.h"
+#include "simJobs.h"
+
+sim::WorkerPool::WorkerPool(int threads)
+{
+	m_jobs = NULL;
+	m_generation = 0;
+	m_pending = 0;
+	m_quit = false;
+	m_count = 0;
+	m_task = NULL;
+	m_context = NULL;
+
+	for (int part = 1; part < threads; part++) {
+		m_workers.push_back(std::thread(&WorkerPool::worker, this, part));
+	}
+}
+
+sim::WorkerPool::WorkerPool(JobSystem& jobs)
+{
+	m_jobs = &jobs;
+	m_generation = 0;
+	m_pending = 0;
+	m_quit = false;
+	m_count = 0;
+	m_task = NULL;
+	m_context = NULL;
+}
+
+sim::WorkerPool::~WorkerPool(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_start.notify_all();
+	for (size_t w = 0; w < m_workers.size(); w++) m_workers[w].join();
+}
+
+int sim::WorkerPool::getThreadCount(void) const
+{
+	return m_jobs != NULL ? m_jobs->getThreadCount() : (int)m_workers.size() + 1;
+}
+
+int sim::WorkerPool::hardwareThreads(void)
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return n > 0 ? (int)n : 1;
+}
+
+void sim::WorkerPool::range(int part, int& begin, int& end) const
+{
+	int parts = getThreadCount();
+	begin = (int)((long long)m_count * part / parts);
+	end = (int)((long long)m_count * (part + 1) / parts);
+}
+
+void sim::WorkerPool::run(int count, RangeTask task, void* context)
+{
+	if (m_jobs != NULL) {
+		m_jobs->parallelRanges(count, task, context);
+		return;
+	}
+	if (m_workers.empty() || count < 2) {
+		task(context, 0, 0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_count = count;
+		m_task = task;
+		m_context = context;
+		m_pending = (int)m_workers.size();
+		m_generation++;
+	}
+	m_start.notify_all();
+
+	int begin, end;
+	range(0, begin, end);
+	task(context, 0, begin, end);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_pending == 0; });
+}
+
+void sim::WorkerPool::worker(int part)
+{
+	unsigned int seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_start.wait(lock, [this, seen] { return m_quit || m_generation != seen; });
+			if (m_quit) return;
+			seen = m_generation;
+		}
+
+		int begin, end;
+		range(part, begin, end);
+		if (begin < end) m_task(m_context, part, begin, end);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_pending == 0) m_done.notify_one();
+	}
+}
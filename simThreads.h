@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simThreads.h
+//
+// Desc: Fixed pool of worker threads for data parallel loops. run() splits [0, count) into
+//       one contiguous range per thread, the calling thread takes the first range, and
+//       returns when all ranges are done. The split only depends on count and the thread
+//       count, never on timing.
+//
+//       Built on a JobSystem the pool owns no threads and runs the ranges as jobs on the
+//       threads of the system, with the same split.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simThreadsH__
+#define __simThreadsH__
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sim
+{
+	// processes items [begin, end) as range number part
+	typedef void (*RangeTask)(void* context, int part, int begin, int end);
+
+	class JobSystem;
+
+	class WorkerPool
+	{
+	public:
+		explicit WorkerPool(int threads);    // threads includes the caller, at least 1
+		explicit WorkerPool(JobSystem& jobs);
+		~WorkerPool(void);
+
+		void run(int count, RangeTask task, void* context);
+		int getThreadCount(void) const;
+
+		static int hardwareThreads(void);    // at least 1
+
+	private:
+		WorkerPool(const WorkerPool&);
+		WorkerPool& operator=(const WorkerPool&);
+
+		void worker(int part);
+		void range(int part, int& begin, int& end) const;
+
+		JobSystem*               m_jobs;     // not owned, NULL with own threads
+		std::vector<std::thread> m_workers;
+		std::mutex               m_mutex;
+		std::condition_variable  m_start;
+		std::condition_variable  m_done;
+		unsigned int m_generation;       // bumped for every run
+		int          m_pending;          // workers still busy with the current run
+		bool         m_quit;
+
+		int          m_count;
+		RangeTask    m_task;
+		void*        m_context;
+	};
+}
+
+#endif // __simThreadsH__
@@ -0,0 +1,104 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simWallTree.cpp
+//
+// Desc: Bounding volume hierarchy over the static walls of a level.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simWallTree.h"
+#include <algorithm>
+
+// nodes a query keeps pending. the tree is split at the median, so it is about
+// log2(wallCount / WALL_TREE_LEAF) deep and a query holds at most one node per level
+#define WALL_TREE_STACK 64
+
+sim::WallTree::WallTree(void)
+{
+	m_depth = 0;
+}
+
+void sim::WallTree::build(const float* minX, const float* minZ, const float* maxX, const float* maxZ, int count)
+{
+	m_minX.assign(minX, minX + count);
+	m_minZ.assign(minZ, minZ + count);
+	m_maxX.assign(maxX, maxX + count);
+	m_maxZ.assign(maxZ, maxZ + count);
+	m_ids.resize(count);
+	for (int j = 0; j < count; j++) m_ids[j] = j;
+
+	m_nodes.clear();
+	m_depth = 0;
+	if (count == 0) return;
+	m_nodes.reserve(2 * (count / WALL_TREE_LEAF + 1));
+	m_nodes.push_back(Node());
+	split(0, 0, count, 1);
+}
+
+void sim::WallTree::split(int node, int begin, int end, int depth)
+{
+	if (depth > m_depth) m_depth = depth;
+
+	Node n;
+	n.minX = n.minZ = 1e30f;
+	n.maxX = n.maxZ = -1e30f;
+	for (int k = begin; k < end; k++) {
+		int j = m_ids[k];
+		n.minX = std::min(n.minX, m_minX[j]);
+		n.minZ = std::min(n.minZ, m_minZ[j]);
+		n.maxX = std::max(n.maxX, m_maxX[j]);
+		n.maxZ = std::max(n.maxZ, m_maxZ[j]);
+	}
+
+	if (end - begin <= WALL_TREE_LEAF) {
+		n.first = begin;
+		n.count = end - begin;
+		m_nodes[node] = n;
+		return;
+	}
+
+	// halve at the median center along the longer side of the node
+	const bool alongX = n.maxX - n.minX >= n.maxZ - n.minZ;
+	const int mid = begin + (end - begin) / 2;
+	std::nth_element(m_ids.begin() + begin, m_ids.begin() + mid, m_ids.begin() + end, [this, alongX](int a, int b) {
+		if (alongX) return m_minX[a] + m_maxX[a] < m_minX[b] + m_maxX[b];
+		return m_minZ[a] + m_maxZ[a] < m_minZ[b] + m_maxZ[b];
+	});
+
+	n.first = (int)m_nodes.size();
+	n.count = 0;
+	m_nodes[node] = n;
+	m_nodes.push_back(Node());
+	m_nodes.push_back(Node());
+	split(n.first, begin, mid, depth + 1);
+	split(n.first + 1, mid, end, depth + 1);
+}
+
+int sim::WallTree::query(float minX, float minZ, float maxX, float maxZ, std::vector<int>& ids) const
+{
+	if (m_nodes.empty()) return 0;
+
+	size_t start = ids.size();
+	int stack[WALL_TREE_STACK];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& n = m_nodes[stack[--top]];
+		// one branch for the four sides, they are hard to predict one by one
+		if (!((n.minX <= maxX) & (n.maxX >= minX) & (n.minZ <= maxZ) & (n.maxZ >= minZ))) continue;
+
+		if (n.count == 0) {
+			stack[top++] = n.first + 1;
+			stack[top++] = n.first;
+			continue;
+		}
+		for (int k = n.first; k < n.first + n.count; k++) {
+			int j = m_ids[k];
+			if ((m_minX[j] <= maxX) & (m_maxX[j] >= minX) & (m_minZ[j] <= maxZ) & (m_maxZ[j] >= minZ)) ids.push_back(j);
+		}
+	}
+
+	// leaves are spread over the index range, so the order is only known at the end
+	if (ids.size() - start > 1) std::sort(ids.begin() + start, ids.end());
+	return (int)(ids.size() - start);
+}
@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simWallTree.h
+//
+// Desc: Bounding volume hierarchy over the static walls of a level, built once at setup.
+//       A ball finds the walls around it in about log(wallCount) node tests instead of
+//       testing every wall, so levels can carry thousands of obstacle boxes.
+//
+//       Queries return the walls in ascending index order, so the callers resolve them in the
+//       order a loop over all walls would and get the same results.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simWallTreeH__
+#define __simWallTreeH__
+
+#include "simMath.h"
+#include <vector>
+
+// walls per leaf
+#define WALL_TREE_LEAF 4
+
+// added to the query boxes of the wall tests. the tree holds the bare wall boxes while
+// Wall::hasIntersected grows them by the ball radius in its own rounding; this keeps the
+// tree from missing a wall the exact test would hit.
+#define WALL_TREE_MARGIN 1e-3f
+
+namespace sim
+{
+	class WallTree
+	{
+	public:
+		WallTree(void);
+
+		// the boxes of walls 0 .. count-1 on the xz plane
+		void build(const float* minX, const float* minZ, const float* maxX, const float* maxZ, int count);
+
+		// appends the indices of the walls whose box overlaps the query box to ids, the
+		// appended ones in ascending order. returns the number appended. read only, safe to
+		// call from several threads at once with their own ids.
+		int query(float minX, float minZ, float maxX, float maxZ, std::vector<int>& ids) const;
+
+		int getWallCount(void) const { return (int)m_ids.size(); }
+		int getNodeCount(void) const { return (int)m_nodes.size(); }
+		int getDepth(void) const { return m_depth; }
+
+	private:
+		struct Node
+		{
+			float minX, minZ, maxX, maxZ;
+			int   first;                     // leaf: into m_ids, inner: left child (right is first + 1)
+			int   count;                     // walls of a leaf, 0 for an inner node
+		};
+
+		void split(int node, int begin, int end, int depth);
+
+		std::vector<Node>  m_nodes;        // m_nodes[0] is the root
+		std::vector<int>   m_ids;          // wall indices, ascending inside every leaf
+		std::vector<float> m_minX, m_minZ, m_maxX, m_maxZ;
+		int m_depth;
+	};
+}
+
+#endif // __simWallTreeH__
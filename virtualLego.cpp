@@ -2,7 +2,7 @@
 //
 // File: virtualLego.cpp
 //
-// Original Author: â Chang-hyeon Park, 
+// Original Author: ¹ÚÃ¢Çö Chang-hyeon Park, 
 // Modified by Bong-Soo Sohn and Dong-Jun Kim
 // 
 // Originally programmed for Virtual LEGO. 
@@ -11,460 +11,199 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include "simCore.h"
+#include "simEvent.h"
+#include "simJobs.h"
+#include "simParticles.h"
+#include "simProfile.h"
+#include "simRaster.h"
+#include "simRender.h"
+#include "simReplay.h"
+#include "simShapes.h"
+#include "simSnapshot.h"
+#include "simThreads.h"
 #include <vector>
 #include <ctime>
 #include <cstdlib>
 #include <cstdio>
 #include <cassert>
 
-#define brickCount 52
-#define wallCount 3
-#define COR_VAL 0.01f
-
 IDirect3DDevice9* Device = NULL;
 
-// initialize the position (coordinate) of each ball (ball0 ~ ball3)
-float spherePos[brickCount][2] = {};
-// initialize the color of each ball (ball0 ~ ball3)
-D3DXCOLOR sphereColor[brickCount] = {};
-
 // window size
 const int Width = 1024;
 const int Height = 768;
 
-// game start
-bool game_start = false;
-
-// -----------------------------------------------------------------------------
-// Transform matrices
-// -----------------------------------------------------------------------------
-D3DXMATRIX g_mWorld;
-D3DXMATRIX g_mView;
-D3DXMATRIX g_mProj;
-
-#define M_RADIUS 0.21   // ball radius
 #define PI 3.14159265
-#define M_HEIGHT 0.01
-#define DECREASE_RATE 0.9982
 
 // -----------------------------------------------------------------------------
-// CSphere class definition
+// Simulation rate
+// the world is stepped at a fixed rate, independent of the frame rate. drawing
+// interpolates between the last two simulation states.
 // -----------------------------------------------------------------------------
+#define SIM_HZ 120
+#define SIM_MAX_STEPS 8         // steps per frame before time is dropped
+#define TIME_PER_MS 0.0007f     // timeDelta units per millisecond (d3d::EnterMsgLoop)
 
-class CSphere {
-private :
-	float					center_x, center_y, center_z;
-    float                   m_radius;
-	float					m_velocity_x;
-	float					m_velocity_z;
-	bool					isControlball = false;
-
-public:
-    CSphere(void)
-    {
-        D3DXMatrixIdentity(&m_mLocal);
-        ZeroMemory(&m_mtrl, sizeof(m_mtrl));
-        m_radius = 0;
-		m_velocity_x = 0;
-		m_velocity_z = 0;
-        m_pSphereMesh = NULL;
-    }
-    ~CSphere(void) {}
-
-public:
-    bool create(IDirect3DDevice9* pDevice, D3DXCOLOR color = d3d::WHITE)
-    {
-        if (NULL == pDevice)
-            return false;
-		
-        m_mtrl.Ambient  = color;
-        m_mtrl.Diffuse  = color;
-        m_mtrl.Specular = color;
-        m_mtrl.Emissive = d3d::BLACK;
-        m_mtrl.Power    = 5.0f;
-		
-        if (FAILED(D3DXCreateSphere(pDevice, getRadius(), 50, 50, &m_pSphereMesh, NULL)))
-            return false;
-        return true;
-    }
-	
-    void destroy(void)
-    {
-        if (m_pSphereMesh != NULL) {
-            m_pSphereMesh->Release();
-            m_pSphereMesh = NULL;
-        }
-    }
-
-    void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
-    {
-        if (NULL == pDevice)
-            return;
-        pDevice->SetTransform(D3DTS_WORLD, &mWorld);
-        pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-        pDevice->SetMaterial(&m_mtrl);
-		m_pSphereMesh->DrawSubset(0);
-    }
-	
-    bool hasIntersected(CSphere& ball) 
-	{
-		// Insert your code here.
-		D3DXVECTOR3 cord = this->getCenter();
-		D3DXVECTOR3 ball_cord = ball.getCenter();
-		double xDistance = abs((cord.x - ball_cord.x) * (cord.x - ball_cord.x));
-		double zDistance = abs((cord.z - ball_cord.z) * (cord.z - ball_cord.z));
-		double totalDistance = sqrt(xDistance + zDistance);
-
-		if (totalDistance < (this->getRadius() + ball.getRadius()))
-		{
-			std::cout << "hasInters" << std::endl;
-			return true;
-		}
-
-		return false;
-	}
-	
-	void hitBy(CSphere& ball) 
-	{ 
-		// Insert your code here.
-		if (hasIntersected(ball)) {
-			//浹 
-
-			//moveball ƨ( ӵ ߿Ѱ ƴ϶,   ߿ϴ,  ŭ ̵ϵ Ѵ)
-
-			float delta_x = ball.getCenter().x - this->getCenter().x;
-			float delta_z = ball.getCenter().z - this->getCenter().z;
-			float multiple;
-
-			float velocity_vector_scala = sqrt(ball.getVelocity_X() * ball.getVelocity_X() + ball.getVelocity_Z() * ball.getVelocity_Z());
-			float distance_vector_scala = sqrt(delta_x * delta_x + delta_z * delta_z); // 
-			multiple = velocity_vector_scala / distance_vector_scala;
-
-			float new_velocity_x = multiple * delta_x;
-			float new_velocity_z = multiple * delta_z;
+// per-stage timings are written here on F2 and on exit (needs SIM_PROFILE)
+#define PROFILE_PATH "profile.csv"
+// F3 starts / stops the event log (collisions, destroyed bricks, bounces, resets)
+#define EVENT_PATH "events.txt"
 
-			ball.setPower(new_velocity_x, new_velocity_z);
+// level played, see simLevel.h. the built-in level is used when it can not be loaded
+#define LEVEL_PATH "level.bin"
 
-			// this controlball̸, ball   ʱ
-			if (!this->isControlBall()) {
-				this->setCenter(-10.0f, -10.0f, 0.0f);
-			}
-		}
-			
-	}
+// F4 restarts the level and records the input, F4 again writes the recording for
+// simRunner -replay (fixed step only)
+#define RECORD_PATH "input.rec"
 
-	void ballUpdate(float timeDiff) 
-	{
-		const float TIME_SCALE = 3.3;
-		D3DXVECTOR3 cord = this->getCenter();
-		double vx = abs(this->getVelocity_X());
-		double vz = abs(this->getVelocity_Z());
-
-		if(vx > 0.01 || vz > 0.01)
-		{
-			float tX = cord.x + TIME_SCALE*timeDiff*m_velocity_x;
-			float tZ = cord.z + TIME_SCALE*timeDiff*m_velocity_z;
-
-			//correction of position of ball
-			// Please uncomment this part because this correction of ball position is necessary when a ball collides with a wall
-			/*if(tX >= (4.5 - M_RADIUS))
-				tX = 4.5 - M_RADIUS;
-			else if(tX <=(-4.5 + M_RADIUS))
-				tX = -4.5 + M_RADIUS;
-			else if(tZ <= (-3 + M_RADIUS))
-				tZ = -3 + M_RADIUS;
-			else if(tZ >= (3 - M_RADIUS))
-				tZ = 3 - M_RADIUS;*/
-			
-			this->setCenter(tX, cord.y, tZ);
-		}
-		else { this->setPower(0,0);}
-	}
+// B spawns this many extra balls (multi-ball)
+#define MULTIBALL_COUNT 16
 
-	double getVelocity_X() { return this->m_velocity_x;	}
-	double getVelocity_Z() { return this->m_velocity_z; }
-
-	void setPower(double vx, double vz)
-	{
-		this->m_velocity_x = vx;
-		this->m_velocity_z = vz;
-	}
-
-	void setCenter(float x, float y, float z)
-	{
-		D3DXMATRIX m;
-		center_x=x;	center_y=y;	center_z=z;
-		D3DXMatrixTranslation(&m, x, y, z);
-		setLocalTransform(m);
-	}
-	
-	float getRadius(void)  const { return (float)(M_RADIUS);  }
-    const D3DXMATRIX& getLocalTransform(void) const { return m_mLocal; }
-    void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
-	void setControlBall(bool l_isControlball) { isControlball = l_isControlball; }
-	bool isControlBall(void) { return isControlball; }
-
-    D3DXVECTOR3 getCenter(void) const
-    {
-        D3DXVECTOR3 org(center_x, center_y, center_z);
-        return org;
-    }
-	
-private:
-    D3DXMATRIX              m_mLocal;
-    D3DMATERIAL9            m_mtrl;
-    ID3DXMesh*              m_pSphereMesh;
-	
-};
+// every SNAPSHOT_TICKS steps the world is saved for rewind, the last REWIND_SNAPSHOTS
+// are kept (a minute at SIM_HZ). each Backspace goes back one of them (not while recording).
+#define SNAPSHOT_TICKS 30
+#define REWIND_SNAPSHOTS 240
 
+// debris of hit bricks, drawn as one list of points (sim::RenderPoint)
+#define PARTICLE_FVF (D3DFVF_XYZ | D3DFVF_DIFFUSE)
 
+// F5 draws the current frame with the CPU rasterizer (simRaster.h) into this image
+#define SCREENSHOT_PATH "frame.ppm"
 
 // -----------------------------------------------------------------------------
-// CWall class definition
+// CRenderer class definition
+// the Direct3D backend of sim::RenderFrame (simRender.h). what is drawn and where
+// comes from the frame, this only makes the meshes and issues the draw calls.
+// sim::Rasterizer draws the same frames on the CPU.
 // -----------------------------------------------------------------------------
 
-class CWall {
-
-private:
-	
-    float					m_x;
-	float					m_z;
-	float                   m_width;
-    float                   m_depth;
-	float					m_height;
-	
+class CRenderer {
 public:
-    CWall(void)
-    {
-        D3DXMatrixIdentity(&m_mLocal);
-        ZeroMemory(&m_mtrl, sizeof(m_mtrl));
-        m_width = 0;
-        m_depth = 0;
-        m_pBoundMesh = NULL;
-    }
-    ~CWall(void) {}
+    CRenderer(void) {}
+    ~CRenderer(void) {}
+
 public:
-    bool create(IDirect3DDevice9* pDevice, float ix, float iz, float iwidth, float iheight, float idepth, D3DXCOLOR color = d3d::WHITE)
+    // meshes, camera and light of a frame set up by sim::renderSetup
+    bool create(IDirect3DDevice9* pDevice, const sim::RenderFrame& frame)
     {
         if (NULL == pDevice)
             return false;
-		
-        m_mtrl.Ambient  = color;
-        m_mtrl.Diffuse  = color;
-        m_mtrl.Specular = color;
-        m_mtrl.Emissive = d3d::BLACK;
-        m_mtrl.Power    = 5.0f;
-		
-        m_width = iwidth;
-        m_depth = idepth;
-		
-        if (FAILED(D3DXCreateBox(pDevice, iwidth, iheight, idepth, &m_pBoundMesh, NULL)))
-            return false;
+
+        for (size_t i = 0; i < frame.meshes.size(); i++) {
+            const sim::RenderMesh& m = frame.meshes[i];
+            ID3DXMesh* pMesh = NULL;
+            HRESULT created;
+            if (m.kind == sim::MESH_BOX)
+                created = D3DXCreateBox(pDevice, m.size[0], m.size[1], m.size[2], &pMesh, NULL);
+            else if (m.kind == sim::MESH_CYLINDER)
+                created = D3DXCreateCylinder(pDevice, m.size[0], m.size[0], m.size[1], m.slices, m.stacks, &pMesh, NULL);
+            else
+                created = D3DXCreateSphere(pDevice, m.size[0], m.slices, m.stacks, &pMesh, NULL);
+            if (FAILED(created))
+                return false;
+            m_meshes.push_back(pMesh);
+        }
+
+        D3DXMATRIX mView(&frame.view.m[0][0]);
+        D3DXMATRIX mProj(&frame.projection.m[0][0]);
+        pDevice->SetTransform(D3DTS_VIEW, &mView);
+        pDevice->SetTransform(D3DTS_PROJECTION, &mProj);
+
+        const sim::RenderLight& light = frame.light;
+        D3DLIGHT9 lit;
+        ::ZeroMemory(&lit, sizeof(lit));
+        lit.Type         = D3DLIGHT_POINT;
+        lit.Diffuse      = colorValue(light.diffuse);
+        lit.Specular     = colorValue(light.specular);
+        lit.Ambient      = colorValue(light.ambient);
+        lit.Position     = D3DXVECTOR3(light.position.x, light.position.y, light.position.z);
+        lit.Range        = light.range;
+        lit.Attenuation0 = light.attenuation0;
+        lit.Attenuation1 = light.attenuation1;
+        lit.Attenuation2 = light.attenuation2;
+        pDevice->SetLight(0, &lit);
+        pDevice->LightEnable(0, TRUE);
         return true;
     }
+
     void destroy(void)
     {
-        if (m_pBoundMesh != NULL) {
-            m_pBoundMesh->Release();
-            m_pBoundMesh = NULL;
+        for (size_t i = 0; i < m_meshes.size(); i++) {
+            m_meshes[i]->Release();
         }
+        m_meshes.clear();
     }
-    void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
+
+    // the items in order, then all of the points in one call, unlit
+    void draw(IDirect3DDevice9* pDevice, const sim::RenderFrame& frame)
     {
         if (NULL == pDevice)
             return;
-        pDevice->SetTransform(D3DTS_WORLD, &mWorld);
-        pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-        pDevice->SetMaterial(&m_mtrl);
-		m_pBoundMesh->DrawSubset(0);
-    }
-	
-	bool hasIntersected(CSphere& ball) 
-	{
-		// Insert your code here.
-		float cord_x = ball.getCenter().x;
-		float cord_z = ball.getCenter().z;
-
-		float hit_boundary_min_x = this->m_x - this->getWidth() / 2 - ball.getRadius();
-		float hit_boundary_max_x = this->m_x + this->getWidth() / 2 + ball.getRadius();
-		float hit_boundary_min_z = this->m_z - this->getDepth() / 2 - ball.getRadius();
-		float hit_boundary_max_z = this->m_z + this->getDepth() / 2 + ball.getRadius();
-
-		if ((hit_boundary_min_x <= cord_x && cord_x <= hit_boundary_max_x) && (hit_boundary_min_z <= cord_z && cord_z <= hit_boundary_max_z)) {
-			return true;
-		}
-		else return false;
-
-		return false;
-	}
-
-	void hitBy(CSphere& ball) 
-	{
-		// Insert your code here.
-		if (hasIntersected(ball)) {
-
-			float cord_x = ball.getCenter().x;
-			float cord_z = ball.getCenter().z;
-
-			float boundary_min_x = this->m_x - this->getWidth() / 2;
-			float boundary_max_x = this->m_x + this->getWidth() / 2;
-			float boundary_min_z = this->m_z - this->getDepth() / 2;
-			float boundary_max_z = this->m_z + this->getDepth() / 2;
-
-			if ((boundary_min_x <= cord_x && cord_x <= boundary_max_x) && !(boundary_min_z <= cord_z && cord_z <= boundary_max_z)) {
-				if (boundary_min_z - ball.getRadius() <= cord_z && cord_z <= this->m_z) {
-					cord_z = boundary_min_z - ball.getRadius() - COR_VAL;
-				}
-				else {
-					cord_z = boundary_max_z + ball.getRadius() + COR_VAL;
-				}
-				ball.setPower(ball.getVelocity_X(), -ball.getVelocity_Z());
-			}
 
-			if (!(boundary_min_x <= cord_x && cord_x <= boundary_max_x) && (boundary_min_z <= cord_z && cord_z <= boundary_max_z)) {
-				if (boundary_min_x - ball.getRadius() <= cord_x && cord_x <= this->m_x) {
-					cord_x = boundary_min_x - ball.getRadius() - COR_VAL;
-				}
-				else {
-					cord_x = boundary_max_x + ball.getRadius() + COR_VAL;
-				}
-				ball.setPower(-ball.getVelocity_X(), ball.getVelocity_Z());
-			}
-
-			if (ball.isControlBall()) {
-				ball.setPower(0.0, 0.0);
-			}
-
-			ball.setCenter(cord_x, ball.getCenter().y, cord_z);
-		}
-	}    
-	
-	void setPosition(float x, float y, float z)
-	{
-		D3DXMATRIX m;
-		this->m_x = x;
-		this->m_z = z;
-
-		D3DXMatrixTranslation(&m, x, y, z);
-		setLocalTransform(m);
-	}
-
-	D3DXVECTOR3 CWall::getCenter(void) const
-	{
-		D3DXVECTOR3 org(m_x, 0, m_z);
-		return org;
-	}
-	
-    float getHeight(void) const { return M_HEIGHT; }
-	float getDepth(void) const { return m_depth; }
-	float getWidth(void) const { return m_width; }
-	
-	
-	
-private :
-    void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
-	
-	D3DXMATRIX              m_mLocal;
-    D3DMATERIAL9            m_mtrl;
-    ID3DXMesh*              m_pBoundMesh;
-};
-
-// -----------------------------------------------------------------------------
-// CLight class definition
-// -----------------------------------------------------------------------------
+        D3DMATERIAL9 mtrl;
+        ::ZeroMemory(&mtrl, sizeof(mtrl));
+        mtrl.Emissive = d3d::BLACK;
+        for (size_t i = 0; i < frame.items.size(); i++) {
+            const sim::RenderItem& item = frame.items[i];
+            D3DXMATRIX mWorld(&item.world.m[0][0]);
+            D3DXCOLOR color(item.color);
+            mtrl.Ambient  = color;
+            mtrl.Diffuse  = color;
+            mtrl.Specular = color;
+            mtrl.Power    = item.power;
+            pDevice->SetTransform(D3DTS_WORLD, &mWorld);
+            pDevice->SetMaterial(&mtrl);
+            m_meshes[item.mesh]->DrawSubset(0);
+        }
 
-class CLight {
-public:
-    CLight(void)
-    {
-        static DWORD i = 0;
-        m_index = i++;
-        D3DXMatrixIdentity(&m_mLocal);
-        ::ZeroMemory(&m_lit, sizeof(m_lit));
-        m_pMesh = NULL;
-        m_bound._center = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
-        m_bound._radius = 0.0f;
-    }
-    ~CLight(void) {}
-public:
-    bool create(IDirect3DDevice9* pDevice, const D3DLIGHT9& lit, float radius = 0.1f)
-    {
-        if (NULL == pDevice)
-            return false;
-        if (FAILED(D3DXCreateSphere(pDevice, radius, 10, 10, &m_pMesh, NULL)))
-            return false;
-		
-        m_bound._center = lit.Position;
-        m_bound._radius = radius;
-		
-        m_lit.Type          = lit.Type;
-        m_lit.Diffuse       = lit.Diffuse;
-        m_lit.Specular      = lit.Specular;
-        m_lit.Ambient       = lit.Ambient;
-        m_lit.Position      = lit.Position;
-        m_lit.Direction     = lit.Direction;
-        m_lit.Range         = lit.Range;
-        m_lit.Falloff       = lit.Falloff;
-        m_lit.Attenuation0  = lit.Attenuation0;
-        m_lit.Attenuation1  = lit.Attenuation1;
-        m_lit.Attenuation2  = lit.Attenuation2;
-        m_lit.Theta         = lit.Theta;
-        m_lit.Phi           = lit.Phi;
-        return true;
-    }
-    void destroy(void)
-    {
-        if (m_pMesh != NULL) {
-            m_pMesh->Release();
-            m_pMesh = NULL;
+        if (!frame.points.empty()) {
+            D3DXMATRIX mIdentity;
+            D3DXMatrixIdentity(&mIdentity);
+            float pointSize = frame.pointSize;
+            pDevice->SetTransform(D3DTS_WORLD, &mIdentity);
+            pDevice->SetRenderState(D3DRS_LIGHTING, FALSE);
+            pDevice->SetRenderState(D3DRS_POINTSIZE, *(DWORD*)&pointSize);
+            pDevice->SetFVF(PARTICLE_FVF);
+            pDevice->DrawPrimitiveUP(D3DPT_POINTLIST, (UINT)frame.points.size(), &frame.points[0],
+                sizeof(sim::RenderPoint));
+            pDevice->SetRenderState(D3DRS_LIGHTING, TRUE);
         }
     }
-    bool setLight(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
-    {
-        if (NULL == pDevice)
-            return false;
-		
-        D3DXVECTOR3 pos(m_bound._center);
-        D3DXVec3TransformCoord(&pos, &pos, &m_mLocal);
-        D3DXVec3TransformCoord(&pos, &pos, &mWorld);
-        m_lit.Position = pos;
-		
-        pDevice->SetLight(m_index, &m_lit);
-        pDevice->LightEnable(m_index, TRUE);
-        return true;
-    }
 
-    void draw(IDirect3DDevice9* pDevice)
+private:
+    static D3DCOLORVALUE colorValue(const sim::Color4& c)
     {
-        if (NULL == pDevice)
-            return;
-        D3DXMATRIX m;
-        D3DXMatrixTranslation(&m, m_lit.Position.x, m_lit.Position.y, m_lit.Position.z);
-        pDevice->SetTransform(D3DTS_WORLD, &m);
-        pDevice->SetMaterial(&d3d::WHITE_MTRL);
-        m_pMesh->DrawSubset(0);
+        D3DCOLORVALUE v = { c.r, c.g, c.b, c.a };
+        return v;
     }
 
-    D3DXVECTOR3 getPosition(void) const { return D3DXVECTOR3(m_lit.Position); }
-
-private:
-    DWORD               m_index;
-    D3DXMATRIX          m_mLocal;
-    D3DLIGHT9           m_lit;
-    ID3DXMesh*          m_pMesh;
-    d3d::BoundingSphere m_bound;
+    std::vector<ID3DXMesh*> m_meshes;   // by index into the frame meshes
 };
 
 
 // -----------------------------------------------------------------------------
 // Global variables
 // -----------------------------------------------------------------------------
-CWall	g_legoPlane;
-CWall	g_legowall[wallCount];
-CSphere	g_sphere[brickCount];
-CSphere g_controlball;
-CSphere g_moveball;
-CLight	g_light;
+sim::Level g_level;
+sim::World g_world;
+bool g_useFixedStep = true;
+sim::FixedStep g_fixedStep(1000.0f / SIM_HZ * TIME_PER_MS, SIM_MAX_STEPS);
+
+// ball positions before the last simulation step, for interpolation
+sim::Vec3 g_prevControlball;
+sim::Vec3 g_prevMoveball;
+
+sim::InputRecorder g_recorder;
+sim::SnapshotArena g_snapshots;
+sim::JobSystem*  g_jobs = NULL;        // frame work: simulation, then the draw list
+sim::WorkerPool* g_workers = NULL;     // collision work of the extra balls, on g_jobs
+
+sim::ParticlePool g_particles;
+
+sim::RenderFrame g_renderFrame;        // what is drawn, filled by the draw list
+CRenderer        g_renderer;
+sim::Rasterizer  g_raster;             // F5 screenshots
 
 double g_camera_pos[3] = {0.0, 5.0, -8.0};
 
@@ -473,175 +212,174 @@ double g_camera_pos[3] = {0.0, 5.0, -8.0};
 // -----------------------------------------------------------------------------
 
 
-void destroyAllLegoBlock(void)
+// all input goes through here, between two simulation steps
+void applyInput(int type, float value)
 {
+	sim::Input input;
+	input.tick = g_world.ticks;
+	input.type = type;
+	input.value = value;
+	sim::applyInput(g_world, input);
+	g_recorder.record(input);
 }
 
-// initialization
-bool Setup()
+void toggleRecording(void)
 {
-	int i;
-
-	D3DXMatrixIdentity(&g_mWorld);
-	D3DXMatrixIdentity(&g_mView);
-	D3DXMatrixIdentity(&g_mProj);
-
-	// create plane and set the position
-	if (false == g_legoPlane.create(Device, -1, -1, 9, 0.03f, 6, d3d::GREEN)) return false;
-	g_legoPlane.setPosition(0.0f, -0.0006f / 5, 0.0f);
-
-	// create walls and set the position. note that there are four walls
-	if (false == g_legowall[0].create(Device, -1, -1, 9, 0.3f, 0.12f, d3d::DARKRED)) return false;
-	g_legowall[0].setPosition(0.0f, 0.12f, 3.06f);
-	if (false == g_legowall[1].create(Device, -1, -1, 9, 0.3f, 0.12f, d3d::DARKRED)) return false;
-	g_legowall[1].setPosition(0.0f, 0.12f, -3.06f);
-	/*if (false == g_legowall[2].create(Device, -1, -1, 0.12f, 0.3f, 6.24f, d3d::DARKRED)) return false;
-	g_legowall[2].setPosition(4.56f, 0.12f, 0.0f);*/
-	if (false == g_legowall[2].create(Device, -1, -1, 0.12f, 0.3f, 6.24f, d3d::DARKRED)) return false;
-	g_legowall[2].setPosition(-4.56f, 0.12f, 0.0f);
-
-	// set position and color for the bricks
-	// set position
-	for (int layer = 0; layer < 4; layer++) {
-		for (int nth = 0; nth < 13; nth++) {
-			spherePos[layer * 13 + nth][0] = 0.9f + (-0.9f * layer);
-			spherePos[layer * 13 + nth][1] = 0.43f * (nth - 6);
-		}
-	}
-	// set color
-	for (int i = 0; i < brickCount; i++) {
-		sphereColor[i] = d3d::YELLOW;
-	}
-
-	// create balls and set the position
-	for (i = 0; i < brickCount; i++) {
-		if (false == g_sphere[i].create(Device, sphereColor[i])) return false;
-		g_sphere[i].setCenter(spherePos[i][0], (float)M_RADIUS, spherePos[i][1]);
-		g_sphere[i].setPower(0, 0);
+	if (g_recorder.isRecording()) {
+		g_recorder.stop(g_world, RECORD_PATH);
+		return;
 	}
+	if (!g_useFixedStep) return;
+
+	// a recording starts from the level as set up
+	bool continuous = g_world.continuous;
+	g_world.setup(g_level);
+	g_world.continuous = continuous;
+	g_prevControlball = g_world.controlball.getCenter();
+	g_prevMoveball = g_world.moveball.getCenter();
+	g_recorder.start(g_world, g_level.getHash(), g_fixedStep.getStepTime());
+	g_snapshots.clear();
+}
 
-	// create controlball for control direction of moveball
-	if (false == g_controlball.create(Device, d3d::WHITE)) return false;
-	g_controlball.setCenter(4.5f - M_RADIUS, (float)M_RADIUS, .0f);
-	g_controlball.setControlBall(true);
-
-	// create moveball for destroy bricks
-	if (false == g_moveball.create(Device, d3d::RED)) return false;
-	g_moveball.setCenter(4.5f - 3 * M_RADIUS, (float)M_RADIUS, .0f);
-
-	// light setting 
-	D3DLIGHT9 lit;
-	::ZeroMemory(&lit, sizeof(lit));
-	lit.Type = D3DLIGHT_POINT;
-	lit.Diffuse = d3d::WHITE;
-	lit.Specular = d3d::WHITE * 0.9f;
-	lit.Ambient = d3d::WHITE * 0.9f;
-	lit.Position = D3DXVECTOR3(0.0f, 6.0f, 0.0f);
-	lit.Range = 100.0f;
-	lit.Attenuation0 = 0.0f;
-	lit.Attenuation1 = 0.7f;
-	lit.Attenuation2 = 0.0f;
-	if (false == g_light.create(Device, lit))
-		return false;
+void rewindWorld(void)
+{
+	// the recording would not match the world any more
+	if (g_recorder.isRecording()) return;
+	if (!g_snapshots.rewind(g_world)) return;
+	g_prevControlball = g_world.controlball.getCenter();
+	g_prevMoveball = g_world.moveball.getCenter();
+}
 
-	// Position and aim the camera.
-	D3DXVECTOR3 pos(9.0f, 9.0f, 0.0f);
-	D3DXVECTOR3 target(0.0f, 0.0f, 0.0f);
-	D3DXVECTOR3 up(0.0f, 2.0f, 0.0f);
-	D3DXMatrixLookAtLH(&g_mView, &pos, &target, &up);
-	Device->SetTransform(D3DTS_VIEW, &g_mView);
+void writeScreenshot(void)
+{
+	g_raster.render(g_renderFrame, g_jobs);
+	g_raster.writeImage(SCREENSHOT_PATH);
+}
 
-	// Set the projection matrix.
-	D3DXMatrixPerspectiveFovLH(&g_mProj, D3DX_PI / 4,
-		(float)Width / (float)Height, 1.0f, 100.0f);
-	Device->SetTransform(D3DTS_PROJECTION, &g_mProj);
+// initialization
+bool Setup()
+{
+	// place plane, walls, bricks and balls in the simulation
+	if (!g_level.load(LEVEL_PATH)) g_level.makeDefault();
+	g_world.setup(g_level);
+	// timeDelta from the message loop is unbounded, so sweep the ball to keep it from
+	// skipping through bricks and walls on a long frame
+	g_world.continuous = true;
+	g_snapshots.reset(g_world, REWIND_SNAPSHOTS, 4 * MULTIBALL_COUNT);
+	g_jobs = new sim::JobSystem(sim::WorkerPool::hardwareThreads());
+	g_workers = new sim::WorkerPool(*g_jobs);
+	g_world.workers = g_workers;
+	g_world.onBrickHit = sim::ParticlePool::brickHit;
+	g_world.onBrickHitContext = &g_particles;
+
+	g_prevControlball = g_world.controlball.getCenter();
+	g_prevMoveball = g_world.moveball.getCenter();
+
+	// camera, light, plane and walls, and the meshes of bricks and balls. note that the
+	// right side is left open
+	sim::renderSetup(g_renderFrame, g_world, g_level, Width, Height);
+	sim::renderUpdate(g_renderFrame, g_world, g_prevControlball, g_prevMoveball, &g_particles, NULL);
+	if (false == g_renderer.create(Device, g_renderFrame))
+		return false;
 
 	// Set render states.
 	Device->SetRenderState(D3DRS_LIGHTING, TRUE);
 	Device->SetRenderState(D3DRS_SPECULARENABLE, TRUE);
 	Device->SetRenderState(D3DRS_SHADEMODE, D3DSHADE_GOURAUD);
-
-	g_light.setLight(Device, g_mWorld);
 	return true;
 }
 
 void Cleanup(void)
 {
-    g_legoPlane.destroy();
-	for(int i = 0 ; i < 4; i++) {
-		g_legowall[i].destroy();
-	}
-    destroyAllLegoBlock();
-    g_light.destroy();
-}
-
-
-// timeDelta represents the time between the current image frame and the last image frame.
-// the distance of moving balls should be "velocity * timeDelta"
-bool Display(float timeDelta)
-{
-	int i = 0;
-	int j = 0;
+    g_renderer.destroy();
 
+	if (sim::profileEnabled()) sim::profileWrite(PROFILE_PATH);
+	sim::eventStop();
+	if (g_recorder.isRecording()) g_recorder.stop(g_world, RECORD_PATH);
 
-	if (Device)
-	{
-		Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x00afafaf, 1.0f, 0);
-		Device->BeginScene();
+	g_world.workers = NULL;
+	delete g_workers;
+	g_workers = NULL;
+	delete g_jobs;
+	g_jobs = NULL;
+}
 
-		// update the position of balls.
-		g_moveball.ballUpdate(timeDelta);
-		g_controlball.ballUpdate(timeDelta);
-		for (i = 0; i < brickCount; i++) {
-			g_sphere[i].ballUpdate(timeDelta);
-		}
 
-		// update the position of each ball. during update, check whether each ball hit by walls.
-		for (i = 0; i < brickCount; i++) {
-			for (j = 0; j < wallCount; j++) { g_legowall[j].hitBy(g_moveball); }
-		}
+// -----------------------------------------------------------------------------
+// Frame jobs
+// the simulation runs first, then the transforms of everything drawn are built in
+// parallel. the draw calls stay on the thread of the device.
+// -----------------------------------------------------------------------------
+struct Frame
+{
+	float timeDelta;
+	float alpha;        // interpolation between the last two simulation states
+};
 
-		// update the position of moveball. Check whether any two balls hit together and update the direction of moveball.
-		for (i = 0; i < brickCount; i++) {
-			g_sphere[i].hitBy(g_moveball);
+void simulateFrame(void* context)
+{
+	Frame* frame = (Frame*)context;
+
+	// update the position of balls and resolve collisions
+	frame->alpha = 1.0f;
+	int restarts = g_world.restarts;
+	if (g_useFixedStep) {
+		int steps = g_fixedStep.advance(frame->timeDelta);
+		for (int i = 0; i < steps; i++) {
+			g_prevControlball = g_world.controlball.getCenter();
+			g_prevMoveball = g_world.moveball.getCenter();
+			g_world.step(g_fixedStep.getStepTime());
+			if (g_world.ticks % SNAPSHOT_TICKS == 0) g_snapshots.save(g_world);
 		}
+		frame->alpha = g_fixedStep.getAlpha();
+	}
+	else {
+		g_world.step(frame->timeDelta);
+		if (g_world.ticks % SNAPSHOT_TICKS == 0) g_snapshots.save(g_world);
+	}
+	// do not interpolate the ball across a restart
+	if (restarts != g_world.restarts) {
+		g_prevControlball = g_world.controlball.getCenter();
+		g_prevMoveball = g_world.moveball.getCenter();
+	}
 
-		// update the position of controlball. Check whether legowall hit by controlball.
-		for (i = 0; i < wallCount; i++) {
-			g_legowall[i].hitBy(g_controlball);
-		}
+	// the debris goes by frame time, it is not part of the simulation
+	SIM_PROFILE_SCOPE(sim::STAGE_PARTICLES);
+	g_particles.update(frame->timeDelta);
+}
 
-		// update the position of moveball. Check whether controlball hit by moveball.
-		g_controlball.hitBy(g_moveball);
+void buildDrawList(void* context)
+{
+	Frame* frame = (Frame*)context;
 
-		// If game not started, moveball follows controlball
-		if (!game_start) g_moveball.setCenter(g_controlball.getCenter().x - 2 * g_controlball.getRadius(), g_controlball.getCenter().y, g_controlball.getCenter().z);
+	sim::Vec3 controlball = sim::lerp(g_prevControlball, g_world.controlball.getCenter(), frame->alpha);
+	sim::Vec3 moveball = sim::lerp(g_prevMoveball, g_world.moveball.getCenter(), frame->alpha);
+	sim::renderUpdate(g_renderFrame, g_world, controlball, moveball, &g_particles, g_jobs);
+}
 
-		// If ball out of field, restart game
-		if (g_moveball.getCenter().x >= 8.0f) {
-			game_start = false;
-			g_moveball.setCenter(g_controlball.getCenter().x - 2 * g_controlball.getRadius(), g_controlball.getCenter().y, g_controlball.getCenter().z);
-			g_moveball.setPower(0, 0);
 
-			// balls set the position
-			for (i = 0; i < brickCount; i++) {
-				g_sphere[i].setCenter(spherePos[i][0], (float)M_RADIUS, spherePos[i][1]);
-				g_sphere[i].setPower(0, 0);
-			}
-		}
+// timeDelta represents the time between the current image frame and the last image frame.
+// the distance of moving balls should be "velocity * timeDelta"
+bool Display(float timeDelta)
+{
+	if (Device)
+	{
+		SIM_PROFILE_SCOPE(sim::STAGE_FRAME);
+		Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, g_renderFrame.clearColor, 1.0f, 0);
+		Device->BeginScene();
 
-		// draw plane, walls, and spheres
-		g_legoPlane.draw(Device, g_mWorld);
-		for (i = 0; i < wallCount; i++) {
-			g_legowall[i].draw(Device, g_mWorld);
-		}
+		Frame frame;
+		frame.timeDelta = timeDelta;
+		sim::Job* simulate = g_jobs->create(simulateFrame, &frame);
+		sim::Job* drawList = g_jobs->create(buildDrawList, &frame);
+		g_jobs->depend(drawList, simulate);
+		g_jobs->submit(drawList);
+		g_jobs->submit(simulate);
+		g_jobs->wait(drawList);
 
-		for (int i = 0; i < brickCount; i++) {
-			g_sphere[i].draw(Device, g_mWorld);
-		}
-		g_controlball.draw(Device, g_mWorld);
-		g_moveball.draw(Device, g_mWorld);
-		g_light.draw(Device);
+		// draw plane, walls, bricks, balls and debris
+		SIM_PROFILE_SCOPE(sim::STAGE_DRAW);
+		g_renderer.draw(Device, g_renderFrame);
 
 		Device->EndScene();
 		Device->Present(0, 0, 0, 0);
@@ -670,6 +408,25 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		case VK_ESCAPE:
 			::DestroyWindow(hwnd);
 			break;
+		case VK_F2:
+			if (sim::profileEnabled()) sim::profileWrite(PROFILE_PATH);
+			break;
+		case VK_F3:
+			if (sim::eventRunning()) sim::eventStop();
+			else sim::eventStart(EVENT_PATH, sim::EVENT_TEXT);
+			break;
+		case VK_F4:
+			toggleRecording();
+			break;
+		case VK_F5:
+			writeScreenshot();
+			break;
+		case VK_BACK:
+			rewindWorld();
+			break;
+		case 'B':
+			applyInput(sim::INPUT_SPAWN, (float)MULTIBALL_COUNT);
+			break;
 		case VK_RETURN:
 			if (NULL != Device) {
 				wire = !wire;
@@ -678,69 +435,25 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 			}
 			break;
 		case VK_LEFT:
-		{
-			float new_z;
-
-			float boundary_max_z = g_legowall[0].getCenter().z - g_legowall[0].getDepth() / 2 - g_controlball.getRadius();
-			float boundary_min_z = g_legowall[1].getCenter().z + g_legowall[1].getDepth() / 2 + g_controlball.getRadius();
-
-			D3DXVECTOR3 coord3d = g_controlball.getCenter();
-
-			new_z = coord3d.z + 10 * (-0.01f);
-
-			if (new_z > boundary_max_z) {
-				new_z = boundary_max_z;
-			}
-
-			if (new_z < boundary_min_z) {
-				new_z = boundary_min_z;
-			}
-
-			g_controlball.setCenter(coord3d.x, coord3d.y, new_z);
-
+			applyInput(sim::INPUT_MOVE, 10 * (-0.01f));
 			move = WORLD_MOVE;
 			break;
-		}
 		case VK_RIGHT:
-		{
-			float new_z;
-
-			float boundary_max_z = g_legowall[0].getCenter().z - g_legowall[0].getDepth() / 2 - g_controlball.getRadius();
-			float boundary_min_z = g_legowall[1].getCenter().z + g_legowall[1].getDepth() / 2 + g_controlball.getRadius();
-
-			D3DXVECTOR3 coord3d = g_controlball.getCenter();
-
-			new_z = coord3d.z + 10 * (0.01f);
-
-			if (new_z > boundary_max_z) {
-				new_z = boundary_max_z;
-			}
-
-			if (new_z < boundary_min_z) {
-				new_z = boundary_min_z;
-			}
-
-			g_controlball.setCenter(coord3d.x, coord3d.y, new_z);
-
+			applyInput(sim::INPUT_MOVE, 10 * (0.01f));
 			move = WORLD_MOVE;
 			break;
-		}
 		case VK_SPACE:
 			//D3DXVECTOR3 targetpos = g_controlball.getCenter();
 			//D3DXVECTOR3	whitepos = g_moveball.getCenter();
 			//double theta = acos(sqrt(pow(targetpos.x - whitepos.x, 2)) / sqrt(pow(targetpos.x - whitepos.x, 2) +
-			//	pow(targetpos.z - whitepos.z, 2)));		// ⺻ 1 и
-			//if (targetpos.z - whitepos.z <= 0 && targetpos.x - whitepos.x >= 0) { theta = -theta; }	//4 и
-			//if (targetpos.z - whitepos.z >= 0 && targetpos.x - whitepos.x <= 0) { theta = PI - theta; } //2 и
-			//if (targetpos.z - whitepos.z <= 0 && targetpos.x - whitepos.x <= 0) { theta = PI + theta; } // 3 и
+			//	pow(targetpos.z - whitepos.z, 2)));		// ±âº» 1 »çºÐ¸é
+			//if (targetpos.z - whitepos.z <= 0 && targetpos.x - whitepos.x >= 0) { theta = -theta; }	//4 »çºÐ¸é
+			//if (targetpos.z - whitepos.z >= 0 && targetpos.x - whitepos.x <= 0) { theta = PI - theta; } //2 »çºÐ¸é
+			//if (targetpos.z - whitepos.z <= 0 && targetpos.x - whitepos.x <= 0) { theta = PI + theta; } // 3 »çºÐ¸é
 			//double distance = sqrt(pow(targetpos.x - whitepos.x, 2) + pow(targetpos.z - whitepos.z, 2));
 			//g_moveball.setPower(distance * cos(theta), distance * sin(theta));
 			//break;
-			if (!game_start) {
-				game_start = true;
-
-				g_moveball.setPower(-2.5f, 0.0);
-			}
+			applyInput(sim::INPUT_LAUNCH, 0.0f);
 			break;
 		}
 		break;
@@ -752,32 +465,13 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		int new_y = HIWORD(lParam);
 		float dx;
 		float dy;
-		float new_z;
-
-		float boundary_max_z = g_legowall[0].getCenter().z - g_legowall[0].getDepth() / 2 - g_controlball.getRadius();
-		float boundary_min_z = g_legowall[1].getCenter().z + g_legowall[1].getDepth() / 2 + g_controlball.getRadius();
 
 		if (LOWORD(wParam) & MK_RBUTTON) {
 
 			dx = (old_x - new_x);// * 0.01f;
 			dy = (old_y - new_y);// * 0.01f;
 
-			D3DXVECTOR3 coord3d = g_controlball.getCenter();
-
-			g_controlball.setCenter(4.5f - M_RADIUS, (float)M_RADIUS, .0f);
-			g_controlball.setControlBall(true);
-
-			new_z = coord3d.z + dx * (-0.01f);
-
-			if (new_z > boundary_max_z) {
-				new_z = boundary_max_z;
-			}
-
-			if (new_z < boundary_min_z) {
-				new_z = boundary_min_z;
-			}
-
-			g_controlball.setCenter(coord3d.x, coord3d.y, new_z);
+			applyInput(sim::INPUT_MOVE, dx * (-0.01f));
 			old_x = new_x;
 			old_y = new_y;
 